@@ -0,0 +1,303 @@
+/*********************************************************************
+ ** Stochastic Ranking Evolution Strategy                           **
+ ** benchmark of the per-generation MPI communication               **
+ **                                                                 **
+ ** For ACADEMIC RESEARCH, this is licensed with GPL license        **
+ ** For COMMERCIAL ACTIVITIES, please contact the authors           **
+ **                                                                 **
+ ** This program is distributed in the hope that it will be useful, **
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of  **
+ ** MERCHANTABILITY of FITNESS FOR A PARTICULAR PURPOSE. See the    **
+ ** GNU General Public License for more details.                    **
+ **                                                                 **
+ ** build: scons mpi=1 bench=1, or                                  **
+ **   mpic++ -O2 libsres-mpi/ESDispatchBench.cpp -o dispatch-bench  **
+ ** run: for np in 16 64 256; do mpirun -np $np ./dispatch-bench    **
+ **        [lambda] [dim] [generations]; done                       **
+ **                                                                 **
+ ** every generation the master hands lambda individuals of dim     **
+ ** parameters to the slaves and collects g, f and phi of each,     **
+ ** with evaluation that costs nothing, so only the messages are    **
+ ** timed:                                                          **
+ ** blocking: the protocol before ESMPIDispatch, MPI_Send of every  **
+ **   op round-robin, an OK to each slave in turn before its        **
+ **   results, then MPI_Barrier                                     **
+ ** dispatch: the MPI_Isend/MPI_Irecv protocol of ESMPIDispatch and **
+ **   the slave loop of ESMPIMutate, with esMPIChunk = 1            **
+ *********************************************************************/
+
+/* the MPI env of SConstruct passes -D MPI, which OpenMPI's C++
+   bindings use as a namespace */
+#if defined(MPI)
+	#undef MPI
+	#define OMPI_SKIP_MPICXX 1 /* only the C API is used */
+	#define MPICH_SKIP_MPICXX 1
+	#include <mpi.h>
+	#define MPI
+#else
+	#include <mpi.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define esBenchPrefetch 2
+
+static int benchLambda, benchDim;
+static double *benchOp, *benchGfphi;
+
+/*********************************************************************
+ ** evaluation that costs nothing: gfphi = (f, phi)                 **
+ *********************************************************************/
+static void ESBenchEvaluate(double *op, double *gfphi)
+{
+  gfphi[0] = op[0]*0.5;
+  gfphi[1] = 0;
+
+  return;
+}
+
+/*********************************************************************
+ ** the blocking protocol                                           **
+ ** ESBenchBlockingMaster(numprocs), ESBenchBlockingSlave(me,       **
+ **   numprocs)                                                     **
+ *********************************************************************/
+static void ESBenchBlockingMaster(int numprocs)
+{
+  MPI_Status status;
+  int i, j, l;
+
+  for(i=0, j=1; i<benchLambda; i++, j++)
+  {
+    if(j == numprocs)
+      j = 1;
+    MPI_Send(benchOp+i*benchDim, benchDim, MPI_DOUBLE, j, i,   \
+             MPI_COMM_WORLD);
+  }
+  for(l=1; l<numprocs; l++)
+  {
+    MPI_Send((void *)"OK", 2, MPI_BYTE, l, l, MPI_COMM_WORLD);
+    for(i=0, j=1; i<benchLambda; i++, j++)
+    {
+      if(j == numprocs)
+        j = 1;
+      if(j != l)
+        continue;
+      MPI_Recv(benchGfphi+2*i, 2, MPI_DOUBLE, j, i, MPI_COMM_WORLD,   \
+               &status);
+    }
+  }
+
+  return;
+}
+static void ESBenchBlockingSlave(int me, int numprocs)
+{
+  MPI_Status status;
+  int i, j;
+  char ok[2];
+
+  for(i=0, j=1; i<benchLambda; i++, j++)
+  {
+    if(j == numprocs)
+      j = 1;
+    if(j != me)
+      continue;
+    MPI_Recv(benchOp+i*benchDim, benchDim, MPI_DOUBLE, 0, i,   \
+             MPI_COMM_WORLD, &status);
+    ESBenchEvaluate(benchOp+i*benchDim, benchGfphi+2*i);
+  }
+  MPI_Recv(ok, 2, MPI_BYTE, 0, me, MPI_COMM_WORLD, &status);
+  for(i=0, j=1; i<benchLambda; i++, j++)
+  {
+    if(j == numprocs)
+      j = 1;
+    if(j != me)
+      continue;
+    MPI_Send(benchGfphi+2*i, 2, MPI_DOUBLE, 0, i, MPI_COMM_WORLD);
+  }
+
+  return;
+}
+
+/*********************************************************************
+ ** the non-blocking protocol of ESMPIDispatch                      **
+ ** ESBenchDispatchMaster(numprocs), ESBenchDispatchSlave()         **
+ *********************************************************************/
+static void ESBenchDispatchMaster(int numprocs)
+{
+  MPI_Status status;
+  MPI_Request *recvs, *sends;
+  int *pending;
+  double *gfphi;
+  int numslaves, numsends, next, inflight, done;
+  int i, j, k;
+
+  numslaves = numprocs - 1;
+  recvs = (MPI_Request *)malloc(numslaves*sizeof(MPI_Request));
+  sends = (MPI_Request *)malloc((benchLambda+numslaves)*sizeof(MPI_Request));
+  pending = (int *)calloc(numslaves, sizeof(int));
+  gfphi = (double *)malloc(2*numslaves*sizeof(double));
+
+  next = 0;
+  numsends = 0;
+  inflight = 0;
+  for(j=0; j<numslaves; j++)
+  {
+    for(k=0; k<esBenchPrefetch && next<benchLambda; k++, next++)
+    {
+      MPI_Isend(benchOp+next*benchDim, benchDim, MPI_DOUBLE, j+1, next,   \
+                MPI_COMM_WORLD, &(sends[numsends++]));
+      pending[j]++;
+    }
+    if(pending[j] > 0)
+    {
+      MPI_Irecv(gfphi+2*j, 2, MPI_DOUBLE, j+1, MPI_ANY_TAG,   \
+                MPI_COMM_WORLD, &(recvs[j]));
+      inflight++;
+    }
+    else
+    {
+      MPI_Isend(NULL, 0, MPI_DOUBLE, j+1, 0, MPI_COMM_WORLD,   \
+                &(sends[numsends++]));
+      recvs[j] = MPI_REQUEST_NULL;
+    }
+  }
+
+  while(inflight > 0 || next < benchLambda)
+  {
+    done = 0;
+    if(inflight > 0)
+    {
+      if(next < benchLambda)
+        MPI_Testany(numslaves, recvs, &j, &done, &status);
+      else
+      {
+        MPI_Waitany(numslaves, recvs, &j, &status);
+        done = 1;
+      }
+    }
+    if(!done)
+    {
+      ESBenchEvaluate(benchOp+next*benchDim, benchGfphi+2*next);
+      next++;
+      continue;
+    }
+
+    i = status.MPI_TAG;
+    memcpy(benchGfphi+2*i, gfphi+2*j, 2*sizeof(double));
+    pending[j]--;
+    if(next < benchLambda)
+    {
+      MPI_Isend(benchOp+next*benchDim, benchDim, MPI_DOUBLE, j+1, next,   \
+                MPI_COMM_WORLD, &(sends[numsends++]));
+      pending[j]++;
+      next++;
+    }
+    if(pending[j] > 0)
+      MPI_Irecv(gfphi+2*j, 2, MPI_DOUBLE, j+1, MPI_ANY_TAG,   \
+                MPI_COMM_WORLD, &(recvs[j]));
+    else
+    {
+      MPI_Isend(NULL, 0, MPI_DOUBLE, j+1, 0, MPI_COMM_WORLD,   \
+                &(sends[numsends++]));
+      inflight--;
+    }
+  }
+
+  MPI_Waitall(numsends, sends, MPI_STATUSES_IGNORE);
+  free(recvs);
+  free(sends);
+  free(pending);
+  free(gfphi);
+
+  return;
+}
+static void ESBenchDispatchSlave()
+{
+  MPI_Status status;
+  MPI_Request recv, send;
+  double *op, gfphi[2][2];
+  int l, count, index;
+
+  op = (double *)malloc(2*benchDim*sizeof(double));
+  send = MPI_REQUEST_NULL;
+  MPI_Irecv(op, benchDim, MPI_DOUBLE, 0, MPI_ANY_TAG, MPI_COMM_WORLD,   \
+            &recv);
+  for(l=0; ; l=1-l)
+  {
+    MPI_Wait(&recv, &status);
+    MPI_Get_count(&status, MPI_DOUBLE, &count);
+    if(count == 0)
+      break;
+    index = status.MPI_TAG;
+    MPI_Irecv(op+(1-l)*benchDim, benchDim, MPI_DOUBLE, 0, MPI_ANY_TAG,   \
+              MPI_COMM_WORLD, &recv);
+    ESBenchEvaluate(op+l*benchDim, gfphi[l]);
+    MPI_Wait(&send, MPI_STATUS_IGNORE);
+    MPI_Isend(gfphi[l], 2, MPI_DOUBLE, 0, index, MPI_COMM_WORLD, &send);
+  }
+  MPI_Wait(&send, MPI_STATUS_IGNORE);
+  free(op);
+
+  return;
+}
+
+int main(int argc, char **argv)
+{
+  int me, numprocs, generations, g, i, k, protocol;
+  double start, elapsed;
+
+  MPI_Init(&argc, &argv);
+  MPI_Comm_rank(MPI_COMM_WORLD, &me);
+  MPI_Comm_size(MPI_COMM_WORLD, &numprocs);
+  benchLambda = argc > 1 ? atoi(argv[1]) : 1024;
+  benchDim = argc > 2 ? atoi(argv[2]) : 45;
+  generations = argc > 3 ? atoi(argv[3]) : 20;
+  if(numprocs < 2)
+  {
+    if(me == 0)
+      printf("dispatch-bench needs at least 2 processors\n");
+    MPI_Finalize();
+    return 1;
+  }
+
+  benchOp = (double *)malloc(benchLambda*benchDim*sizeof(double));
+  benchGfphi = (double *)malloc(2*benchLambda*sizeof(double));
+  for(i=0; i<benchLambda; i++)
+    for(k=0; k<benchDim; k++)
+      benchOp[i*benchDim+k] = i + k;
+
+  for(protocol=0; protocol<2; protocol++)
+  {
+    MPI_Barrier(MPI_COMM_WORLD);
+    start = MPI_Wtime();
+    for(g=0; g<generations; g++)
+    {
+      if(protocol == 0)
+      {
+        if(me == 0)
+          ESBenchBlockingMaster(numprocs);
+        else
+          ESBenchBlockingSlave(me, numprocs);
+        MPI_Barrier(MPI_COMM_WORLD);
+      }
+      else if(me == 0)
+        ESBenchDispatchMaster(numprocs);
+      else
+        ESBenchDispatchSlave();
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+    elapsed = MPI_Wtime() - start;
+    if(me == 0)
+      printf("np=%4d lambda=%5d dim=%3d %-8s %10.1f us/generation\n",   \
+             numprocs, benchLambda, benchDim,   \
+             protocol == 0 ? "blocking" : "dispatch",   \
+             elapsed/generations*1e6);
+  }
+
+  free(benchOp);
+  free(benchGfphi);
+  MPI_Finalize();
+
+  return 0;
+}
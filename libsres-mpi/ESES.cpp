@@ -46,11 +46,24 @@
 #include "sharefunc.hpp"
 #include "ESSRSort.hpp"
 #include "ESES.hpp"
+#include "ESKernel.hpp"
 
 #include "../source/io.hpp"
 
 extern int printing_precision; // Declared in main.cpp
 
+/*********************************************************************
+ ** communicator the processors of this population evolve in,       **
+ ** MPI_COMM_WORLD unless the processors are split into islands     **
+ *********************************************************************/
+MPI_Comm esMPIComm = MPI_COMM_WORLD;
+
+/*********************************************************************
+ ** number of individuals handed to a processor at once, i.e. how   **
+ ** many it can evaluate at the same time                           **
+ *********************************************************************/
+int esMPIChunk = 1;
+
 /*********************************************************************
  ** Initialize: parameters,populations and random seed              **
  ** ESInitial( argc, argv,                                          **
@@ -62,6 +75,7 @@ extern int printing_precision; // Declared in main.cpp
  ** param: point to parameter                                       **
  ** trsfm: to transform sp/op                                       **
  ** fg: functions of fitness and constraints                        **
+ ** fgbatch: fg for a batch of individuals, NULL to call fg on each **
  ** es: ES process, esDefESPlus/esDefESSlash                        **
  ** constraint: number of constraints                               **
  ** dim: dimension/number of genes in genome                        **
@@ -83,7 +97,7 @@ extern int printing_precision; // Declared in main.cpp
  ** stats: statistics for each generation                           **
  **                                                                 **
  ** Initialize MPI                                                  **
- ** processors >=2, print seed if master                            **
+ ** any number of processors, rank 0 also evaluates individuals     **
  **                                                                 **
  ** ESDeInitial(param,population,stats)                             **
  ** free param and population                                       **
@@ -91,25 +105,21 @@ extern int printing_precision; // Declared in main.cpp
  *********************************************************************/
 void ESInitial(/*int *argc, char ***argv,   */\
                unsigned int seed, ESParameter ** param,ESfcnTrsfm *trsfm,  \
-               ESfcnFG fg, int es, int constraint, int dim, double* ub,   \
+               ESfcnFG fg, ESfcnFGBatch fgbatch, int es, int constraint,   \
+               int dim, double* ub,   \
                double *lb, int miu, int lambda, int gen,  \
                double gamma, double alpha, double varphi, int retry,  \
                ESPopulation ** population, ESStatistics **stats)
 {
   unsigned int outseed;
-  int myid, numprocs;
+  int myid;
 
   //MPI_Init(argc, argv);
-  MPI_Comm_rank(MPI_COMM_WORLD, &myid);
-  MPI_Comm_size(MPI_COMM_WORLD, &numprocs);
-  if(numprocs < 2)
-  {
-    printf("Requiring at least 2 processes!\n");
-    exit(1);
-  }
+  MPI_Comm_rank(esMPIComm, &myid);
 
   ShareSeed(seed, &outseed);
-  ESInitialParam(param, trsfm, fg, es, outseed,constraint, dim, ub, lb,   \
+  ESInitialParam(param, trsfm, fg, fgbatch, es, outseed,constraint,   \
+                 dim, ub, lb,   \
                  miu, lambda, gen, gamma, alpha, varphi, retry);
   ESInitialPopulation(population, (*param));
   ESInitialStat(stats, (*population), (*param));
@@ -128,6 +138,7 @@ void ESDeInitial(ESParameter *param, ESPopulation *population,   \
   ESDeInitialPopulation(population, param);
   ESDeInitialStat(stats);
   ESDeInitialParam(param);
+  ESSRTeamFree();
 
   MPI_Finalize();
   return;
@@ -135,11 +146,12 @@ void ESDeInitial(ESParameter *param, ESPopulation *population,   \
 
 /*********************************************************************
  ** initialize parameters                                           **
- ** ESInitialParam(param, trsfm, fg,constraint,                     **
+ ** ESInitialParam(param, trsfm, fg,fgbatch,constraint,             **
  **                dim,ub,lb,miu,lambda,gen)                        **
  ** param: point to parameter                                       **
  ** trsfm: to transform sp/op                                       **
  ** fg: functions of fitness and constraints                        **
+ ** fgbatch: fg for a batch of individuals, NULL to call fg on each **
  ** es: ES process, esDefESPlus/esDefESSlash                        **
  ** seed: reserve seed for next use                                 **
  ** constraint: number of constraints                               **
@@ -164,7 +176,8 @@ void ESDeInitial(ESParameter *param, ESPopulation *population,   \
  ** free param                                                      **
  *********************************************************************/
 void ESInitialParam(ESParameter **param,ESfcnTrsfm *trsfm,  \
-                    ESfcnFG fg, int es, unsigned int seed,  \
+                    ESfcnFG fg, ESfcnFGBatch fgbatch,  \
+                    int es, unsigned int seed,  \
                     int constraint, int dim,  double *ub, double *lb,   \
                     int miu, int lambda, int gen,  \
                     double gamma, double alpha,  \
@@ -175,9 +188,11 @@ void ESInitialParam(ESParameter **param,ESfcnTrsfm *trsfm,  \
   (*param) = (ESParameter *)ShareMallocM1c(sizeof(ESParameter));
   (*param)->trsfm = NULL;
   (*param)->fg = NULL;
+  (*param)->fgbatch = NULL;
   (*param)->ub = NULL;
   (*param)->lb = NULL;
   (*param)->spb = NULL;
+  ShareArenaInit(&((*param)->arena));
 
   (*param)->spb = ShareMallocM1d(dim);
   for(i=0; i<dim; i++)
@@ -185,6 +200,7 @@ void ESInitialParam(ESParameter **param,ESfcnTrsfm *trsfm,  \
 
   (*param)->trsfm = trsfm;
   (*param)->fg = fg;
+  (*param)->fgbatch = fgbatch;
   (*param)->es = es;
   (*param)->seed = seed;
   (*param)->constraint = constraint;
@@ -212,11 +228,14 @@ void ESInitialParam(ESParameter **param,ESfcnTrsfm *trsfm,  \
   (*param)->tau = (*param)->varphi/(sqrt(2*sqrt(dim)));
   (*param)->tau_ = (*param)->varphi/(sqrt(2*dim));
 
+  ESKernelSelect(*param);
+
 
   return;
 }
 void ESDeInitialParam(ESParameter *param)
 {
+  ShareArenaFree(&(param->arena));
   ShareFreeM1d(param->spb);
   ShareFreeM1c((char *)param);
   param = NULL;
@@ -230,7 +249,8 @@ void ESDeInitialParam(ESParameter *param)
  ** param: point to this parameter                                  **
  **   -> index: 0->eslambda-1                                       **
  **   -> individual[eslambda]                                       **
- **   -> fg(individual)                                             **
+ **   -> ESMPIDispatch(individual[eslambda]) on rank 0, ESMPIMutate **
+ **      on the others, evaluating it like any generation           **
  **   -> f,phi                                                      **
  ** the initialization is looked as first generation                **
  **                                                                 **
@@ -239,16 +259,39 @@ void ESDeInitialParam(ESParameter *param)
  *********************************************************************/
 void ESInitialPopulation(ESPopulation **population, ESParameter *param)
 {
-  int i;
+  int i, j;
+  int myid;
   int eslambda;
+  int dim, constraint, stride;
+  double *ub, *lb;
+  double *op, *sp;
 
   eslambda = param->eslambda;
+  dim = param->dim;
+  constraint = param->constraint;
+  ub = param->ub;
+  lb = param->lb;
+  stride = ShareAlignedStride(dim);
 
   (*population) = (ESPopulation *)ShareMallocM1c(sizeof(ESPopulation));
   (*population)->member = NULL;
   (*population)->f = NULL;
   (*population)->phi = NULL;
   (*population)->index = NULL;
+  (*population)->op = NULL;
+  (*population)->sp = NULL;
+  (*population)->g = NULL;
+  (*population)->rows = NULL;
+  (*population)->backop = NULL;
+  (*population)->backsp = NULL;
+  (*population)->backg = NULL;
+  (*population)->backf = NULL;
+  (*population)->backphi = NULL;
+  (*population)->parent = NULL;
+  (*population)->randscalar = NULL;
+  (*population)->randsp = NULL;
+  (*population)->randop = NULL;
+  (*population)->step = NULL;
 
   (*population)->member = (ESIndividual **)  \
                    ShareMallocM1c(eslambda*sizeof(ESIndividual *));
@@ -257,11 +300,47 @@ void ESInitialPopulation(ESPopulation **population, ESParameter *param)
 
   (*population)->index = ShareMallocM1i(eslambda);
 
+  (*population)->stride = stride;
+  (*population)->op = ShareMallocAlignedM1d(eslambda*stride);
+  (*population)->sp = ShareMallocAlignedM1d(eslambda*stride);
+  (*population)->g = ShareMallocAlignedM1d(eslambda*constraint);
+  (*population)->rows = (ESIndividual *)  \
+                   ShareMallocM1c(eslambda*sizeof(ESIndividual));
+  (*population)->backop = ShareMallocAlignedM1d(eslambda*stride);
+  (*population)->backsp = ShareMallocAlignedM1d(eslambda*stride);
+  (*population)->backg = ShareMallocAlignedM1d(eslambda*constraint);
+  (*population)->backf = ShareMallocM1d(eslambda);
+  (*population)->backphi = ShareMallocM1d(eslambda);
+  (*population)->parent = ShareMallocM1i(eslambda);
+  (*population)->randscalar = ShareMallocM1d(eslambda);
+  (*population)->randsp = ShareMallocAlignedM1d(eslambda*stride);
+  (*population)->randop = ShareMallocAlignedM1d(eslambda*stride);
+  (*population)->step = ShareMallocAlignedM1d(stride);
+  ESPointMembers((*population), param);
+  (*population)->generation = 0;
+
   for(i=0; i<eslambda; i++)
   {
-    (*population)->member[i] = NULL;
-    ESInitialIndividual(&((*population)->member[i]), param);
+    op = ESRowOp((*population), i);
+    sp = ESRowSp((*population), i);
+    for(j=0; j<dim; j++)
+    {
+      op[j] = ShareRand(lb[j], ub[j], 0, i, j, esDefStreamInit);
+      sp[j] = (ub[j] - lb[j])/sqrt(dim);
+    }
+    (*population)->member[i]->f = HUGE_VAL;
+    (*population)->member[i]->phi = 0.0;
     (*population)->index[i] = i;
+    (*population)->parent[i] = i;
+  }
+
+  MPI_Comm_rank(esMPIComm, &myid);
+  if(myid == 0)
+    ESMPIDispatch((*population)->member, eslambda, param);
+  else
+    ESMPIMutate((*population), param);
+  for(i=0; i<eslambda; i++)
+  {
     (*population)->f[i] = (*population)->member[i]->f;
     (*population)->phi[i] = (*population)->member[i]->phi;
   }
@@ -270,14 +349,21 @@ void ESInitialPopulation(ESPopulation **population, ESParameter *param)
 }
 void ESDeInitialPopulation(ESPopulation *population, ESParameter *param)
 {
-  int i;
-  int eslambda;
-
-  eslambda = param->eslambda;
-
-  for(i=0; i<eslambda; i++)
-    ESDeInitialIndividual(population->member[i]);
   ShareFreeM1c((char *)(population->member));
+  ShareFreeM1c((char *)(population->rows));
+  ShareFreeAlignedM1d(population->op);
+  ShareFreeAlignedM1d(population->sp);
+  ShareFreeAlignedM1d(population->g);
+  ShareFreeAlignedM1d(population->backop);
+  ShareFreeAlignedM1d(population->backsp);
+  ShareFreeAlignedM1d(population->backg);
+  ShareFreeM1d(population->backf);
+  ShareFreeM1d(population->backphi);
+  ShareFreeM1i(population->parent);
+  ShareFreeM1d(population->randscalar);
+  ShareFreeAlignedM1d(population->randsp);
+  ShareFreeAlignedM1d(population->randop);
+  ShareFreeAlignedM1d(population->step);
 
   ShareFreeM1d(population->f);
   ShareFreeM1d(population->phi);
@@ -292,9 +378,8 @@ void ESDeInitialPopulation(ESPopulation *population, ESParameter *param)
 /*********************************************************************
  ** initialize individual                                           **
  ** ESInitialIndividual(indvdl, param)                              **
- ** to calculate f,g,and phi                                        **
+ ** f=HUGE_VAL and phi=0 until the individual is evaluated          **
  ** to initialize op and sp                                         **
- ** phi=sum{(g>0)^2}                                                **
  ** op = rand(lb, ub)                                               **
  ** sp = (ub - lb)/sqrt(dim)                                        **
  **                                                                 **
@@ -312,12 +397,10 @@ void ESInitialIndividual(ESIndividual **indvdl, ESParameter *param)
   int i;
   int dim;
   int constraint;
-  ESfcnFG fg;
   double *ub, *lb;
 
   dim = param->dim;
   constraint = param->constraint;
-  fg = param->fg;
   ub = param->ub;
   lb = param->lb;
 
@@ -336,17 +419,12 @@ void ESInitialIndividual(ESIndividual **indvdl, ESParameter *param)
 
   for(i=0; i<dim; i++)
   {
-    (*indvdl)->op[i] = ShareRand(lb[i], ub[i]);
+    (*indvdl)->op[i] = ShareRand(lb[i], ub[i], 0, -1, i, esDefStreamInit);
     (*indvdl)->sp[i] = (ub[i] - lb[i])/sqrt(dim);
   }
 
-  fg((*indvdl)->op, &((*indvdl)->f), (*indvdl)->g);
+  (*indvdl)->f = HUGE_VAL;
   (*indvdl)->phi = 0.0;
-  for(i=0; i<constraint; i++)
-  {
-    if((*indvdl)->g[i] > 0.0)
-      (*indvdl)->phi += ((*indvdl)->g[i])*((*indvdl)->g[i]);
-  }
 
   return;
 }
@@ -422,30 +500,75 @@ void ESPrintSp(ESIndividual *indvdl, ESParameter *param)
  *********************************************************************/
 void ESCopyIndividual(ESIndividual *from, ESIndividual *to, ESParameter *param)
 {
-  int i;
   int dim;
   int constraint;
 
   dim = param->dim;
   constraint = param->constraint;
 
-  for(i=0; i<dim; i++)
-  {
-    to->op[i] = from->op[i];
-    to->sp[i] = from->sp[i];
-  }
-  for(i=0; i<constraint; i++)
-    to->g[i] = from->g[i];
+  memcpy(to->op, from->op, dim*sizeof(double));
+  memcpy(to->sp, from->sp, dim*sizeof(double));
+  if(constraint > 0)
+    memcpy(to->g, from->g, constraint*sizeof(double));
   to->f = from->f;
   to->phi = from->phi;
 
   return;
 }
 
+/*********************************************************************
+ ** evaluate individuals                                            **
+ ** ESEvaluate(indvdl, n, param)                                    **
+ ** to calculate f,g,and phi of indvdl[n]                           **
+ ** with one call of fgbatch, or fg on each if fgbatch is NULL      **
+ ** the batch arrays come from param->arena                         **
+ *********************************************************************/
+void ESEvaluate(ESIndividual **indvdl, int n, ESParameter *param)
+{
+  int i, j;
+  int constraint;
+  double **op, **g, *f;
+
+  constraint = param->constraint;
+
+  if(param->fgbatch == NULL)
+  {
+    for(i=0; i<n; i++)
+      param->fg(indvdl[i]->op, &(indvdl[i]->f), indvdl[i]->g);
+  }
+  else
+  {
+    op = (double **)ShareArenaMallocM1c(&(param->arena), n*sizeof(double *));
+    g = (double **)ShareArenaMallocM1c(&(param->arena), n*sizeof(double *));
+    f = ShareArenaMallocM1d(&(param->arena), n);
+    for(i=0; i<n; i++)
+    {
+      op[i] = indvdl[i]->op;
+      g[i] = indvdl[i]->g;
+    }
+    param->fgbatch(op, n, f, g);
+    for(i=0; i<n; i++)
+      indvdl[i]->f = f[i];
+  }
+
+  for(i=0; i<n; i++)
+  {
+    indvdl[i]->phi = 0.0;
+    for(j=0; j<constraint; j++)
+    {
+      if(indvdl[i]->g[j] > 0.0)
+        indvdl[i]->phi += (indvdl[i]->g[j] * indvdl[i]->g[j]);
+    }
+  }
+
+  return;
+}
+
 /*********************************************************************
  ** initialize statistics                                           **
  ** ESInitialStat(stats, population, param)                         **
  ** to intialize time, curgen, bestindvdl,thisbestindvdl            **
+ ** bestindvdl,thisbestindvdl are not evaluated (f=HUGE_VAL)        **
  ** not to do the first statistics                                  **
  ** to set dt, bestgen                                              **
  **                                                                 **
@@ -558,25 +681,32 @@ void ESPrintStat(ESStatistics *stats, ESParameter *param)
  ** stepwise evolution                                              **
  ** ESStep(population, param, stats, pf)                            **
  **                                                                 **
+ ** All: reset the arena of the last generation                     **
  ** Master:                                                         **
- ** -> Stochastic ranking -> sort population based on ranking index **
- ** -> send op to other processors  -> do statistics analysis on    **
- ** this generation -> print statistics information                 **
+ ** -> Stochastic ranking -> select the ranked parents into the     **
+ ** next buffer                                                     **
+ ** -> hand op out to whichever processor asks for work, evaluating **
+ ** some itself -> do statistics analysis on this generation        **
+ ** -> print statistics information (on MPI_COMM_WORLD rank 0 only) **
  ** Slave:                                                          **
- ** recalculate f/g/phi -> curgen+1                                 **
+ ** ask for op and recalculate f/g/phi until told to stop           **
+ ** -> curgen+1                                                     **
  *********************************************************************/
 void ESStep(ESPopulation *population, ESParameter *param,   \
             ESStatistics *stats, double pf)
 {
-  int myid;
+  int myid, worldid;
 
-  MPI_Comm_rank(MPI_COMM_WORLD, &myid);
+  MPI_Comm_rank(esMPIComm, &myid);
+  MPI_Comm_rank(MPI_COMM_WORLD, &worldid);
+  ShareArenaReset(&(param->arena));
 
   if(myid == 0)
   {
+    population->generation++;
     ESSRSort(population->f, population->phi, pf, param->eslambda,   \
-             param->eslambda, population->index);
-    ESSortPopulation(population, param);
+             param->eslambda, population->index, population->generation,   \
+             &(param->arena));
 
     ESSelectPopulation(population, param);
 
@@ -584,7 +714,8 @@ void ESStep(ESPopulation *population, ESParameter *param,   \
 
     ESDoStat(stats, population, param);
 
-    ESPrintStat(stats, param);
+    if(worldid == 0)
+      ESPrintStat(stats, param);
   }
   else
   {
@@ -592,41 +723,104 @@ void ESStep(ESPopulation *population, ESParameter *param,   \
     stats->curgen +=1;
   }
 
-  MPI_Barrier(MPI_COMM_WORLD);
-
   return;
 }
 
 /*********************************************************************
  ** sort population based on Index by ESSRSort                      **
  ** ESSortPopulation(population, param)                             **
+ ** rows are gathered in ranked order into the back buffer, which   **
+ ** then becomes the population                                     **
  *********************************************************************/
 void ESSortPopulation(ESPopulation *population, ESParameter *param)
+{
+  ESGatherPopulation(population, param, population->index);
+
+  return;
+}
+
+/*********************************************************************
+ ** gather rows into the back buffer and swap the buffers           **
+ ** ESGatherPopulation(population, param, source)                   **
+ ** row i <- row source[i], each row copied once                    **
+ ** -> parent[i] = source[i], the row i came from, now in the back  **
+ **    buffer                                                       **
+ ** -> index: 0->eslambda-1                                         **
+ *********************************************************************/
+void ESGatherPopulation(ESPopulation *population, ESParameter *param,   \
+                        int *source)
 {
   int i;
-  int eslambda;
-  int *index;
-  ESIndividual **oldmember, **newmember;
+  int eslambda, stride, constraint;
+  double *tmp;
 
   eslambda = param->eslambda;
-  oldmember = population->member;
-  index = population->index;
-  newmember = NULL;
-  newmember = (ESIndividual **)ShareMallocM1c(eslambda*sizeof(ESIndividual *));
+  constraint = param->constraint;
+  stride = population->stride;
 
   for(i=0; i<eslambda; i++)
-    newmember[i] = oldmember[index[i]];
-
+  {
+    memcpy(population->backop + i*stride, ESRowOp(population, source[i]),   \
+           stride*sizeof(double));
+    memcpy(population->backsp + i*stride, ESRowSp(population, source[i]),   \
+           stride*sizeof(double));
+    memcpy(population->backg + i*constraint,   \
+           ESRowG(population, source[i], param), constraint*sizeof(double));
+    population->backf[i] = population->f[source[i]];
+    population->backphi[i] = population->phi[source[i]];
+  }
   for(i=0; i<eslambda; i++)
   {
-    oldmember[i] = newmember[i];
-    population->f[i] = newmember[i]->f;
-    population->phi[i] = newmember[i]->phi;
-    index[i] = i;
+    population->parent[i] = source[i];
+    population->index[i] = i;
   }
 
-  ShareFreeM1c((char *)newmember);
-  newmember = NULL;
+  tmp = population->op;
+  population->op = population->backop;
+  population->backop = tmp;
+  tmp = population->sp;
+  population->sp = population->backsp;
+  population->backsp = tmp;
+  tmp = population->g;
+  population->g = population->backg;
+  population->backg = tmp;
+  tmp = population->f;
+  population->f = population->backf;
+  population->backf = tmp;
+  tmp = population->phi;
+  population->phi = population->backphi;
+  population->backphi = tmp;
+  ESPointMembers(population, param);
+
+  return;
+}
+
+/*********************************************************************
+ ** point each member at its row of the population                  **
+ ** ESPointMembers(population, param)                               **
+ ** member[i] -> rows[i] -> op/sp/g row i, f[i], phi[i]             **
+ *********************************************************************/
+void ESPointMembers(ESPopulation *population, ESParameter *param)
+{
+  int i;
+  int eslambda;
+  ESIndividual *indvdl;
+
+  eslambda = param->eslambda;
+
+  for(i=0; i<eslambda; i++)
+  {
+    indvdl = &(population->rows[i]);
+    indvdl->op = ESRowOp(population, i);
+    indvdl->sp = ESRowSp(population, i);
+    if(param->constraint > 0)
+      indvdl->g = ESRowG(population, i, param);
+    else
+      indvdl->g = NULL;
+    indvdl->f = population->f[i];
+    indvdl->phi = population->phi[i];
+    population->member[i] = indvdl;
+  }
 
   return;
 }
@@ -636,32 +830,36 @@ void ESSortPopulation(ESPopulation *population, ESParameter *param)
  ** ESSelectPopulation(population, param)                           **
  ** select first miu offsprings to fill up the next generation      **
  ** miu -> lambda : 1..miu,1..miu,..,lambda                         **
+ ** the offsprings are ranked by index and gathered straight from   **
+ ** their parents' rows into the next buffer                        **
  *********************************************************************/
 void ESSelectPopulation(ESPopulation *population, ESParameter *param)
 {
   int i,j;
   int miu, lambda, eslambda;
+  int *index, *parent;
 
   miu = param->miu;
   lambda = param->lambda;
   eslambda = param->eslambda;
+  index = population->index;
+  parent = population->parent;
 
+  for(i=0; i<miu && i<lambda; i++)
+    parent[i] = index[i];
   for(i=miu,j=0; i<lambda; i++,j++)
   {
     if(j==miu)
       j = 0;
-    ESCopyIndividual(population->member[j], population->member[i], param);
-    population->f[i] = population->member[j]->f;
-    population->phi[i] = population->member[j]->phi;
+    parent[i] = index[j];
   }
   for(i=lambda, j=0; i<eslambda; i++,j++)
   {
     if(j==miu)
       j = 0;
-    ESCopyIndividual(population->member[j], population->member[i], param);
-    population->f[i] = population->member[j]->f;
-    population->phi[i] = population->member[j]->phi;
+    parent[i] = index[j];
   }
+  ESGatherPopulation(population, param, parent);
 
   return;
 }
@@ -670,8 +868,8 @@ void ESSelectPopulation(ESPopulation *population, ESParameter *param)
  ** mutate                                                          **
  ** ESMutate(population, param)                                     **
  **                                                                 **
- ** sp_ : copy of sp                                                **
- ** op_ : copy of op                                                **
+ ** sp_ : sp before mutation, the parent's row in the back buffer   **
+ ** op_ : op before mutation, the parent's row in the back buffer   **
  ** update sp                                                       **
  ** traditional technique using exponential smoothing               **
  ** sp(1->miu-1) : unchanged                                        **
@@ -690,233 +888,314 @@ void ESSelectPopulation(ESPopulation *population, ESParameter *param)
  ** exponential smoothing                                           **
  ** sp(miu->lambda): sp = sp_ + alpha * (sp - sp_)                  **
  ** 
- ** Master: send op to other processors                             **
- ** Slave:  re-calculate f/g/phi                                    **
+ ** the normal random numbers are drawn for every row first, each   **
+ ** from the row's own streams of this generation, then each row is **
+ ** mutated by param->mutaterow or param->differrow, and its out of **
+ ** bound op retried                                                **
+ ** Master: hand op out with ESMPIDispatch                          **
+ ** Slave:  re-calculate f/g/phi with ESMPIMutate                   **
  *********************************************************************/
 void ESMutate(ESPopulation * population, ESParameter *param)
 {
-  int i, j, k, l;
-  int miu, dim,lambda, constraint;
-  double gamma, alpha;
-  double tau, tau_;
+  int i, j, k;
+  int miu, dim,lambda;
   int retry;
-  double randscalar;
-  double *randvec;
-  double *spb, *ub, *lb;
-  ESIndividual *indvdl;
-  double **sp_, **op_;
+  double *ub, *lb;
+  int stride, gen;
+  double *op, *sp, *step, *jump;
+  double *sp_, *op_, *best_;
+  double *backop, *backsp;
+  int *parent;
   double tmp;
   ESfcnFG fg;
-  
-  int numprocs,nummpi;
-  MPI_Status status;
-  double *gfphi;
-  char strOK[] = "OK";
-  int lenOK = 2;
-  lenOK = strlen(strOK);
-
-  randvec = NULL;
-  sp_ = NULL;
-  op_ = NULL;
 
   miu = param->miu;
   lambda = param->lambda;
-  constraint = param->constraint;
-  gamma = param->gamma;
-  alpha = param->alpha;
-  tau = param->tau;
-  tau_ = param->tau_;
   retry = param->retry;
-  spb = param->spb;
   ub = param->ub;
   lb = param->lb;
   dim = param->dim;
   fg = param->fg;
-  randvec = ShareMallocM1d(dim);
-  sp_ = ShareMallocM2d(lambda, dim);
-  op_ = ShareMallocM2d(lambda, dim);
+  stride = population->stride;
+  gen = population->generation;
+  backop = population->backop;
+  backsp = population->backsp;
+  parent = population->parent;
+  step = population->step;
 
-  for(i=0; i<lambda; i++)
+  for(i=miu-1; i<lambda; i++)
   {
-    indvdl = population->member[i];
-    for(j=0; j<dim; j++)
-    {
-      sp_[i][j] = indvdl->sp[j];
-      op_[i][j] = indvdl->op[j];
-    }
+    population->randscalar[i] = ShareNormalRand(0, 1, gen, i, 0,   \
+                                                esDefStreamScalar);
+    ShareNormalRandVec(population->randsp + i*stride, dim, 0, 1,   \
+                       gen, i, esDefStreamSp);
+    ShareNormalRandVec(population->randop + i*stride, dim, 0, 1,   \
+                       gen, i, esDefStreamOp);
   }
 
-  for(i=miu-1; i<lambda; i++)
+  best_ = backop + parent[0]*stride;
+  for(i=0; i<lambda; i++)
   {
-    randscalar = ShareNormalRand(0,1);
-    ShareNormalRandVec(randvec, dim, 0, 1);
-    indvdl = population->member[i];
-    for(j=0; j<dim; j++)
+    op = ESRowOp(population, i);
+    sp = ESRowSp(population, i);
+    op_ = backop + parent[i]*stride;
+    sp_ = backsp + parent[i]*stride;
+    if(i < miu-1)
     {
-      tmp = indvdl->sp[j] *exp(tau_ *randscalar +tau*randvec[j]);
-      if( tmp > spb[j] )
-        tmp = spb[j];
-      indvdl->sp[j] = tmp;
+      k = param->differrow(op, best_, backop + parent[i+1]*stride, param);
+      jump = sp;
     }
-  }
-
-  for(i=0; i<miu-1; i++)
-  {
-    indvdl = population->member[i];
-    for(j=0; j<dim; j++)
-      indvdl->op[j] = indvdl->op[j] + gamma*(op_[0][j] - op_[i+1][j]);
-  }
-  for(i=miu-1; i<lambda; i++)
-  {
-    indvdl = population->member[i];
-    for(j=0; j<dim; j++)
-      indvdl->op[j] = indvdl->op[j] + indvdl->sp[j] * ShareNormalRand(0, 1);
-  }
+    else
+    {
+      k = param->mutaterow(op, sp, step, op_, sp_,   \
+                           population->randscalar[i],   \
+                           population->randsp + i*stride,   \
+                           population->randop + i*stride, param);
+      jump = step;
+    }
+    if(k == 0)
+      continue;
 
-  for(i=0; i<lambda; i++)
-  {
-    indvdl = population->member[i];
     for(j=0; j<dim; j++)
     {
-      tmp = indvdl->op[j];
+      tmp = op[j];
       if(tmp > ub[j] || tmp < lb[j])
       {
         for(k=0; k<retry; k++)
         {
-          tmp = op_[i][j] + indvdl->sp[j]*ShareNormalRand(0,1);
+          tmp = op_[j] + jump[j]*ShareNormalRand(0, 1, gen, i, j,   \
+                                      esDefStreamRetry + (k << 8));
           if(!(tmp > ub[j] || tmp < lb[j]))
             break;
         }
         if(k >= retry)
-          tmp = op_[i][j];
-        indvdl->op[j] = tmp;
+          tmp = op_[j];
+        op[j] = tmp;
       }
     }
   }
 
-  for(i=miu-1; i<lambda; i++)
+  ESMPIDispatch(population->member, lambda, param);
+  for(i=0; i<lambda; i++)
   {
-    indvdl = population->member[i];
-    for(j=0; j<dim; j++)
-      indvdl->sp[j] = sp_[i][j] + alpha *(indvdl->sp[j] - sp_[i][j]);
+    population->f[i] = population->member[i]->f;
+    population->phi[i] = population->member[i]->phi;
   }
 
-  MPI_Comm_size(MPI_COMM_WORLD, &numprocs);
-  for(i=0,j=1; i<lambda; i++,j++)
+  return;
+}
+
+/*********************************************************************
+ ** evaluate individuals across every processor                     **
+ ** ESMPIDispatch(indvdl, n, param)                                 **
+ **                                                                 **
+ ** op are handed out in chunks of esMPIChunk individuals, so a     **
+ ** processor running several simulations at once gets enough work  **
+ ** the buffers of both sides come from param->arena                **
+ **                                                                 **
+ ** Master: MPI_Isend up to esMPIPrefetch chunks to each slave,     **
+ **   tag = index of the chunk's first individual, and MPI_Irecv    **
+ **   their results                                                 **
+ **   -> whenever a result arrives, MPI_Isend that slave the next   **
+ **      chunk                                                      **
+ **   -> while no result has arrived, evaluate the next chunk itself**
+ **   -> a slave with no chunk left in flight is sent an empty      **
+ **      message to stop                                            **
+ ** result message: g[0..constraint-1], f, phi of each individual,  **
+ **   tag = index of the chunk's first individual                   **
+ **                                                                 **
+ ** ESMPIMutate(population, param)                                  **
+ ** Slave: MPI_Irecv the next chunk while evaluating the current one**
+ **   in one batch -> MPI_Isend f/g/phi -> until an empty message   **
+ *********************************************************************/
+void ESMPIDispatch(ESIndividual **indvdl, int n, ESParameter *param)
+{
+  int i, j, k, l;
+  int next, size, count, inflight, done;
+  int dim, constraint, chunk;
+  int numprocs, numslaves, numsends;
+  MPI_Status status;
+  MPI_Request *recvs, *sends;
+  int *pending;
+  double *op, **gfphi;
+
+  dim = param->dim;
+  constraint = param->constraint;
+  chunk = esMPIChunk;
+  recvs = NULL;
+  sends = NULL;
+  pending = NULL;
+  op = NULL;
+  gfphi = NULL;
+
+  MPI_Comm_size(esMPIComm, &numprocs);
+  numslaves = numprocs - 1;
+  if(numslaves > 0)
   {
-    if(j==numprocs)
-      j=1;
-    MPI_Send(population->member[i]->op,dim,MPI_DOUBLE,j,i,MPI_COMM_WORLD);
+    recvs = (MPI_Request *)ShareArenaMallocM1c(&(param->arena),   \
+                             numslaves*sizeof(MPI_Request));
+    sends = (MPI_Request *)ShareArenaMallocM1c(&(param->arena),   \
+                             (n+numslaves)*sizeof(MPI_Request));
+    pending = ShareArenaMallocM1i(&(param->arena), numslaves);
+    gfphi = ShareArenaMallocM2d(&(param->arena), numslaves,   \
+                                chunk*(2+constraint));
+    op = ShareArenaMallocM1d(&(param->arena), n*dim);
+    for(i=0; i<n; i++)
+      for(k=0; k<dim; k++)
+        op[i*dim+k] = indvdl[i]->op[k];
   }
-  gfphi = ShareMallocM1d(2+constraint);
-  for(l=1; l<numprocs; l++)
+
+  next = 0;
+  numsends = 0;
+  inflight = 0;
+  for(j=0; j<numslaves; j++)
   {
-    for(i=0,j=1,nummpi=0; i<lambda; i++,j++)
+    pending[j] = 0;
+    for(k=0; k<esMPIPrefetch && next<n; k++)
     {
-      if(j==numprocs)
-        j=1;
-      if(j==l)
-        nummpi++;
+      size = (n-next < chunk) ? n-next : chunk;
+      MPI_Isend(op+next*dim, size*dim, MPI_DOUBLE, j+1, next,   \
+                esMPIComm, &(sends[numsends++]));
+      pending[j]++;
+      next += size;
     }
-    if(nummpi<=0)
-      break;
-    MPI_Send(strOK,lenOK,MPI_BYTE,l,l,MPI_COMM_WORLD);
-    for(i=0,j=1; i<lambda; i++,j++)
+    if(pending[j] > 0)
     {
-      if(j==numprocs)
-        j=1;
-      if(j!=l)
-        continue;
-      MPI_Recv(gfphi,2+constraint,MPI_DOUBLE,j,i,MPI_COMM_WORLD,&status);
-      indvdl = population->member[i];
-      for(k=0;k<constraint;k++)
-        indvdl->g[k] = gfphi[k];
-      indvdl->f = gfphi[k++];
-      indvdl->phi = gfphi[k++];
-      population->f[i] = indvdl->f;
-      population->phi[i] = indvdl->phi;
+      MPI_Irecv(gfphi[j], chunk*(2+constraint), MPI_DOUBLE, j+1,   \
+                MPI_ANY_TAG, esMPIComm, &(recvs[j]));
+      inflight++;
+    }
+    else
+    {
+      MPI_Isend(NULL, 0, MPI_DOUBLE, j+1, 0, esMPIComm,   \
+                &(sends[numsends++]));
+      recvs[j] = MPI_REQUEST_NULL;
+    }
+  }
+
+  while(inflight > 0 || next < n)
+  {
+    done = 0;
+    if(inflight > 0)
+    {
+      if(next < n)
+        MPI_Testany(numslaves, recvs, &j, &done, &status);
+      else
+      {
+        MPI_Waitany(numslaves, recvs, &j, &status);
+        done = 1;
+      }
+    }
+    if(!done)
+    {
+      size = (n-next < chunk) ? n-next : chunk;
+      ESEvaluate(&(indvdl[next]), size, param);
+      next += size;
+      continue;
+    }
+
+    MPI_Get_count(&status, MPI_DOUBLE, &count);
+    count /= 2+constraint;
+    for(l=0, i=status.MPI_TAG; l<count; l++, i++)
+    {
+      for(k=0; k<constraint; k++)
+        indvdl[i]->g[k] = gfphi[j][l*(2+constraint)+k];
+      indvdl[i]->f = gfphi[j][l*(2+constraint)+constraint];
+      indvdl[i]->phi = gfphi[j][l*(2+constraint)+constraint+1];
+    }
+    pending[j]--;
+    if(next < n)
+    {
+      size = (n-next < chunk) ? n-next : chunk;
+      MPI_Isend(op+next*dim, size*dim, MPI_DOUBLE, j+1, next,   \
+                esMPIComm, &(sends[numsends++]));
+      pending[j]++;
+      next += size;
+    }
+    if(pending[j] > 0)
+      MPI_Irecv(gfphi[j], chunk*(2+constraint), MPI_DOUBLE, j+1,   \
+                MPI_ANY_TAG, esMPIComm, &(recvs[j]));
+    else
+    {
+      MPI_Isend(NULL, 0, MPI_DOUBLE, j+1, 0, esMPIComm,   \
+                &(sends[numsends++]));
+      inflight--;
     }
   }
-  ShareFreeM1d(gfphi);
-  gfphi = NULL;
 
-  ShareFreeM1d(randvec);
-  randvec = NULL;
-  ShareFreeM2d(sp_, lambda);
-  sp_ = NULL;
-  ShareFreeM2d(op_, lambda);
-  op_ = NULL;
+  if(numslaves > 0)
+    MPI_Waitall(numsends, sends, MPI_STATUSES_IGNORE);
 
   return;
 }
 
 void ESMPIMutate(ESPopulation *population, ESParameter *param)
 {
-  int i,j,k,l;
-  int lambda, dim, constraint;
-
-  double *op, **gfphi;
-  int nummpi;
-  int myid, numprocs;
+  int i, k, l;
+  int dim, constraint, chunk;
+  int count, index;
   MPI_Status status;
-  char buf[10];
-  char strOK[] = "OK";
-  int lenOK = 2;
-  lenOK = strlen(strOK);
+  MPI_Request recv, send;
+  double **op, **gfphi, **x, **g, *f;
 
-  lambda = param->lambda;
   dim = param->dim;
   constraint = param->constraint;
+  chunk = esMPIChunk;
 
-  MPI_Comm_rank(MPI_COMM_WORLD, &myid);
-  MPI_Comm_size(MPI_COMM_WORLD, &numprocs);
-  for(i=0,j=1,nummpi=0; i<lambda; i++,j++)
-  {
-    if(j==numprocs)
-      j = 1;
-    if(j==myid)
-      nummpi++;
-  }
-  if(nummpi<=0)
-    return;
-
-  op = ShareMallocM1d(dim);
-  gfphi = ShareMallocM2d(nummpi,2+constraint);
+  op = ShareArenaMallocM2d(&(param->arena), 2, chunk*dim);
+  gfphi = ShareArenaMallocM2d(&(param->arena), 2, chunk*(2+constraint));
+  x = (double **)ShareArenaMallocM1c(&(param->arena), chunk*sizeof(double *));
+  g = (double **)ShareArenaMallocM1c(&(param->arena), chunk*sizeof(double *));
+  f = ShareArenaMallocM1d(&(param->arena), chunk);
+  send = MPI_REQUEST_NULL;
 
-  for(i=0,j=1,l=0; i<lambda; i++,j++)
+  MPI_Irecv(op[0], chunk*dim, MPI_DOUBLE, 0, MPI_ANY_TAG, esMPIComm, &recv);
+  for(l=0; ; l=1-l)
   {
-    if(j==numprocs)
-      j = 1;
-    if(j!=myid)
-      continue;
-    MPI_Recv(op, dim, MPI_DOUBLE, 0,i,MPI_COMM_WORLD,&status);
-    param->fg(op, &(gfphi[l][constraint]),gfphi[l]);
-    MPI_Send(op, dim, MPI_DOUBLE, 0,i,MPI_COMM_WORLD);
-    gfphi[l][constraint+1] = 0.0;
-    for(k=0;k<constraint;k++)
+    MPI_Wait(&recv, &status);
+    MPI_Get_count(&status, MPI_DOUBLE, &count);
+    if(count == 0)
+      break;
+    count /= dim;
+    index = status.MPI_TAG;
+    MPI_Irecv(op[1-l], chunk*dim, MPI_DOUBLE, 0, MPI_ANY_TAG, esMPIComm,   \
+              &recv);
+
+/*********************************************************************
+ ** evaluate the chunk received in one batch                        **
+ ** gfphi[l] = g[0..constraint-1], f, phi of each individual        **
+ ** the last result, in gfphi[1-l], is sent meanwhile               **
+ *********************************************************************/
+    for(i=0; i<count; i++)
     {
-      if(gfphi[l][k]>0.0)
-        gfphi[l][constraint+1] += (gfphi[l][k]*gfphi[l][k]);
+      x[i] = op[l] + i*dim;
+      g[i] = gfphi[l] + i*(2+constraint);
     }
-    l++;
-  }
-
-  MPI_Recv(buf,lenOK,MPI_BYTE,0,myid,MPI_COMM_WORLD, &status);
-  for(i=0,j=1,l=0; i<lambda; i++,j++)
-  {
-    if(j==numprocs)
-      j = 1;
-    if(j!=myid)
-      continue;
-    MPI_Send(gfphi[l], 2+constraint, MPI_DOUBLE, 0,i,MPI_COMM_WORLD);
-    l++;
+    if(param->fgbatch == NULL)
+    {
+      for(i=0; i<count; i++)
+        param->fg(x[i], &(g[i][constraint]), g[i]);
+    }
+    else
+    {
+      param->fgbatch(x, count, f, g);
+      for(i=0; i<count; i++)
+        g[i][constraint] = f[i];
+    }
+    for(i=0; i<count; i++)
+    {
+      g[i][constraint+1] = 0.0;
+      for(k=0;k<constraint;k++)
+      {
+        if(g[i][k]>0.0)
+          g[i][constraint+1] += (g[i][k]*g[i][k]);
+      }
+    }
+    MPI_Wait(&send, MPI_STATUS_IGNORE);
+    MPI_Isend(gfphi[l], count*(2+constraint), MPI_DOUBLE, 0, index,   \
+              esMPIComm, &send);
   }
-
-  ShareFreeM1d(op);
-  op = NULL;
-  ShareFreeM2d(gfphi,nummpi);
-  gfphi = NULL;
+  MPI_Wait(&send, MPI_STATUS_IGNORE);
 
   return;
 }
-
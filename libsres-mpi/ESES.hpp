@@ -36,6 +36,16 @@
 #ifndef ESES_HPP
 #define ESES_HPP
 
+#include "sharefunc.hpp"
+
+#if defined(MPI)
+	#undef MPI
+	#define OMPI_SKIP_MPICXX 1 /* only the C API is used */
+	#define MPICH_SKIP_MPICXX 1
+	#include <mpi.h>
+	#define MPI
+#endif
+
 #define esDefPopsize 300
 #define esDefGeneration 500
 #define esDefGamma 0.85
@@ -45,6 +55,35 @@
 #define esDefESPlus 0
 #define esDefESSlash 1
 
+/*********************************************************************
+ ** random streams, what a ShareRand/ShareNormalRand draw is for    **
+ ** retry k of an op draws from esDefStreamRetry + (k << 8)         **
+ *********************************************************************/
+#define esDefStreamInit 1
+#define esDefStreamScalar 2
+#define esDefStreamSp 3
+#define esDefStreamOp 4
+#define esDefStreamParent 5
+#define esDefStreamRetry 6
+
+/*********************************************************************
+ ** communicator the processors of this population evolve in,       **
+ ** MPI_COMM_WORLD unless the processors are split into islands     **
+ *********************************************************************/
+extern MPI_Comm esMPIComm;
+
+/*********************************************************************
+ ** number of individuals handed to a processor at once, i.e. how   **
+ ** many it can evaluate at the same time                           **
+ *********************************************************************/
+extern int esMPIChunk;
+
+/*********************************************************************
+ ** number of chunks kept in flight per slave, so a slave has the   **
+ ** next chunk while it sends the results of the last               **
+ *********************************************************************/
+#define esMPIPrefetch 2
+
 /*********************************************************************
  ** function of fitness and constraints                             **
  ** to calculate fitness and constraints and assign to ESIndividual **
@@ -52,15 +91,38 @@
  *********************************************************************/
 typedef void(*ESfcnFG) (double *, double *, double *);
 
+/*********************************************************************
+ ** function of fitness and constraints for a batch of individuals  **
+ ** to evaluate many individuals with one call                      **
+ ** fgbatch(x[n], n, f[n], g[n])                                    **
+ *********************************************************************/
+typedef void(*ESfcnFGBatch) (double **, int, double *, double **);
+
 /*********************************************************************
  ** function to transform x(op) and sp                              **
  ** double f(double)                                                **
  *********************************************************************/
 typedef double(*ESfcnTrsfm) (double );
 
+/*********************************************************************
+ ** mutation kernels, see ESKernel.hpp                              **
+ ** mutaterow(op, sp, step, op_, sp_, randscalar, randsp, randop,   **
+ **           param): mutate one offspring row from its parent's row**
+ ** differrow(op, best_, other_, param): differentially vary one    **
+ **           parent row                                            **
+ ** both return how many op are out of bounds                       **
+ *********************************************************************/
+struct ESParameter;
+typedef int(*ESfcnMutateRow) (double *, double *, double *, double *,   \
+                              double *, double, double *, double *,   \
+                              struct ESParameter *);
+typedef int(*ESfcnDifferRow) (double *, double *, double *,   \
+                              struct ESParameter *);
+
 /*********************************************************************
  ** ESParameter: struct for ES-parameter                            **
  ** fg: functions of fitness and constraints                        **
+ ** fgbatch: fg for a batch of individuals, NULL to call fg on each **
  ** trsfm: to transform sp/op                                       **
  ** es: ES process, esDefESPlus/esDefESSlash                        **
  ** eslambda: lambda+miu or lambda according to ES process          **
@@ -82,10 +144,13 @@ typedef double(*ESfcnTrsfm) (double );
  ** retry: retry times to check bounds                              **
  ** tau: learning rates: tau = varphi/(sqrt(2*sqrt(dim)))           **
  ** tar_: learning rates: tau_ = varphi((sqrt(2*dim)                **
+ ** mutaterow, differrow: mutation kernels for this processor       **
+ ** arena: temporaries of one generation, reset by ESStep           **
  *********************************************************************/
-typedef struct
+typedef struct ESParameter
   {
     ESfcnFG fg;
+    ESfcnFGBatch fgbatch;
     ESfcnTrsfm *trsfm;
     int seed;
     int constraint;
@@ -99,6 +164,9 @@ typedef struct
     int retry;
     double chi, tau, tau_;
     int es,eslambda;
+    ESfcnMutateRow mutaterow;
+    ESfcnDifferRow differrow;
+    ShareArena arena;
   } ESParameter;
 
 /*********************************************************************
@@ -108,6 +176,7 @@ typedef struct
  ** f: fitness                                                      **
  ** g[constraint]: constraint value                                 **
  ** phi: phi = sum( max(0,g)^2 )                                    **
+ ** a population member only points op/sp/g at its population's rows**
  *********************************************************************/
 typedef struct
   {
@@ -119,10 +188,26 @@ typedef struct
 
 /*********************************************************************
  ** ESPopulation: struct for population                             **
- ** member[lambda]: each individual in this population              **
+ ** member[lambda]: each individual in this population, row i       **
  ** f[lambda]: fitness                                              **
  ** phi[lambda]: constraints                                        **
  ** index[lambda]: ranking index                                    **
+ ** op[lambda*stride]: op of every individual, one aligned row each **
+ ** sp[lambda*stride]: sp of every individual, one aligned row each **
+ ** g[lambda*constraint]: g of every individual, one row each       **
+ ** stride: doubles per op/sp row, dim rounded up to keep rows      **
+ **         aligned to shareDefAlign bytes                          **
+ ** rows[lambda]: the individuals member points at                  **
+ ** backop/backsp/backg/backf/backphi: second buffer of op/sp/g/f/  **
+ **   phi, the next generation is gathered into it and the buffers  **
+ **   swapped, leaving the last generation in it                    **
+ ** parent[lambda]: the back buffer row each row was gathered from  **
+ ** randscalar[lambda], randsp[lambda*stride],                      **
+ ** randop[lambda*stride]: normal random numbers ESMutate draws for **
+ **   a whole generation at once                                    **
+ ** step[stride]: a row's sp before smoothing, for ESMutate retries **
+ ** generation: generations ESStep has made, the random streams of  **
+ **   ranking and mutation are keyed by it                          **
  *********************************************************************/
 typedef struct
   {
@@ -130,8 +215,34 @@ typedef struct
     double *f;
     double *phi;
     int *index;
+    double *op;
+    double *sp;
+    double *g;
+    int stride;
+    ESIndividual *rows;
+    double *backop;
+    double *backsp;
+    double *backg;
+    double *backf;
+    double *backphi;
+    int *parent;
+    double *randscalar;
+    double *randsp;
+    double *randop;
+    double *step;
+    int generation;
   } ESPopulation;
 
+/*********************************************************************
+ ** address row i of a population                                   **
+ ** ESRowOp(population, i): op of individual i                      **
+ ** ESRowSp(population, i): sp of individual i                      **
+ ** ESRowG(population, i, param): g of individual i                 **
+ *********************************************************************/
+#define ESRowOp(population, i) ((population)->op + (i)*(population)->stride)
+#define ESRowSp(population, i) ((population)->sp + (i)*(population)->stride)
+#define ESRowG(population, i, param) ((population)->g + (i)*(param)->constraint)
+
 /*********************************************************************
  ** ESStatistics: struct for ES-statistics                          **
  ** begintime: begin time when intializing                          **
@@ -161,6 +272,7 @@ typedef struct
  ** outseed: seed value assigned , for next use                     **
  ** param: point to parameter                                       **
  ** fg: functions of fitness and constraints                        **
+ ** fgbatch: fg for a batch of individuals, NULL to call fg on each **
  ** trsfm: to transform sp/op                                       **
  ** es: ES process, esDefESPlus/esDefESSlash                        **
  ** constraint: number of constraints                               **
@@ -183,7 +295,7 @@ typedef struct
  ** stats: point to statistics                                      **
  **                                                                 **
  ** Initialize MPI                                                  **
- ** processors >=2, print seed if master                            **
+ ** any number of processors, rank 0 also evaluates individuals     **
  **                                                                 **
  ** ESDeInitial(param,populationi,stats)                            **
  ** free param and population                                       **
@@ -191,16 +303,17 @@ typedef struct
  *********************************************************************/
 void ESInitial(/*int *, char ***,  */\
                unsigned int, ESParameter**, ESfcnTrsfm *,   \
-               ESfcnFG,int, int,int,double*,double*,int,int,int,  \
+               ESfcnFG, ESfcnFGBatch, int, int,int,double*,double*,int,int,int,  \
                double, double, double, int,  \
                ESPopulation**, ESStatistics**);
 void ESDeInitial(ESParameter*, ESPopulation*, ESStatistics*);
 /*********************************************************************
  ** initialize parameters                                           **
- ** ESInitialParam(param,trsfm,fg,es,constraint,                    **
+ ** ESInitialParam(param,trsfm,fg,fgbatch,es,constraint,            **
  **                dim,ub,lb,miu,lambda,gen)                        **
  ** param: point to parameter                                       **
  ** fg: functions of fitness and constraints                        **
+ ** fgbatch: fg for a batch of individuals, NULL to call fg on each **
  ** trsfm: to transform sp/op                                       **
  ** es: ES process, esDefESPlus/esDefESSlash                        **
  ** seed: reserve seed for next use                                 **
@@ -225,7 +338,8 @@ void ESDeInitial(ESParameter*, ESPopulation*, ESStatistics*);
  ** ESDeInitialParam(param)                                         **
  ** free param                                                      **
  *********************************************************************/
-void ESInitialParam(ESParameter **, ESfcnTrsfm *, ESfcnFG, int,   \
+void ESInitialParam(ESParameter **, ESfcnTrsfm *, ESfcnFG,   \
+                    ESfcnFGBatch, int,   \
                     unsigned int,  \
                     int,int,double*,double*,int,int,int,  \
                     double, double, double, int);
@@ -237,7 +351,8 @@ void ESDeInitialParam(ESParameter *);
  ** param: point to this parameter                                  **
  **   -> index: 0->lambda-1                                         **
  **   -> individual[lambda]                                         **
- **   -> fg(individual)                                             **
+ **   -> ESMPIDispatch(individual[lambda]) on rank 0, ESMPIMutate   **
+ **      on the others, evaluating it like any generation           **
  **   -> f,phi                                                      **
  ** the initialization is looked as first generation                **
  **                                                                 **
@@ -249,9 +364,8 @@ void ESDeInitialPopulation(ESPopulation *, ESParameter *);
 /*********************************************************************
  ** initialize individual                                           **
  ** ESInitialIndividual(indvdl, param)                              **
- ** to calculate f,g,and phi                                        **
+ ** f=HUGE_VAL and phi=0 until the individual is evaluated          **
  ** to initialize op and sp                                         **
- ** phi=sum{(g>0)^2}                                                **
  ** op = rand(lb, ub)                                               **
  ** sp = (ub - lb)/sqrt(dim)                                        **
  **                                                                 **
@@ -274,10 +388,18 @@ void ESPrintSp(ESIndividual *, ESParameter *);
  ** ESCopyIndividual(from, to, param)                               **
  *********************************************************************/
 void ESCopyIndividual(ESIndividual *, ESIndividual *, ESParameter *);
+/*********************************************************************
+ ** evaluate individuals                                            **
+ ** ESEvaluate(indvdl, n, param)                                    **
+ ** to calculate f,g,and phi of indvdl[n]                           **
+ ** with one call of fgbatch, or fg on each if fgbatch is NULL      **
+ *********************************************************************/
+void ESEvaluate(ESIndividual **, int, ESParameter *);
 /*********************************************************************
  ** initialize statistics                                           **
  ** ESInitialStat(stats, population, param)                         **
  ** to intialize time, curgen, bestindvdl,thisbestindvdl            **
+ ** bestindvdl,thisbestindvdl are not evaluated (f=HUGE_VAL)        **
  ** not to do the first statistics                                  **
  ** to set dt, bestgen                                              **
  **                                                                 **
@@ -306,25 +428,49 @@ void ESPrintStat(ESStatistics *, ESParameter *);
  ** ESStep(population, param, stats, pf)                            **
  **                                                                 **
  ** Master:                                                         **
- ** -> Stochastic ranking -> sort population based on ranking index **
- ** -> send op to other processors  -> do statistics analysis on    **
- ** this generation -> print statistics information                 **
+ ** -> Stochastic ranking -> select the ranked parents into the     **
+ ** next buffer                                                     **
+ ** -> hand op out to whichever processor asks for work, evaluating **
+ ** some itself -> do statistics analysis on this generation        **
+ ** -> print statistics information (on MPI_COMM_WORLD rank 0 only) **
  ** Slave:                                                          **
- ** recalculate f/g/phi -> curgen+1                                 **
+ ** ask for op and recalculate f/g/phi until told to stop           **
+ ** -> curgen+1                                                     **
  *********************************************************************/
 void ESStep(ESPopulation *, ESParameter *, ESStatistics *, double);
 
 /*********************************************************************
  ** sort population based on Index by ESSRSort                      **
  ** ESSortPopulation(population, param)                             **
+ ** rows are gathered in ranked order into the back buffer, which   **
+ ** then becomes the population                                     **
  *********************************************************************/
 void ESSortPopulation(ESPopulation *, ESParameter *);
 
+/*********************************************************************
+ ** gather rows into the back buffer and swap the buffers           **
+ ** ESGatherPopulation(population, param, source)                   **
+ ** row i <- row source[i], each row copied once                    **
+ ** -> parent[i] = source[i], the row i came from, now in the back  **
+ **    buffer                                                       **
+ ** -> index: 0->eslambda-1                                         **
+ *********************************************************************/
+void ESGatherPopulation(ESPopulation *, ESParameter *, int *);
+
+/*********************************************************************
+ ** point each member at its row of the population                  **
+ ** ESPointMembers(population, param)                               **
+ ** member[i] -> rows[i] -> op/sp/g row i, f[i], phi[i]             **
+ *********************************************************************/
+void ESPointMembers(ESPopulation *, ESParameter *);
+
 /*********************************************************************
  ** select the next generation                                      **
  ** ESSelectPopulation(population, param)                           **
  ** select first miu offsprings to fill up the next generation      **
  ** miu -> lambda : 1..miu,1..miu,..,lambda                         **
+ ** the offsprings are ranked by index and gathered straight from   **
+ ** their parents' rows into the next buffer                        **
  *********************************************************************/
 void ESSelectPopulation(ESPopulation *, ESParameter *);
 
@@ -332,8 +478,8 @@ void ESSelectPopulation(ESPopulation *, ESParameter *);
  ** mutate                                                          **
  ** ESMutate(population, param)                                     **
  **                                                                 **
- ** sp_ : copy of sp                                                **
- ** op_ : copy of op                                                **
+ ** sp_ : sp before mutation, the parent's row in the back buffer   **
+ ** op_ : op before mutation, the parent's row in the back buffer   **
  ** update sp                                                       **
  ** traditional technique using exponential smoothing               **
  ** sp(1->miu-1) : unchanged                                        **
@@ -352,10 +498,36 @@ void ESSelectPopulation(ESPopulation *, ESParameter *);
  ** exponential smoothing                                           **
  ** sp(miu->lambda): sp = sp_ + alpha * (sp - sp_)                  **
  **                                                                 **
- ** Master: send op to other processors                             **
- ** Slave:  re-calculate f/g/phi                                    **
+ ** the normal random numbers are drawn for every row first, in the **
+ ** order above, then each row is mutated by param->mutaterow or    **
+ ** param->differrow, and its out of bound op retried               **
+ ** Master: hand op out with ESMPIDispatch                          **
+ ** Slave:  re-calculate f/g/phi with ESMPIMutate                   **
  *********************************************************************/
 void ESMutate(ESPopulation *, ESParameter *);
+/*********************************************************************
+ ** evaluate individuals across every processor                     **
+ ** ESMPIDispatch(indvdl, n, param)                                 **
+ **                                                                 **
+ ** op are handed out in chunks of esMPIChunk individuals, so a     **
+ ** processor running several simulations at once gets enough work  **
+ **                                                                 **
+ ** Master: MPI_Isend up to esMPIPrefetch chunks to each slave,     **
+ **   tag = index of the chunk's first individual, and MPI_Irecv    **
+ **   their results                                                 **
+ **   -> whenever a result arrives, MPI_Isend that slave the next   **
+ **      chunk                                                      **
+ **   -> while no result has arrived, evaluate the next chunk itself**
+ **   -> a slave with no chunk left in flight is sent an empty      **
+ **      message to stop                                            **
+ ** result message: g[0..constraint-1], f, phi of each individual,  **
+ **   tag = index of the chunk's first individual                   **
+ **                                                                 **
+ ** ESMPIMutate(population, param)                                  **
+ ** Slave: MPI_Irecv the next chunk while evaluating the current one**
+ **   in one batch -> MPI_Isend f/g/phi -> until an empty message   **
+ *********************************************************************/
+void ESMPIDispatch(ESIndividual **, int, ESParameter *);
 void ESMPIMutate(ESPopulation *, ESParameter *);
 
 #endif
@@ -0,0 +1,397 @@
+/*********************************************************************
+ ** Stochastic Ranking Evolution Strategy                           **
+ ** Mutation kernels                                                **
+ **                                                                 **
+ ** For ACADEMIC RESEARCH, this is licensed with GPL license        **
+ ** For COMMERCIAL ACTIVITIES, please contact the authors           **
+ **                                                                 **
+ ** This program is distributed in the hope that it will be useful, **
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of  **
+ ** MERCHANTABILITY of FITNESS FOR A PARTICULAR PURPOSE. See the    **
+ ** GNU General Public License for more details.                    **
+ **                                                                 **
+ ** You should have received a copy of the GNU General Public       **
+ ** License along with is program; if not, write to the Free        **
+ ** Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, **
+ ** MA 02111-1307, USA.                                             **
+ *********************************************************************/
+
+#include <time.h>
+#include <string.h>
+#include "ESKernel.hpp"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#define esKernelExpMax 708.0
+#define esKernelExpMin -708.0
+#define esKernelLog2e 1.4426950408889634074
+#define esKernelLn2Hi 6.93147180369123816490e-01
+#define esKernelLn2Lo 1.90821492927058770002e-10
+#define esKernelShift 6755399441055744.0 /* 1.5*2^52, rounds to integer */
+#define esKernelBias 1023
+
+/*********************************************************************
+ ** coefficients of p(r), 1/n! for n = 12..0, highest first         **
+ *********************************************************************/
+static const double esKernelPoly[13] = {
+  2.08767569878680989792e-09, 2.50521083854417187751e-08,
+  2.75573192239858906526e-07, 2.75573192239858906526e-06,
+  2.48015873015873015873e-05, 1.98412698412698412698e-04,
+  1.38888888888888888889e-03, 8.33333333333333333333e-03,
+  4.16666666666666666667e-02, 1.66666666666666666667e-01,
+  5.00000000000000000000e-01, 1.0, 1.0
+};
+
+/*********************************************************************
+ ** choose the mutation kernels for this processor                  **
+ ** ESKernelSelect(param)                                           **
+ *********************************************************************/
+void ESKernelSelect(ESParameter *param)
+{
+  param->mutaterow = ESKernelMutateRowScalar;
+  param->differrow = ESKernelDifferRowScalar;
+#if defined(__x86_64__)
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx512f"))
+  {
+    param->mutaterow = ESKernelMutateRowAVX512;
+    param->differrow = ESKernelDifferRowAVX512;
+  }
+  else if(__builtin_cpu_supports("avx2"))
+  {
+    param->mutaterow = ESKernelMutateRowAVX2;
+    param->differrow = ESKernelDifferRowAVX2;
+  }
+#endif
+
+  return;
+}
+
+/*********************************************************************
+ ** exp for the kernels                                             **
+ ** ESKernelExp(x)                                                  **
+ ** t = x*log2(e) + 1.5*2^52 keeps k = round(x*log2(e)) in its low  **
+ ** bits, which are shifted into the exponent of 2^k                **
+ *********************************************************************/
+double ESKernelExp(double x)
+{
+  int i;
+  double t, k, r, p, scale;
+  unsigned long long bits;
+
+  x = (esKernelExpMax < x) ? esKernelExpMax : x;
+  x = (esKernelExpMin > x) ? esKernelExpMin : x;
+  t = x*esKernelLog2e + esKernelShift;
+  k = t - esKernelShift;
+  r = x - k*esKernelLn2Hi;
+  r = r - k*esKernelLn2Lo;
+  p = esKernelPoly[0];
+  for(i=1; i<13; i++)
+    p = p*r + esKernelPoly[i];
+  memcpy(&bits, &t, sizeof(bits));
+  bits = (bits + esKernelBias) << 52;
+  memcpy(&scale, &bits, sizeof(scale));
+
+  return p*scale;
+}
+
+/*********************************************************************
+ ** one lane of ESKernelMutateRow / ESKernelDifferRow               **
+ ** for the scalar kernels                                          **
+ *********************************************************************/
+static int ESKernelMutateLane(double *op, double *sp, double *step,   \
+                              double *op_, double *sp_, double randscalar,   \
+                              double *randsp, double *randop,   \
+                              ESParameter *param, int j)
+{
+  double s, o;
+
+  s = sp_[j]*ESKernelExp(param->tau_*randscalar + param->tau*randsp[j]);
+  s = (param->spb[j] < s) ? param->spb[j] : s;
+  o = op_[j] + s*randop[j];
+  step[j] = s;
+  op[j] = o;
+  sp[j] = sp_[j] + param->alpha*(s - sp_[j]);
+
+  return (o > param->ub[j] || o < param->lb[j]);
+}
+
+static int ESKernelDifferLane(double *op, double *best_, double *other_,   \
+                              ESParameter *param, int j)
+{
+  double o;
+
+  o = op[j] + param->gamma*(best_[j] - other_[j]);
+  op[j] = o;
+
+  return (o > param->ub[j] || o < param->lb[j]);
+}
+
+/*********************************************************************
+ ** scalar kernels                                                  **
+ *********************************************************************/
+int ESKernelMutateRowScalar(double *op, double *sp, double *step,   \
+                            double *op_, double *sp_, double randscalar,   \
+                            double *randsp, double *randop,   \
+                            ESParameter *param)
+{
+  int j;
+  int out;
+
+  out = 0;
+  for(j=0; j<param->dim; j++)
+    out += ESKernelMutateLane(op, sp, step, op_, sp_, randscalar,   \
+                              randsp, randop, param, j);
+
+  return out;
+}
+
+int ESKernelDifferRowScalar(double *op, double *best_, double *other_,   \
+                            ESParameter *param)
+{
+  int j;
+  int out;
+
+  out = 0;
+  for(j=0; j<param->dim; j++)
+    out += ESKernelDifferLane(op, best_, other_, param, j);
+
+  return out;
+}
+
+#if defined(__x86_64__)
+
+/*********************************************************************
+ ** AVX2 kernels, 4 lanes                                           **
+ ** the tail of a row is done with a lane mask, as mixing in scalar **
+ ** SSE code would stall on the AVX/SSE transitions                 **
+ ** only mul/add are used, so no lane is rounded differently from   **
+ ** ESKernelExp; AVX-512F has FMA, so contraction is turned off to  **
+ ** keep its mul/add separate as well                               **
+ *********************************************************************/
+#pragma GCC push_options
+#pragma GCC optimize ("fp-contract=off")
+
+__attribute__((target("avx2")))
+static __m256d ESKernelExpAVX2(__m256d x)
+{
+  int i;
+  __m256d t, k, r, p;
+  __m256i bits;
+
+  x = _mm256_min_pd(_mm256_set1_pd(esKernelExpMax), x);
+  x = _mm256_max_pd(_mm256_set1_pd(esKernelExpMin), x);
+  t = _mm256_add_pd(_mm256_mul_pd(x, _mm256_set1_pd(esKernelLog2e)),   \
+                    _mm256_set1_pd(esKernelShift));
+  k = _mm256_sub_pd(t, _mm256_set1_pd(esKernelShift));
+  r = _mm256_sub_pd(x, _mm256_mul_pd(k, _mm256_set1_pd(esKernelLn2Hi)));
+  r = _mm256_sub_pd(r, _mm256_mul_pd(k, _mm256_set1_pd(esKernelLn2Lo)));
+  p = _mm256_set1_pd(esKernelPoly[0]);
+  for(i=1; i<13; i++)
+    p = _mm256_add_pd(_mm256_mul_pd(p, r), _mm256_set1_pd(esKernelPoly[i]));
+  bits = _mm256_add_epi64(_mm256_castpd_si256(t),   \
+                          _mm256_set1_epi64x(esKernelBias));
+  bits = _mm256_slli_epi64(bits, 52);
+
+  return _mm256_mul_pd(p, _mm256_castsi256_pd(bits));
+}
+
+__attribute__((target("avx2")))
+static __m256i ESKernelMaskAVX2(int n)
+{
+  return _mm256_cmpgt_epi64(_mm256_set1_epi64x(n),   \
+                            _mm256_set_epi64x(3, 2, 1, 0));
+}
+
+__attribute__((target("avx2")))
+static int ESKernelOutAVX2(__m256i m, __m256d o, double *ub, double *lb)
+{
+  __m256d over, under;
+
+  over = _mm256_cmp_pd(o, _mm256_maskload_pd(ub, m), _CMP_GT_OQ);
+  under = _mm256_cmp_pd(o, _mm256_maskload_pd(lb, m), _CMP_LT_OQ);
+
+  return __builtin_popcount(_mm256_movemask_pd(_mm256_and_pd(   \
+                            _mm256_or_pd(over, under),   \
+                            _mm256_castsi256_pd(m))));
+}
+
+__attribute__((target("avx2")))
+int ESKernelMutateRowAVX2(double *op, double *sp, double *step,   \
+                          double *op_, double *sp_, double randscalar,   \
+                          double *randsp, double *randop,   \
+                          ESParameter *param)
+{
+  int j, dim;
+  int out;
+  __m256i m;
+  __m256d tau, tau_, alpha, scalar;
+  __m256d s, o, parentsp;
+
+  dim = param->dim;
+  tau = _mm256_set1_pd(param->tau);
+  tau_ = _mm256_set1_pd(param->tau_);
+  alpha = _mm256_set1_pd(param->alpha);
+  scalar = _mm256_mul_pd(tau_, _mm256_set1_pd(randscalar));
+
+  out = 0;
+  for(j=0; j<dim; j+=4)
+  {
+    m = ESKernelMaskAVX2(dim-j);
+    parentsp = _mm256_maskload_pd(sp_+j, m);
+    s = _mm256_add_pd(scalar,   \
+                      _mm256_mul_pd(tau, _mm256_maskload_pd(randsp+j, m)));
+    s = _mm256_mul_pd(parentsp, ESKernelExpAVX2(s));
+    s = _mm256_min_pd(_mm256_maskload_pd(param->spb+j, m), s);
+    o = _mm256_add_pd(_mm256_maskload_pd(op_+j, m),   \
+                      _mm256_mul_pd(s, _mm256_maskload_pd(randop+j, m)));
+    _mm256_maskstore_pd(step+j, m, s);
+    _mm256_maskstore_pd(op+j, m, o);
+    _mm256_maskstore_pd(sp+j, m, _mm256_add_pd(parentsp,   \
+                        _mm256_mul_pd(alpha, _mm256_sub_pd(s, parentsp))));
+    out += ESKernelOutAVX2(m, o, param->ub+j, param->lb+j);
+  }
+
+  return out;
+}
+
+__attribute__((target("avx2")))
+int ESKernelDifferRowAVX2(double *op, double *best_, double *other_,   \
+                          ESParameter *param)
+{
+  int j, dim;
+  int out;
+  __m256i m;
+  __m256d gamma, o;
+
+  dim = param->dim;
+  gamma = _mm256_set1_pd(param->gamma);
+
+  out = 0;
+  for(j=0; j<dim; j+=4)
+  {
+    m = ESKernelMaskAVX2(dim-j);
+    o = _mm256_sub_pd(_mm256_maskload_pd(best_+j, m),   \
+                      _mm256_maskload_pd(other_+j, m));
+    o = _mm256_add_pd(_mm256_maskload_pd(op+j, m), _mm256_mul_pd(gamma, o));
+    _mm256_maskstore_pd(op+j, m, o);
+    out += ESKernelOutAVX2(m, o, param->ub+j, param->lb+j);
+  }
+
+  return out;
+}
+
+/*********************************************************************
+ ** AVX-512F kernels, 8 lanes                                       **
+ ** the tail of a row is done with a lane mask                      **
+ ** the maskz forms with a full mask avoid GCC 12's false           **
+ ** maybe-uninitialized warnings on the plain min/max/slli          **
+ *********************************************************************/
+__attribute__((target("avx512f")))
+static __m512d ESKernelExpAVX512(__m512d x)
+{
+  int i;
+  __m512d t, k, r, p;
+  __m512i bits;
+
+  x = _mm512_maskz_min_pd(0xFF, _mm512_set1_pd(esKernelExpMax), x);
+  x = _mm512_maskz_max_pd(0xFF, _mm512_set1_pd(esKernelExpMin), x);
+  t = _mm512_add_pd(_mm512_mul_pd(x, _mm512_set1_pd(esKernelLog2e)),   \
+                    _mm512_set1_pd(esKernelShift));
+  k = _mm512_sub_pd(t, _mm512_set1_pd(esKernelShift));
+  r = _mm512_sub_pd(x, _mm512_mul_pd(k, _mm512_set1_pd(esKernelLn2Hi)));
+  r = _mm512_sub_pd(r, _mm512_mul_pd(k, _mm512_set1_pd(esKernelLn2Lo)));
+  p = _mm512_set1_pd(esKernelPoly[0]);
+  for(i=1; i<13; i++)
+    p = _mm512_add_pd(_mm512_mul_pd(p, r), _mm512_set1_pd(esKernelPoly[i]));
+  bits = _mm512_add_epi64(_mm512_castpd_si512(t),   \
+                          _mm512_set1_epi64(esKernelBias));
+  bits = _mm512_maskz_slli_epi64(0xFF, bits, 52);
+
+  return _mm512_mul_pd(p, _mm512_castsi512_pd(bits));
+}
+
+__attribute__((target("avx512f")))
+static int ESKernelOutAVX512(__mmask8 m, __m512d o, double *ub, double *lb)
+{
+  __mmask8 over, under;
+
+  over = _mm512_mask_cmp_pd_mask(m, o, _mm512_maskz_loadu_pd(m, ub),   \
+                                 _CMP_GT_OQ);
+  under = _mm512_mask_cmp_pd_mask(m, o, _mm512_maskz_loadu_pd(m, lb),   \
+                                  _CMP_LT_OQ);
+
+  return __builtin_popcount((unsigned int)(over | under));
+}
+
+__attribute__((target("avx512f")))
+int ESKernelMutateRowAVX512(double *op, double *sp, double *step,   \
+                            double *op_, double *sp_, double randscalar,   \
+                            double *randsp, double *randop,   \
+                            ESParameter *param)
+{
+  int j, dim;
+  int out;
+  __mmask8 m;
+  __m512d tau, tau_, alpha, scalar;
+  __m512d s, o, parentsp;
+
+  dim = param->dim;
+  tau = _mm512_set1_pd(param->tau);
+  tau_ = _mm512_set1_pd(param->tau_);
+  alpha = _mm512_set1_pd(param->alpha);
+  scalar = _mm512_mul_pd(tau_, _mm512_set1_pd(randscalar));
+
+  out = 0;
+  for(j=0; j<dim; j+=8)
+  {
+    m = (dim-j >= 8) ? 0xFF : (__mmask8)((1u << (dim-j)) - 1);
+    parentsp = _mm512_maskz_loadu_pd(m, sp_+j);
+    s = _mm512_add_pd(scalar,   \
+                      _mm512_mul_pd(tau, _mm512_maskz_loadu_pd(m, randsp+j)));
+    s = _mm512_mul_pd(parentsp, ESKernelExpAVX512(s));
+    s = _mm512_maskz_min_pd(0xFF,   \
+                            _mm512_maskz_loadu_pd(m, param->spb+j), s);
+    o = _mm512_add_pd(_mm512_maskz_loadu_pd(m, op_+j),   \
+                      _mm512_mul_pd(s, _mm512_maskz_loadu_pd(m, randop+j)));
+    _mm512_mask_storeu_pd(step+j, m, s);
+    _mm512_mask_storeu_pd(op+j, m, o);
+    _mm512_mask_storeu_pd(sp+j, m, _mm512_add_pd(parentsp,   \
+                          _mm512_mul_pd(alpha, _mm512_sub_pd(s, parentsp))));
+    out += ESKernelOutAVX512(m, o, param->ub+j, param->lb+j);
+  }
+
+  return out;
+}
+
+__attribute__((target("avx512f")))
+int ESKernelDifferRowAVX512(double *op, double *best_, double *other_,   \
+                            ESParameter *param)
+{
+  int j, dim;
+  int out;
+  __mmask8 m;
+  __m512d gamma, o;
+
+  dim = param->dim;
+  gamma = _mm512_set1_pd(param->gamma);
+
+  out = 0;
+  for(j=0; j<dim; j+=8)
+  {
+    m = (dim-j >= 8) ? 0xFF : (__mmask8)((1u << (dim-j)) - 1);
+    o = _mm512_sub_pd(_mm512_maskz_loadu_pd(m, best_+j),   \
+                      _mm512_maskz_loadu_pd(m, other_+j));
+    o = _mm512_add_pd(_mm512_maskz_loadu_pd(m, op+j), _mm512_mul_pd(gamma, o));
+    _mm512_mask_storeu_pd(op+j, m, o);
+    out += ESKernelOutAVX512(m, o, param->ub+j, param->lb+j);
+  }
+
+  return out;
+}
+
+#pragma GCC pop_options
+
+#endif
@@ -0,0 +1,75 @@
+/*********************************************************************
+ ** Stochastic Ranking Evolution Strategy                           **
+ ** Mutation kernels                                                **
+ **                                                                 **
+ ** For ACADEMIC RESEARCH, this is licensed with GPL license        **
+ ** For COMMERCIAL ACTIVITIES, please contact the authors           **
+ **                                                                 **
+ ** This program is distributed in the hope that it will be useful, **
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of  **
+ ** MERCHANTABILITY of FITNESS FOR A PARTICULAR PURPOSE. See the    **
+ ** GNU General Public License for more details.                    **
+ **                                                                 **
+ ** You should have received a copy of the GNU General Public       **
+ ** License along with is program; if not, write to the Free        **
+ ** Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, **
+ ** MA 02111-1307, USA.                                             **
+ *********************************************************************/
+
+#ifndef ESKERNEL_HPP
+#define ESKERNEL_HPP
+
+#include "ESES.hpp"
+
+/*********************************************************************
+ ** choose the mutation kernels for this processor                  **
+ ** ESKernelSelect(param)                                           **
+ ** -> param->mutaterow, param->differrow                           **
+ ** AVX-512F if the processor has it, else AVX2, else scalar        **
+ ** every kernel does the same arithmetic in the same order, so the **
+ ** choice does not change any result                               **
+ *********************************************************************/
+void ESKernelSelect(ESParameter *);
+
+/*********************************************************************
+ ** exp for the kernels                                             **
+ ** ESKernelExp(x)                                                  **
+ ** x clamped to [-708, 708], x = k*ln2 + r, exp(x) = 2^k * p(r)    **
+ ** p: degree 12 Taylor polynomial, within 2 ulp of libm's exp      **
+ ** the vector kernels compute it lane by lane with the same steps  **
+ *********************************************************************/
+double ESKernelExp(double);
+
+/*********************************************************************
+ ** mutate one offspring row                                        **
+ ** ESKernelMutateRow(op, sp, step, op_, sp_, randscalar, randsp,   **
+ **                   randop, param)                                **
+ ** op_, sp_: the parent's row                                      **
+ ** step = min(sp_*exp(tau_*randscalar + tau*randsp), spb)          **
+ ** op = op_ + step*randop                                          **
+ ** sp = sp_ + alpha*(step - sp_)                                   **
+ ** return: how many op are out of [lb, ub], to retry with step     **
+ **                                                                 **
+ ** differentially vary one parent row                              **
+ ** ESKernelDifferRow(op, best_, other_, param)                     **
+ ** op = op + gamma*(best_ - other_)                                **
+ ** return: how many op are out of [lb, ub]                         **
+ **                                                                 **
+ ** one version of each per instruction set, Scalar/AVX2/AVX512     **
+ *********************************************************************/
+int ESKernelMutateRowScalar(double *, double *, double *, double *,   \
+                            double *, double, double *, double *,   \
+                            ESParameter *);
+int ESKernelDifferRowScalar(double *, double *, double *, ESParameter *);
+#if defined(__x86_64__)
+int ESKernelMutateRowAVX2(double *, double *, double *, double *,   \
+                          double *, double, double *, double *,   \
+                          ESParameter *);
+int ESKernelDifferRowAVX2(double *, double *, double *, ESParameter *);
+int ESKernelMutateRowAVX512(double *, double *, double *, double *,   \
+                            double *, double, double *, double *,   \
+                            ESParameter *);
+int ESKernelDifferRowAVX512(double *, double *, double *, ESParameter *);
+#endif
+
+#endif
@@ -33,36 +33,131 @@
 
 #include "../source/memory.hpp"
 
+/*********************************************************************
+ ** Philox4x32-10 constants, from Salmon et al., "Parallel random   **
+ ** numbers: as easy as 1, 2, 3", SC 2011                           **
+ *********************************************************************/
+#define sharePhiloxM0 0xD2511F53U
+#define sharePhiloxM1 0xCD9E8D57U
+#define sharePhiloxW0 0x9E3779B9U
+#define sharePhiloxW1 0xBB67AE85U
+#define sharePhiloxRounds 10
+
+/*********************************************************************
+ ** key of every random stream, set once by ShareSeed               **
+ *********************************************************************/
+static unsigned int shareKey[2] = {0, 0};
+
+/*********************************************************************
+ ** void SharePhilox(ctr, key, out)                                 **
+ ** out[4] = Philox4x32-10 of ctr[4] under key[2]                   **
+ ** inline here, so the draws below keep the rounds in registers    **
+ *********************************************************************/
+static inline void SharePhiloxInline(const unsigned int *ctr,   \
+                                     const unsigned int *key,   \
+                                     unsigned int *out)
+{
+  unsigned long long p0, p1;
+  unsigned int x0, x1, x2, x3;
+  unsigned int k0, k1;
+  int r;
+
+  x0 = ctr[0];
+  x1 = ctr[1];
+  x2 = ctr[2];
+  x3 = ctr[3];
+  k0 = key[0];
+  k1 = key[1];
+  for(r=0; r<sharePhiloxRounds; r++)
+  {
+    p0 = (unsigned long long)sharePhiloxM0*x0;
+    p1 = (unsigned long long)sharePhiloxM1*x2;
+    x0 = (unsigned int)(p1 >> 32) ^ x1 ^ k0;
+    x1 = (unsigned int)p1;
+    x2 = (unsigned int)(p0 >> 32) ^ x3 ^ k1;
+    x3 = (unsigned int)p0;
+    k0 += sharePhiloxW0;
+    k1 += sharePhiloxW1;
+  }
+  out[0] = x0;
+  out[1] = x1;
+  out[2] = x2;
+  out[3] = x3;
+
+  return;
+}
+
+void SharePhilox(const unsigned int *ctr, const unsigned int *key,   \
+                 unsigned int *out)
+{
+  SharePhiloxInline(ctr, key, out);
+
+  return;
+}
+
+/*********************************************************************
+ ** block of the draw (gen, ind, dim, stream)                       **
+ ** ShareBlock(gen, ind, dim, stream, out)                          **
+ *********************************************************************/
+static inline void ShareBlock(unsigned int gen, unsigned int ind,   \
+                              unsigned int dim, unsigned int stream,   \
+                              unsigned int *out)
+{
+  unsigned int ctr[4];
+
+  ctr[0] = dim;
+  ctr[1] = ind;
+  ctr[2] = gen;
+  ctr[3] = stream;
+  SharePhiloxInline(ctr, shareKey, out);
+
+  return;
+}
+
+/*********************************************************************
+ ** uniform in [0,1) of two words, 53 bits                          **
+ ** ShareUnit(hi, lo)                                               **
+ *********************************************************************/
+static inline double ShareUnit(unsigned int hi, unsigned int lo)
+{
+  return (double)((((unsigned long long)hi << 32) | lo) >> 11)   \
+         *(1.0/9007199254740992.0);
+}
+
 /*********************************************************************
  ** uniform random                                                  **
- ** double ShareRand(min,max)                                       **
+ ** double ShareRand(min,max,gen,ind,dim,stream)                    **
  ** min: min value                                                  **
  ** max: max value                                                  **
  **                                                                 **
- ** return value = min + (max-min)*rand()/(RAND_MAX)                **
+ ** return value = min + (max-min)*u, u in [0,1) with 53 bits       **
  **                                                                 **
- ** double ShareRandVec(n, min, max)                                **
+ ** double ShareRandVec(n, min, max, gen, ind, stream)              **
  ** return s=vec(n)                                                 **
  *********************************************************************/
-double ShareRand(double min, double max)
+double ShareRand(double min, double max, unsigned int gen,   \
+                 unsigned int ind, unsigned int dim, unsigned int stream)
 {
+  unsigned int out[4];
   double delta;
   double value;
 
   delta = max - min;
 
-  value = (double)rand()/(RAND_MAX);
+  ShareBlock(gen, ind, dim, stream, out);
+  value = ShareUnit(out[0], out[1]);
   value = min + delta*value;
 
   return value;
 }
 
-void ShareRandVec(double *s, int n, double min, double max)
+void ShareRandVec(double *s, int n, double min, double max,   \
+                  unsigned int gen, unsigned int ind, unsigned int stream)
 {
   int i;
 
   for(i=0; i<n; i++)
-    s[i] = ShareRand(min, max);
+    s[i] = ShareRand(min, max, gen, ind, i, stream);
 
   return;
 }
@@ -81,17 +176,15 @@ void ShareSeed(unsigned int inseed, unsigned int *outseed)
 /*********************************************************************
  ** shareDefSeed = 0                                                **
  *********************************************************************/
-  if(inseed != shareDefSeed)
+  if(inseed == shareDefSeed)
   {
-    srand(inseed);
-    *outseed = inseed;
-    return;
+    thispid = getpid();
+    time(&nowtime);
+    inseed = thispid*nowtime;
   }
 
-  thispid = getpid();
-  time(&nowtime);
-  inseed = thispid*nowtime;
-  srand(inseed);
+  shareKey[0] = inseed;
+  shareKey[1] = 0;
   *outseed = inseed;
 
   return;
@@ -100,49 +193,46 @@ void ShareSeed(unsigned int inseed, unsigned int *outseed)
 /*********************************************************************
  ** gaussian random: normal distribution                            **
  ** N(mean, dev)                                                    **
+ ** Box-Muller: u1 in (0,1], u2 in [0,1) from one block             **
+ ** z = sqrt(-2*log(u1))*cos(2*pi*u2), the sin value is the second  **
+ ** normal ShareNormalRandVec takes from the block                  **
  **                                                                 **
- ** void ShareNormalRandVec(s, n, mean, dev)                        **
+ ** void ShareNormalRandVec(s, n, mean, dev, gen, ind, stream)      **
  ** return s=vec(n)                                                 **
- **                                                                 **
- ** source code from                                                **
- **        http://remus.rutgers.edu/~rhoads/Code/code.html          **
  *********************************************************************/
-double ShareNormalRand(double mean, double dev)
+double ShareNormalRand(double mean, double dev, unsigned int gen,   \
+                       unsigned int ind, unsigned int dim,   \
+                       unsigned int stream)
 {
-  static double V2, fac;
-  static int phase = 0;
-  double S, Z, U1, U2, V1;
+  unsigned int out[4];
+  double R, Z;
 
-  if (phase)
-    Z = V2 * fac;
-  else
-  {
-    do 
-    {
-      U1 = (double)rand() / RAND_MAX;
-      U2 = (double)rand() / RAND_MAX;
-      V1 = 2 * U1 - 1;
-      V2 = 2 * U2 - 1;
-      S = V1 * V1 + V2 * V2;
-    } while(S >= 1 || S ==0.0);
-
-    fac = sqrt (-2 * log(S) / S);
-    Z = V1 * fac;
-  }
-
-  phase = 1 - phase;
+  ShareBlock(gen, ind, dim, stream, out);
+  R = sqrt(-2*log(1.0 - ShareUnit(out[0], out[1])));
+  Z = R*cos(2*M_PI*ShareUnit(out[2], out[3]));
 
   Z = mean + dev*Z;
 
   return Z;
 }
 
-void ShareNormalRandVec(double *s, int n, double mean, double dev)
+void ShareNormalRandVec(double *s, int n, double mean, double dev,   \
+                        unsigned int gen, unsigned int ind,   \
+                        unsigned int stream)
 {
+  unsigned int out[4];
+  double R, T;
   int i;
 
-  for(i=0; i<n; i++)
-    s[i] = ShareNormalRand(mean, dev);
+  for(i=0; i<n; i+=2)
+  {
+    ShareBlock(gen, ind, i/2, stream, out);
+    R = sqrt(-2*log(1.0 - ShareUnit(out[0], out[1])));
+    T = 2*M_PI*ShareUnit(out[2], out[3]);
+    s[i] = mean + dev*R*cos(T);
+    if(i+1 < n)
+      s[i+1] = mean + dev*R*sin(T);
+  }
 
   return;
 }
@@ -295,6 +385,44 @@ void ShareFreeM1d(double *s)
   return;
 }
 
+/*********************************************************************
+ ** to malloc memories aligned to shareDefAlign bytes               **
+ ** ShareMallocAlignedM1d(size): size*double, zeroed                **
+ ** the block is over-allocated and the pointer mallocate returned  **
+ ** is kept just before the aligned memory                          **
+ ** ShareAlignedStride(size): size rounded up to shareDefAlign      **
+ **                                                                 **
+ ** to free memories                                                **
+ ** ShareFreeAlignedM1d(s)                                          **
+ *********************************************************************/
+double * ShareMallocAlignedM1d(int size)
+{
+  char *block = NULL;
+  char *s = NULL;
+
+  block = (char *)callocate(size*sizeof(double) + sizeof(char *) + shareDefAlign, 1);
+  s = block + sizeof(char *);
+  s += (shareDefAlign - ((size_t)s % shareDefAlign)) % shareDefAlign;
+  ((char **)s)[-1] = block;
+
+  return (double *)s;
+}
+
+int ShareAlignedStride(int size)
+{
+  int perblock;
+
+  perblock = shareDefAlign/sizeof(double);
+  return (size + perblock - 1)/perblock*perblock;
+}
+
+void ShareFreeAlignedM1d(double *s)
+{
+  if(s)
+    mfree((void *)(((char **)s)[-1]));
+  return;
+}
+
 /*********************************************************************
  ** to malloc memories                                              **
  ** ShareMallocM2d(size1, size2)                                    **
@@ -373,6 +501,120 @@ void ShareFreeM3d(double ***s, int size1, int size2)
   return;
 }
 
+/*********************************************************************
+ ** bump allocator for the temporaries of a generation              **
+ ** ShareArenaInit(arena)                                           **
+ ** ShareArenaReset(arena)                                          **
+ ** ShareArenaFree(arena)                                           **
+ ** ShareArenaMallocM1c(arena, size)                                **
+ ** a request is rounded up to shareDefAlign bytes; one that does   **
+ ** not fit in block gets a spill block of its own, and is still    **
+ ** counted in need, so block fits it after the next reset          **
+ ** block and spills count as MEM_TAG_SCRATCH for the memory        **
+ ** tracker                                                         **
+ *********************************************************************/
+void ShareArenaInit(ShareArena *arena)
+{
+  arena->raw = NULL;
+  arena->block = NULL;
+  arena->size = 0;
+  arena->used = 0;
+  arena->need = 0;
+  arena->spill = NULL;
+
+  return;
+}
+
+void ShareArenaReset(ShareArena *arena)
+{
+  char *next;
+  int tag;
+
+  while(arena->spill != NULL)
+  {
+    next = *(char **)arena->spill;
+    mfree(arena->spill);
+    arena->spill = next;
+  }
+
+  if(arena->need > arena->size)
+  {
+    mfree(arena->raw);
+    arena->size = arena->need;
+    tag = mem_tag(MEM_TAG_SCRATCH);
+    arena->raw = (char *)mallocate(arena->size + shareDefAlign);
+    mem_tag(tag);
+    arena->block = arena->raw;
+    arena->block += (shareDefAlign - ((size_t)arena->block % shareDefAlign))   \
+                    % shareDefAlign;
+  }
+  arena->used = 0;
+  arena->need = 0;
+
+  return;
+}
+
+void ShareArenaFree(ShareArena *arena)
+{
+  ShareArenaReset(arena);
+  mfree(arena->raw);
+  ShareArenaInit(arena);
+
+  return;
+}
+
+char * ShareArenaMallocM1c(ShareArena *arena, int size)
+{
+  char *s, *spill;
+  size_t bytes;
+  int tag;
+
+  bytes = ((size_t)size + shareDefAlign - 1)/shareDefAlign*shareDefAlign;
+  if(bytes == 0)
+    bytes = shareDefAlign;
+  arena->need += bytes;
+  if(arena->used + bytes <= arena->size)
+  {
+    s = arena->block + arena->used;
+    arena->used += bytes;
+  }
+  else
+  {
+    tag = mem_tag(MEM_TAG_SCRATCH);
+    spill = (char *)mallocate(shareDefAlign + bytes + shareDefAlign);
+    mem_tag(tag);
+    *(char **)spill = arena->spill;
+    arena->spill = spill;
+    s = spill + shareDefAlign;
+    s += (shareDefAlign - ((size_t)s % shareDefAlign)) % shareDefAlign;
+  }
+  memset(s, 0, bytes);
+
+  return s;
+}
+
+int * ShareArenaMallocM1i(ShareArena *arena, int size)
+{
+  return (int *)ShareArenaMallocM1c(arena, size*sizeof(int));
+}
+
+double * ShareArenaMallocM1d(ShareArena *arena, int size)
+{
+  return (double *)ShareArenaMallocM1c(arena, size*sizeof(double));
+}
+
+double ** ShareArenaMallocM2d(ShareArena *arena, int size1, int size2)
+{
+  int i;
+  double **s;
+
+  s = (double **)ShareArenaMallocM1c(arena, size1*sizeof(double *));
+  for(i=0; i<size1; i++)
+    s[i] = ShareArenaMallocM1d(arena, size2);
+
+  return s;
+}
+
 /*********************************************************************
  ** to check if it's equal to zero                                  **
  ** if(x<shareDefMinZero) return true                               **
@@ -39,6 +39,7 @@
 #include "sharefunc.hpp"
 #include "ESSRSort.hpp"
 #include "ESES.hpp"
+#include "ESKernel.hpp"
 
 #include "../source/io.hpp"
 
@@ -46,7 +47,7 @@ extern int printing_precision; // Declared in main.cpp
 
 /*********************************************************************
  ** Initialize: parameters,populations and random seed              **
- ** ESInitial(seed, param,trsfm, fg,es, constraint,                 **
+ ** ESInitial(seed, param,trsfm, fg,fgbatch,es, constraint,         **
  **            dim,ub,lb,miu,lambda,gen,                            **
  **              gamma, alpha, varphi, retry, population, stats)    **
  ** seed: random seed, usually esDefSeed=0 (pid*time)               **
@@ -54,6 +55,7 @@ extern int printing_precision; // Declared in main.cpp
  ** param: point to parameter                                       **
  ** trsfm: to transform sp/op                                       **
  ** fg: functions of fitness and constraints                        **
+ ** fgbatch: fg for a batch of individuals, NULL to call fg on each **
  ** es: ES process, esDefESPlus/esDefESSlash                        **
  ** constraint: number of constraints                               **
  ** dim: dimension/number of genes in genome                        **
@@ -78,7 +80,8 @@ extern int printing_precision; // Declared in main.cpp
  ** free param and population                                       **
  *********************************************************************/
 void ESInitial(unsigned int seed, ESParameter ** param,ESfcnTrsfm *trsfm,  \
-               ESfcnFG fg, int es, int constraint, int dim, double* ub,   \
+               ESfcnFG fg, ESfcnFGBatch fgbatch, int es, int constraint,   \
+               int dim, double* ub,   \
                double *lb, int miu, int lambda, int gen,  \
                double gamma, double alpha, double varphi, int retry,  \
                ESPopulation ** population, ESStatistics **stats)
@@ -86,7 +89,8 @@ void ESInitial(unsigned int seed, ESParameter ** param,ESfcnTrsfm *trsfm,  \
   unsigned int outseed;
 
   ShareSeed(seed, &outseed);
-  ESInitialParam(param, trsfm, fg, es, outseed,constraint, dim, ub, lb,   \
+  ESInitialParam(param, trsfm, fg, fgbatch, es, outseed,constraint,   \
+                 dim, ub, lb,   \
                  miu, lambda, gen, gamma, alpha, varphi, retry);
   ESInitialPopulation(population, (*param));
   ESInitialStat(stats, (*population), (*param));
@@ -102,16 +106,18 @@ void ESDeInitial(ESParameter *param, ESPopulation *population,   \
   ESDeInitialPopulation(population, param);
   ESDeInitialParam(param);
   ESDeInitialStat(stats);
+  ESSRTeamFree();
   return;
 }
 
 /*********************************************************************
  ** initialize parameters                                           **
- ** ESInitialParam(param, trsfm, fg,constraint,                     **
+ ** ESInitialParam(param, trsfm, fg,fgbatch,constraint,             **
  **                dim,ub,lb,miu,lambda,gen)                        **
  ** param: point to parameter                                       **
  ** trsfm: to transform sp/op                                       **
  ** fg: functions of fitness and constraints                        **
+ ** fgbatch: fg for a batch of individuals, NULL to call fg on each **
  ** es: ES process, esDefESPlus/esDefESSlash                        **
  ** seed: reserve seed for next use                                 **
  ** constraint: number of constraints                               **
@@ -136,7 +142,8 @@ void ESDeInitial(ESParameter *param, ESPopulation *population,   \
  ** free param                                                      **
  *********************************************************************/
 void ESInitialParam(ESParameter **param,ESfcnTrsfm *trsfm,  \
-                    ESfcnFG fg, int es, unsigned int seed,  \
+                    ESfcnFG fg, ESfcnFGBatch fgbatch,  \
+                    int es, unsigned int seed,  \
                     int constraint, int dim,  double *ub, double *lb,   \
                     int miu, int lambda, int gen,  \
                     double gamma, double alpha,  \
@@ -147,9 +154,11 @@ void ESInitialParam(ESParameter **param,ESfcnTrsfm *trsfm,  \
   (*param) = (ESParameter *)ShareMallocM1c(sizeof(ESParameter));
   (*param)->trsfm = NULL;
   (*param)->fg = NULL;
+  (*param)->fgbatch = NULL;
   (*param)->ub = NULL;
   (*param)->lb = NULL;
   (*param)->spb = NULL;
+  ShareArenaInit(&((*param)->arena));
 
   (*param)->spb = ShareMallocM1d(dim);
   for(i=0; i<dim; i++)
@@ -157,6 +166,7 @@ void ESInitialParam(ESParameter **param,ESfcnTrsfm *trsfm,  \
 
   (*param)->trsfm = trsfm;
   (*param)->fg = fg;
+  (*param)->fgbatch = fgbatch;
   (*param)->es = es;
   (*param)->seed = seed;
   (*param)->constraint = constraint;
@@ -184,11 +194,14 @@ void ESInitialParam(ESParameter **param,ESfcnTrsfm *trsfm,  \
   (*param)->tau = (*param)->varphi/(sqrt(2*sqrt(dim)));
   (*param)->tau_ = (*param)->varphi/(sqrt(2*dim));
 
+  ESKernelSelect(*param);
+
 
   return;
 }
 void ESDeInitialParam(ESParameter *param)
 {
+  ShareArenaFree(&(param->arena));
   ShareFreeM1d(param->spb);
   ShareFreeM1c((char *)param);
   param = NULL;
@@ -202,7 +215,7 @@ void ESDeInitialParam(ESParameter *param)
  ** param: point to this parameter                                  **
  **   -> index: 0->eslambda-1                                       **
  **   -> individual[eslambda]                                       **
- **   -> fg(individual)                                             **
+ **   -> ESEvaluate(individual[eslambda]) in one batch              **
  **   -> f,phi                                                      **
  ** the initialization is looked as first generation                **
  **                                                                 **
@@ -211,16 +224,38 @@ void ESDeInitialParam(ESParameter *param)
  *********************************************************************/
 void ESInitialPopulation(ESPopulation **population, ESParameter *param)
 {
-  int i;
+  int i, j;
   int eslambda;
+  int dim, constraint, stride;
+  double *ub, *lb;
+  double *op, *sp;
 
   eslambda = param->eslambda;
+  dim = param->dim;
+  constraint = param->constraint;
+  ub = param->ub;
+  lb = param->lb;
+  stride = ShareAlignedStride(dim);
 
   (*population) = (ESPopulation *)ShareMallocM1c(sizeof(ESPopulation));
   (*population)->member = NULL;
   (*population)->f = NULL;
   (*population)->phi = NULL;
   (*population)->index = NULL;
+  (*population)->op = NULL;
+  (*population)->sp = NULL;
+  (*population)->g = NULL;
+  (*population)->rows = NULL;
+  (*population)->backop = NULL;
+  (*population)->backsp = NULL;
+  (*population)->backg = NULL;
+  (*population)->backf = NULL;
+  (*population)->backphi = NULL;
+  (*population)->parent = NULL;
+  (*population)->randscalar = NULL;
+  (*population)->randsp = NULL;
+  (*population)->randop = NULL;
+  (*population)->step = NULL;
 
   (*population)->member = (ESIndividual **)  \
                    ShareMallocM1c(eslambda*sizeof(ESIndividual *));
@@ -229,11 +264,43 @@ void ESInitialPopulation(ESPopulation **population, ESParameter *param)
 
   (*population)->index = ShareMallocM1i(eslambda);
 
+  (*population)->stride = stride;
+  (*population)->op = ShareMallocAlignedM1d(eslambda*stride);
+  (*population)->sp = ShareMallocAlignedM1d(eslambda*stride);
+  (*population)->g = ShareMallocAlignedM1d(eslambda*constraint);
+  (*population)->rows = (ESIndividual *)  \
+                   ShareMallocM1c(eslambda*sizeof(ESIndividual));
+  (*population)->backop = ShareMallocAlignedM1d(eslambda*stride);
+  (*population)->backsp = ShareMallocAlignedM1d(eslambda*stride);
+  (*population)->backg = ShareMallocAlignedM1d(eslambda*constraint);
+  (*population)->backf = ShareMallocM1d(eslambda);
+  (*population)->backphi = ShareMallocM1d(eslambda);
+  (*population)->parent = ShareMallocM1i(eslambda);
+  (*population)->randscalar = ShareMallocM1d(eslambda);
+  (*population)->randsp = ShareMallocAlignedM1d(eslambda*stride);
+  (*population)->randop = ShareMallocAlignedM1d(eslambda*stride);
+  (*population)->step = ShareMallocAlignedM1d(stride);
+  ESPointMembers((*population), param);
+  (*population)->generation = 0;
+
   for(i=0; i<eslambda; i++)
   {
-    (*population)->member[i] = NULL;
-    ESInitialIndividual(&((*population)->member[i]), param);
+    op = ESRowOp((*population), i);
+    sp = ESRowSp((*population), i);
+    for(j=0; j<dim; j++)
+    {
+      op[j] = ShareRand(lb[j], ub[j], 0, i, j, esDefStreamInit);
+      sp[j] = (ub[j] - lb[j])/sqrt(dim);
+    }
+    (*population)->member[i]->f = HUGE_VAL;
+    (*population)->member[i]->phi = 0.0;
     (*population)->index[i] = i;
+    (*population)->parent[i] = i;
+  }
+
+  ESEvaluate((*population)->member, eslambda, param);
+  for(i=0; i<eslambda; i++)
+  {
     (*population)->f[i] = (*population)->member[i]->f;
     (*population)->phi[i] = (*population)->member[i]->phi;
   }
@@ -242,14 +309,21 @@ void ESInitialPopulation(ESPopulation **population, ESParameter *param)
 }
 void ESDeInitialPopulation(ESPopulation *population, ESParameter *param)
 {
-  int i;
-  int eslambda;
-
-  eslambda = param->eslambda;
-
-  for(i=0; i<eslambda; i++)
-    ESDeInitialIndividual(population->member[i]);
   ShareFreeM1c((char *)(population->member));
+  ShareFreeM1c((char *)(population->rows));
+  ShareFreeAlignedM1d(population->op);
+  ShareFreeAlignedM1d(population->sp);
+  ShareFreeAlignedM1d(population->g);
+  ShareFreeAlignedM1d(population->backop);
+  ShareFreeAlignedM1d(population->backsp);
+  ShareFreeAlignedM1d(population->backg);
+  ShareFreeM1d(population->backf);
+  ShareFreeM1d(population->backphi);
+  ShareFreeM1i(population->parent);
+  ShareFreeM1d(population->randscalar);
+  ShareFreeAlignedM1d(population->randsp);
+  ShareFreeAlignedM1d(population->randop);
+  ShareFreeAlignedM1d(population->step);
 
   ShareFreeM1d(population->f);
   ShareFreeM1d(population->phi);
@@ -264,9 +338,8 @@ void ESDeInitialPopulation(ESPopulation *population, ESParameter *param)
 /*********************************************************************
  ** initialize individual                                           **
  ** ESInitialIndividual(indvdl, param)                              **
- ** to calculate f,g,and phi                                        **
+ ** f=HUGE_VAL and phi=0 until the individual is evaluated          **
  ** to initialize op and sp                                         **
- ** phi=sum{(g>0)^2}                                                **
  ** op = rand(lb, ub)                                               **
  ** sp = (ub - lb)/sqrt(dim)                                        **
  **                                                                 **
@@ -284,12 +357,10 @@ void ESInitialIndividual(ESIndividual **indvdl, ESParameter *param)
   int i;
   int dim;
   int constraint;
-  ESfcnFG fg;
   double *ub, *lb;
 
   dim = param->dim;
   constraint = param->constraint;
-  fg = param->fg;
   ub = param->ub;
   lb = param->lb;
 
@@ -308,17 +379,12 @@ void ESInitialIndividual(ESIndividual **indvdl, ESParameter *param)
 
   for(i=0; i<dim; i++)
   {
-    (*indvdl)->op[i] = ShareRand(lb[i], ub[i]);
+    (*indvdl)->op[i] = ShareRand(lb[i], ub[i], 0, -1, i, esDefStreamInit);
     (*indvdl)->sp[i] = (ub[i] - lb[i])/sqrt(dim);
   }
 
-  fg((*indvdl)->op, &((*indvdl)->f), (*indvdl)->g);
+  (*indvdl)->f = HUGE_VAL;
   (*indvdl)->phi = 0.0;
-  for(i=0; i<constraint; i++)
-  {
-    if((*indvdl)->g[i] > 0.0)
-      (*indvdl)->phi += ((*indvdl)->g[i])*((*indvdl)->g[i]);
-  }
 
   return;
 }
@@ -394,30 +460,75 @@ void ESPrintSp(ESIndividual *indvdl, ESParameter *param)
  *********************************************************************/
 void ESCopyIndividual(ESIndividual *from, ESIndividual *to, ESParameter *param)
 {
-  int i;
   int dim;
   int constraint;
 
   dim = param->dim;
   constraint = param->constraint;
 
-  for(i=0; i<dim; i++)
-  {
-    to->op[i] = from->op[i];
-    to->sp[i] = from->sp[i];
-  }
-  for(i=0; i<constraint; i++)
-    to->g[i] = from->g[i];
+  memcpy(to->op, from->op, dim*sizeof(double));
+  memcpy(to->sp, from->sp, dim*sizeof(double));
+  if(constraint > 0)
+    memcpy(to->g, from->g, constraint*sizeof(double));
   to->f = from->f;
   to->phi = from->phi;
 
   return;
 }
 
+/*********************************************************************
+ ** evaluate individuals                                            **
+ ** ESEvaluate(indvdl, n, param)                                    **
+ ** to calculate f,g,and phi of indvdl[n]                           **
+ ** with one call of fgbatch, or fg on each if fgbatch is NULL      **
+ ** the batch arrays come from param->arena                         **
+ *********************************************************************/
+void ESEvaluate(ESIndividual **indvdl, int n, ESParameter *param)
+{
+  int i, j;
+  int constraint;
+  double **op, **g, *f;
+
+  constraint = param->constraint;
+
+  if(param->fgbatch == NULL)
+  {
+    for(i=0; i<n; i++)
+      param->fg(indvdl[i]->op, &(indvdl[i]->f), indvdl[i]->g);
+  }
+  else
+  {
+    op = (double **)ShareArenaMallocM1c(&(param->arena), n*sizeof(double *));
+    g = (double **)ShareArenaMallocM1c(&(param->arena), n*sizeof(double *));
+    f = ShareArenaMallocM1d(&(param->arena), n);
+    for(i=0; i<n; i++)
+    {
+      op[i] = indvdl[i]->op;
+      g[i] = indvdl[i]->g;
+    }
+    param->fgbatch(op, n, f, g);
+    for(i=0; i<n; i++)
+      indvdl[i]->f = f[i];
+  }
+
+  for(i=0; i<n; i++)
+  {
+    indvdl[i]->phi = 0.0;
+    for(j=0; j<constraint; j++)
+    {
+      if(indvdl[i]->g[j] > 0.0)
+        indvdl[i]->phi += (indvdl[i]->g[j] * indvdl[i]->g[j]);
+    }
+  }
+
+  return;
+}
+
 /*********************************************************************
  ** initialize statistics                                           **
  ** ESInitialStat(stats, population, param)                         **
  ** to intialize time, curgen, bestindvdl,thisbestindvdl            **
+ ** bestindvdl,thisbestindvdl are not evaluated (f=HUGE_VAL)        **
  ** not to do the first statistics                                  **
  ** to set dt, bestgen                                              **
  **                                                                 **
@@ -530,17 +641,21 @@ void ESPrintStat(ESStatistics *stats, ESParameter *param)
  ** stepwise evolution                                              **
  ** ESStep(population, param, stats, pf)                            **
  **                                                                 **
- ** -> Stochastic ranking -> sort population based on ranking index **
+ ** -> reset the arena of the last generation                       **
+ ** -> Stochastic ranking -> select the ranked parents into the     **
+ ** next buffer                                                     **
  ** -> Mutate (recalculate f/g/phi) -> do statistics analysis on    **
  ** this generation -> print statistics information                 **
  *********************************************************************/
 void ESStep(ESPopulation *population, ESParameter *param,   \
             ESStatistics *stats, double pf)
 {
+  ShareArenaReset(&(param->arena));
 
+  population->generation++;
   ESSRSort(population->f, population->phi, pf, param->eslambda,   \
-           param->eslambda, population->index);
-  ESSortPopulation(population, param);
+           param->eslambda, population->index, population->generation,   \
+           &(param->arena));
 
   ESSelectPopulation(population, param);
 
@@ -556,33 +671,98 @@ void ESStep(ESPopulation *population, ESParameter *param,   \
 /*********************************************************************
  ** sort population based on Index by ESSRSort                      **
  ** ESSortPopulation(population, param)                             **
+ ** rows are gathered in ranked order into the back buffer, which   **
+ ** then becomes the population                                     **
  *********************************************************************/
 void ESSortPopulation(ESPopulation *population, ESParameter *param)
+{
+  ESGatherPopulation(population, param, population->index);
+
+  return;
+}
+
+/*********************************************************************
+ ** gather rows into the back buffer and swap the buffers           **
+ ** ESGatherPopulation(population, param, source)                   **
+ ** row i <- row source[i], each row copied once                    **
+ ** -> parent[i] = source[i], the row i came from, now in the back  **
+ **    buffer                                                       **
+ ** -> index: 0->eslambda-1                                         **
+ *********************************************************************/
+void ESGatherPopulation(ESPopulation *population, ESParameter *param,   \
+                        int *source)
 {
   int i;
-  int eslambda;
-  int *index;
-  ESIndividual **oldmember, **newmember;
+  int eslambda, stride, constraint;
+  double *tmp;
 
   eslambda = param->eslambda;
-  oldmember = population->member;
-  index = population->index;
-  newmember = NULL;
-  newmember = (ESIndividual **)ShareMallocM1c(eslambda*sizeof(ESIndividual *));
+  constraint = param->constraint;
+  stride = population->stride;
 
   for(i=0; i<eslambda; i++)
-    newmember[i] = oldmember[index[i]];
-
+  {
+    memcpy(population->backop + i*stride, ESRowOp(population, source[i]),   \
+           stride*sizeof(double));
+    memcpy(population->backsp + i*stride, ESRowSp(population, source[i]),   \
+           stride*sizeof(double));
+    memcpy(population->backg + i*constraint,   \
+           ESRowG(population, source[i], param), constraint*sizeof(double));
+    population->backf[i] = population->f[source[i]];
+    population->backphi[i] = population->phi[source[i]];
+  }
   for(i=0; i<eslambda; i++)
   {
-    oldmember[i] = newmember[i];
-    population->f[i] = newmember[i]->f;
-    population->phi[i] = newmember[i]->phi;
-    index[i] = i;
+    population->parent[i] = source[i];
+    population->index[i] = i;
   }
 
-  ShareFreeM1c((char *)newmember);
-  newmember = NULL;
+  tmp = population->op;
+  population->op = population->backop;
+  population->backop = tmp;
+  tmp = population->sp;
+  population->sp = population->backsp;
+  population->backsp = tmp;
+  tmp = population->g;
+  population->g = population->backg;
+  population->backg = tmp;
+  tmp = population->f;
+  population->f = population->backf;
+  population->backf = tmp;
+  tmp = population->phi;
+  population->phi = population->backphi;
+  population->backphi = tmp;
+  ESPointMembers(population, param);
+
+  return;
+}
+
+/*********************************************************************
+ ** point each member at its row of the population                  **
+ ** ESPointMembers(population, param)                               **
+ ** member[i] -> rows[i] -> op/sp/g row i, f[i], phi[i]             **
+ *********************************************************************/
+void ESPointMembers(ESPopulation *population, ESParameter *param)
+{
+  int i;
+  int eslambda;
+  ESIndividual *indvdl;
+
+  eslambda = param->eslambda;
+
+  for(i=0; i<eslambda; i++)
+  {
+    indvdl = &(population->rows[i]);
+    indvdl->op = ESRowOp(population, i);
+    indvdl->sp = ESRowSp(population, i);
+    if(param->constraint > 0)
+      indvdl->g = ESRowG(population, i, param);
+    else
+      indvdl->g = NULL;
+    indvdl->f = population->f[i];
+    indvdl->phi = population->phi[i];
+    population->member[i] = indvdl;
+  }
 
   return;
 }
@@ -592,32 +772,36 @@ void ESSortPopulation(ESPopulation *population, ESParameter *param)
  ** ESSelectPopulation(population, param)                           **
  ** select first miu offsprings to fill up the next generation      **
  ** miu -> lambda : 1..miu,1..miu,..,lambda                         **
+ ** the offsprings are ranked by index and gathered straight from   **
+ ** their parents' rows into the next buffer                        **
  *********************************************************************/
 void ESSelectPopulation(ESPopulation *population, ESParameter *param)
 {
   int i,j;
   int miu, lambda, eslambda;
+  int *index, *parent;
 
   miu = param->miu;
   lambda = param->lambda;
   eslambda = param->eslambda;
+  index = population->index;
+  parent = population->parent;
 
+  for(i=0; i<miu && i<lambda; i++)
+    parent[i] = index[i];
   for(i=miu,j=0; i<lambda; i++,j++)
   {
     if(j==miu)
       j = 0;
-    ESCopyIndividual(population->member[j], population->member[i], param);
-    population->f[i] = population->member[j]->f;
-    population->phi[i] = population->member[j]->phi;
+    parent[i] = index[j];
   }
   for(i=lambda, j=0; i<eslambda; i++,j++)
   {
     if(j==miu)
       j = 0;
-    ESCopyIndividual(population->member[j], population->member[i], param);
-    population->f[i] = population->member[j]->f;
-    population->phi[i] = population->member[j]->phi;
+    parent[i] = index[j];
   }
+  ESGatherPopulation(population, param, parent);
 
   return;
 }
@@ -626,8 +810,8 @@ void ESSelectPopulation(ESPopulation *population, ESParameter *param)
  ** mutate                                                          **
  ** ESMutate(population, param)                                     **
  **                                                                 **
- ** sp_ : copy of sp                                                **
- ** op_ : copy of op                                                **
+ ** sp_ : sp before mutation, the parent's row in the back buffer   **
+ ** op_ : op before mutation, the parent's row in the back buffer   **
  ** update sp                                                       **
  ** traditional technique using exponential smoothing               **
  ** sp(1->miu-1) : unchanged                                        **
@@ -646,130 +830,97 @@ void ESSelectPopulation(ESPopulation *population, ESParameter *param)
  ** exponential smoothing                                           **
  ** sp(miu->lambda): sp = sp_ + alpha * (sp - sp_)                  **
  ** 
+ ** the normal random numbers are drawn for every row first, each   **
+ ** from the row's own streams of this generation, then each row is **
+ ** mutated by param->mutaterow or param->differrow, and its out of **
+ ** bound op retried                                                **
  ** re-calculate f/g/phi                                            **
  *********************************************************************/
 void ESMutate(ESPopulation * population, ESParameter *param)
 {
   int i, j, k;
-  int miu, dim,lambda, constraint;
-  double gamma, alpha;
-  double tau, tau_;
+  int miu, dim,lambda;
   int retry;
-  double randscalar;
-  double *randvec;
-  double *spb, *ub, *lb;
-  ESIndividual *indvdl;
-  double **sp_, **op_;
+  double *ub, *lb;
+  int stride, gen;
+  double *op, *sp, *step, *jump;
+  double *sp_, *op_, *best_;
+  double *backop, *backsp;
+  int *parent;
   double tmp;
-  ESfcnFG fg;
-  
-  randvec = NULL;
-  sp_ = NULL;
-  op_ = NULL;
 
   miu = param->miu;
   lambda = param->lambda;
-  constraint = param->constraint;
-  gamma = param->gamma;
-  alpha = param->alpha;
-  tau = param->tau;
-  tau_ = param->tau_;
   retry = param->retry;
-  spb = param->spb;
   ub = param->ub;
   lb = param->lb;
   dim = param->dim;
-  fg = param->fg;
-  randvec = ShareMallocM1d(dim);
-  sp_ = ShareMallocM2d(lambda, dim);
-  op_ = ShareMallocM2d(lambda, dim);
+  stride = population->stride;
+  gen = population->generation;
+  backop = population->backop;
+  backsp = population->backsp;
+  parent = population->parent;
+  step = population->step;
 
-  for(i=0; i<lambda; i++)
+  for(i=miu-1; i<lambda; i++)
   {
-    indvdl = population->member[i];
-    for(j=0; j<dim; j++)
-    {
-      sp_[i][j] = indvdl->sp[j];
-      op_[i][j] = indvdl->op[j];
-    }
+    population->randscalar[i] = ShareNormalRand(0, 1, gen, i, 0,   \
+                                                esDefStreamScalar);
+    ShareNormalRandVec(population->randsp + i*stride, dim, 0, 1,   \
+                       gen, i, esDefStreamSp);
+    ShareNormalRandVec(population->randop + i*stride, dim, 0, 1,   \
+                       gen, i, esDefStreamOp);
   }
 
-  for(i=miu-1; i<lambda; i++)
+  best_ = backop + parent[0]*stride;
+  for(i=0; i<lambda; i++)
   {
-    randscalar = ShareNormalRand(0,1);
-    ShareNormalRandVec(randvec, dim, 0, 1);
-    indvdl = population->member[i];
-    for(j=0; j<dim; j++)
+    op = ESRowOp(population, i);
+    sp = ESRowSp(population, i);
+    op_ = backop + parent[i]*stride;
+    sp_ = backsp + parent[i]*stride;
+    if(i < miu-1)
     {
-      tmp = indvdl->sp[j] *exp(tau_ *randscalar +tau*randvec[j]);
-      if( tmp > spb[j] )
-        tmp = spb[j];
-      indvdl->sp[j] = tmp;
+      k = param->differrow(op, best_, backop + parent[i+1]*stride, param);
+      jump = sp;
     }
-  }
-
-  for(i=0; i<miu-1; i++)
-  {
-    indvdl = population->member[i];
-    for(j=0; j<dim; j++)
-      indvdl->op[j] = indvdl->op[j] + gamma*(op_[0][j] - op_[i+1][j]);
-  }
-  for(i=miu-1; i<lambda; i++)
-  {
-    indvdl = population->member[i];
-    for(j=0; j<dim; j++)
-      indvdl->op[j] = indvdl->op[j] + indvdl->sp[j] * ShareNormalRand(0, 1);
-  }
+    else
+    {
+      k = param->mutaterow(op, sp, step, op_, sp_,   \
+                           population->randscalar[i],   \
+                           population->randsp + i*stride,   \
+                           population->randop + i*stride, param);
+      jump = step;
+    }
+    if(k == 0)
+      continue;
 
-  for(i=0; i<lambda; i++)
-  {
-    indvdl = population->member[i];
     for(j=0; j<dim; j++)
     {
-      tmp = indvdl->op[j];
+      tmp = op[j];
       if(tmp > ub[j] || tmp < lb[j])
       {
         for(k=0; k<retry; k++)
         {
-          tmp = op_[i][j] + indvdl->sp[j]*ShareNormalRand(0,1);
+          tmp = op_[j] + jump[j]*ShareNormalRand(0, 1, gen, i, j,   \
+                                      esDefStreamRetry + (k << 8));
           if(!(tmp > ub[j] || tmp < lb[j]))
             break;
         }
         if(k >= retry)
-          tmp = op_[i][j];
-        indvdl->op[j] = tmp;
+          tmp = op_[j];
+        op[j] = tmp;
       }
     }
   }
 
-  for(i=miu-1; i<lambda; i++)
-  {
-    indvdl = population->member[i];
-    for(j=0; j<dim; j++)
-      indvdl->sp[j] = sp_[i][j] + alpha *(indvdl->sp[j] - sp_[i][j]);
-  }
-
+  ESEvaluate(population->member, lambda, param);
   for(i=0; i<lambda; i++)
   {
-    indvdl = population->member[i];
-    fg(indvdl->op, &(indvdl->f), indvdl->g);
-    indvdl->phi = 0.0;
-    for(j=0; j<constraint; j++)
-    {
-      if(indvdl->g[j] > 0.0)
-        indvdl->phi += (indvdl->g[j] * indvdl->g[j]);
-    }
-    population->f[i] = indvdl->f;
-    population->phi[i] = indvdl->phi;
+    population->f[i] = population->member[i]->f;
+    population->phi[i] = population->member[i]->phi;
   }
 
-  ShareFreeM1d(randvec);
-  randvec = NULL;
-  ShareFreeM2d(sp_, lambda);
-  sp_ = NULL;
-  ShareFreeM2d(op_, lambda);
-  op_ = NULL;
-
   return;
 }
 
@@ -26,17 +26,71 @@
  **   http://cerium.raunvis.hi.is/~tpr/software/sres/               **
  *********************************************************************/
 
+#include <string.h>
+#include <pthread.h>
 #include "sharefunc.hpp"
 #include "ESSRSort.hpp"
 
+#include "../source/memory.hpp"
+
+/*********************************************************************
+ ** number of threads the odd-even ranking may use                  **
+ *********************************************************************/
+int essrThreads = 1;
+
+/*********************************************************************
+ ** compare I(j) and I(j+1) with the random value u, swap them if   **
+ ** they are out of order                                           **
+ ** ESSRCompare(f, phi, pf, u, I, j)                                **
+ ** return: 1 if they were swapped, else 0                          **
+ *********************************************************************/
+static inline int
+ESSRCompare(double *f, double *phi, double pf, double u, int *I, int j)
+{
+  int tmp;
+
 /*********************************************************************
- ** void ESSRSort(f,phi,pf,eslambda,N,I)                            **
+ ** it's difficult to test if a double value is zero or not         **
+ ** for example, a variable 'x',                                    **
+ ** if 'x < double precision', then 'x==0' is true                  **
+ *********************************************************************/
+  if( (ShareIsZero(phi[I[j]]-phi[I[j+1]]) ==shareDefTrue  \
+                 && ShareIsZero(phi[I[j]])==shareDefTrue)  \
+      || u < pf )
+  {
+    if( f[I[j]] > f[I[j+1]] )
+    {
+      tmp = I[j];
+      I[j] = I[j+1];
+      I[j+1] = tmp;
+      return 1;
+    }
+  }
+  else
+  {
+    if( phi[I[j]] > phi[I[j+1]]  )
+    {
+      tmp = I[j];
+      I[j] = I[j+1];
+      I[j+1] = tmp;
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/*********************************************************************
+ ** void ESSRSort(f,phi,pf,eslambda,N,I,gen,arena)                  **
  ** f[eslambda]: fitness                                            **
  ** phi[eslambda]: constraints                                      **
  ** pf: stochastic ranking, in (0,1), generally pf<0.5, pf=0.45     **
  ** eslambda: population size -- offspring or parent+offspring      **
  ** N: usually N=eslambda                                           **
  ** I[eslambda]: sort index                                         **
+ ** gen: generation, u of sweep i and pair j is the draw            **
+ **      (gen, i, j, essrDefStream)                                 **
+ ** arena: where the ranking's temporaries come from                **
  **                                                                 **
  ** for i=1 to N do                                                 **
  **   for j=1 to eslambda-1 do                                      **
@@ -49,54 +103,385 @@
  **         swap( I(j), I(j+1) )                                    **
  **   if(numberOFswap == 0)                                         **
  **     break                                                       **
+ **                                                                 **
+ ** if every phi is 0, every comparison is on f and the passes      **
+ ** above are a stable sort on f, so ESSRSortFeasible does it       **
+ ** if eslambda >= essrDefParallelMin, ESSRSortOddEven gives the    **
+ ** same ranking on essrThreads threads                             **
  *********************************************************************/
 
 void
-ESSRSort(double *f, double *phi, double pf, int eslambda, int N, int *I)
+ESSRSort(double *f, double *phi, double pf, int eslambda, int N, int *I,   \
+         int gen, ShareArena *arena)
 {
   int i, j;
   double u;
   int nSwap;
-  int tmp;
+
+  for(i=0; i<eslambda; i++)
+    if(phi[i] != 0)
+      break;
+  if(i == eslambda)
+  {
+    ESSRSortFeasible(f, eslambda, I, arena);
+    return;
+  }
+
+  if(eslambda >= essrDefParallelMin)
+  {
+    ESSRSortOddEven(f, phi, pf, eslambda, N, I, gen, essrThreads, arena);
+    return;
+  }
 
   for(i=0; i<N; i++)
   {
     nSwap = 0;
     for(j=0; j<eslambda-1; j++)
     {
-      u = ShareRand(0,1);
+      u = ShareRand(0, 1, gen, i, j, essrDefStream);
+      nSwap += ESSRCompare(f, phi, pf, u, I, j);
+    }
+    if(nSwap <=0)
+      break;
+  }
+
+  return;
+}
+
 /*********************************************************************
- ** it's difficult to test if a double value is zero or not         **
- ** for example, a variable 'x',                                    **
- ** if 'x < double precision', then 'x==0' is true                  **
+ ** void ESSRSortFeasible(f,eslambda,I,arena)                       **
+ ** stable bottom-up merge sort of I on f, O(eslambda*log(eslambda))**
+ ** a run's later element is only taken first if it is strictly     **
+ ** better, the same tie order the bubble passes give               **
  *********************************************************************/
-      if( (ShareIsZero(phi[I[j]]-phi[I[j+1]]) ==shareDefTrue  \
-                     && ShareIsZero(phi[I[j]])==shareDefTrue)  \
-          || u < pf )
-      {
-        if( f[I[j]] > f[I[j+1]] )
-        {
-          tmp = I[j];
-          I[j] = I[j+1];
-          I[j+1] = tmp;
-          nSwap++;
-        }
-      }
-      else
+void ESSRSortFeasible(double *f, int eslambda, int *I, ShareArena *arena)
+{
+  int width, lo, mid, hi;
+  int a, b, k;
+  int *from, *to, *tmp;
+
+  from = I;
+  to = ShareArenaMallocM1i(arena, eslambda);
+  for(width=1; width<eslambda; width*=2)
+  {
+    for(lo=0; lo<eslambda; lo+=2*width)
+    {
+      mid = lo + width < eslambda ? lo + width : eslambda;
+      hi = lo + 2*width < eslambda ? lo + 2*width : eslambda;
+      a = lo;
+      b = mid;
+      for(k=lo; k<hi; k++)
       {
-        if( phi[I[j]] > phi[I[j+1]]  )
-        {
-          tmp = I[j];
-          I[j] = I[j+1];
-          I[j+1] = tmp;
-          nSwap++;
-        }
+        if(a < mid && (b >= hi || !(f[from[a]] > f[from[b]])))
+          to[k] = from[a++];
+        else
+          to[k] = from[b++];
       }
     }
-    if(nSwap <=0)
+    tmp = from;
+    from = to;
+    to = tmp;
+  }
+
+  if(from != I)
+    memcpy(I, from, eslambda*sizeof(int));
+
+  return;
+}
+
+/*********************************************************************
+ ** state shared by the threads of one odd-even ranking             **
+ ** swaps[N]: swaps of each sweep                                   **
+ ** stop: the first sweep without swaps, -1 if there is none        **
+ ** arena: where swaps and the starting ranking come from          **
+ *********************************************************************/
+typedef struct ESSRShared
+  {
+    double *f, *phi;
+    double pf;
+    int eslambda, N;
+    int *I;
+    int gen;
+    int threads;
+    int *swaps;
+    int stop;
+    ShareArena *arena;
+    pthread_barrier_t barrier;
+  } ESSRShared;
+
+typedef struct ESSRWorker
+  {
+    ESSRShared *shared;
+    int t;
+  } ESSRWorker;
+
+/*********************************************************************
+ ** do the part of thread t of every step of the odd-even ranking,  **
+ ** the threads wait for each other after every step                **
+ ** ESSROddEvenThread(worker)                                       **
+ ** at step k, sweep s compares pair j = k - 2*s; a sweep finishes  **
+ ** at step eslambda-2 + 2*s, and every thread sees the same swaps  **
+ ** after the barrier, so they all stop at the same step; the last  **
+ ** sweep has none after it, so it never stops the ranking          **
+ *********************************************************************/
+static void *ESSROddEvenThread(void *arg)
+{
+  ESSRWorker *worker;
+  ESSRShared *sh;
+  int t, k, last, lo, hi, first, end, s, j;
+
+  worker = (ESSRWorker *)arg;
+  sh = worker->shared;
+  t = worker->t;
+
+  last = sh->eslambda - 2 + 2*(sh->N - 1);
+  for(k=0; k<=last; k++)
+  {
+    lo = k > sh->eslambda - 2 ? (k - (sh->eslambda - 2) + 1)/2 : 0;
+    hi = k/2 < sh->N - 1 ? k/2 : sh->N - 1;
+    first = lo + (hi - lo + 1)*t/sh->threads;
+    end = lo + (hi - lo + 1)*(t + 1)/sh->threads;
+    for(s=first; s<end; s++)
+    {
+      j = k - 2*s;
+      sh->swaps[s] += ESSRCompare(sh->f, sh->phi, sh->pf,   \
+                        ShareRand(0, 1, sh->gen, s, j, essrDefStream),   \
+                        sh->I, j);
+    }
+    if(sh->threads > 1)
+      pthread_barrier_wait(&sh->barrier);
+
+    s = k - (sh->eslambda - 2);
+    if(s >= 0 && s%2 == 0 && s/2 < sh->N - 1 && sh->swaps[s/2] <= 0)
+    {
+      if(t == 0)
+        sh->stop = s/2;
+      break;
+    }
+  }
+
+  return NULL;
+}
+
+/*********************************************************************
+ ** the helper threads of the odd-even ranking, started by the      **
+ ** first ranking that needs them and kept for the later ones       **
+ ** size: threads that can take part, the caller and its helpers    **
+ ** threads: threads that take part in the current ranking          **
+ ** round: counts the rankings handed to the helpers                **
+ ** pending: helpers still busy with the current ranking            **
+ ** quit: set by ESSRTeamFree to end the helpers                    **
+ *********************************************************************/
+typedef struct ESSRTeam
+  {
+    int size;
+    pthread_t *tids;
+    ESSRWorker *workers;
+    ESSRShared *shared;
+    int threads;
+    unsigned int round;
+    int pending;
+    int quit;
+    pthread_mutex_t lock;
+    pthread_cond_t ready, done;
+  } ESSRTeam;
+
+static ESSRTeam essrTeam = {1, NULL, NULL, NULL, 1, 0, 0, 0,   \
+                            PTHREAD_MUTEX_INITIALIZER,   \
+                            PTHREAD_COND_INITIALIZER,   \
+                            PTHREAD_COND_INITIALIZER};
+
+/*********************************************************************
+ ** wait for each ranking and do its part of helper t, helpers      **
+ ** numbered past the ranking's threads sit it out without looking  **
+ ** at its state, which the caller does not wait for them to leave  **
+ ** ESSRTeamThread(worker)                                          **
+ *********************************************************************/
+static void *ESSRTeamThread(void *arg)
+{
+  ESSRWorker *worker;
+  unsigned int seen;
+  int take_part;
+
+  worker = (ESSRWorker *)arg;
+  seen = 0;
+  for(;;)
+  {
+    pthread_mutex_lock(&essrTeam.lock);
+    while(essrTeam.round == seen && !essrTeam.quit)
+      pthread_cond_wait(&essrTeam.ready, &essrTeam.lock);
+    if(essrTeam.quit)
+    {
+      pthread_mutex_unlock(&essrTeam.lock);
+      break;
+    }
+    seen = essrTeam.round;
+    take_part = worker->t < essrTeam.threads;
+    worker->shared = essrTeam.shared;
+    pthread_mutex_unlock(&essrTeam.lock);
+
+    if(!take_part)
+      continue;
+    ESSROddEvenThread(worker);
+
+    pthread_mutex_lock(&essrTeam.lock);
+    if(--essrTeam.pending == 0)
+      pthread_cond_signal(&essrTeam.done);
+    pthread_mutex_unlock(&essrTeam.lock);
+  }
+
+  return NULL;
+}
+
+/*********************************************************************
+ ** make sure the team has threads threads if it can                **
+ ** ESSRTeamStart(threads)                                          **
+ ** return: the number of threads the team has, at least 1; if a    **
+ **         helper cannot be started the team keeps the ones that   **
+ **         were, and a team of 1 ranks on the caller alone         **
+ *********************************************************************/
+static int ESSRTeamStart(int threads)
+{
+  int t;
+
+  if(threads <= essrTeam.size || essrTeam.tids != NULL)
+    return threads < essrTeam.size ? threads : essrTeam.size;
+
+  essrTeam.tids = (pthread_t *)ShareMallocM1c(threads*sizeof(pthread_t));
+  essrTeam.workers = (ESSRWorker *)ShareMallocM1c(   \
+                       threads*sizeof(ESSRWorker));
+  for(t=1; t<threads; t++)
+  {
+    essrTeam.workers[t].t = t;
+    if(pthread_create(&essrTeam.tids[t], NULL, ESSRTeamThread,   \
+                      &essrTeam.workers[t]) != 0)
       break;
   }
+  essrTeam.size = t;
+
+  return essrTeam.size;
+}
+
+/*********************************************************************
+ ** end the helper threads and free the team                        **
+ ** ESSRTeamFree()                                                  **
+ *********************************************************************/
+void ESSRTeamFree()
+{
+  int t;
+
+  if(essrTeam.tids == NULL)
+    return;
+
+  pthread_mutex_lock(&essrTeam.lock);
+  essrTeam.quit = 1;
+  pthread_cond_broadcast(&essrTeam.ready);
+  pthread_mutex_unlock(&essrTeam.lock);
+  for(t=1; t<essrTeam.size; t++)
+    pthread_join(essrTeam.tids[t], NULL);
+
+  ShareFreeM1c((char *)essrTeam.tids);
+  ShareFreeM1c((char *)essrTeam.workers);
+  essrTeam.tids = NULL;
+  essrTeam.workers = NULL;
+  essrTeam.size = 1;
+  essrTeam.quit = 0;
 
   return;
 }
 
+/*********************************************************************
+ ** run one odd-even ranking on the caller and the team's helpers   **
+ ** ESSROddEvenRun(shared)                                          **
+ *********************************************************************/
+static void ESSROddEvenRun(ESSRShared *shared)
+{
+  ESSRWorker caller;
+
+  memset(shared->swaps, 0, shared->N*sizeof(int));
+  shared->stop = -1;
+  caller.shared = shared;
+  caller.t = 0;
+
+  if(shared->threads == 1)
+  {
+    ESSROddEvenThread(&caller);
+    return;
+  }
+
+  pthread_mutex_lock(&essrTeam.lock);
+  essrTeam.shared = shared;
+  essrTeam.threads = shared->threads;
+  essrTeam.pending = shared->threads - 1;
+  essrTeam.round++;
+  pthread_cond_broadcast(&essrTeam.ready);
+  pthread_mutex_unlock(&essrTeam.lock);
+
+  ESSROddEvenThread(&caller);
+
+  pthread_mutex_lock(&essrTeam.lock);
+  while(essrTeam.pending > 0)
+    pthread_cond_wait(&essrTeam.done, &essrTeam.lock);
+  pthread_mutex_unlock(&essrTeam.lock);
+
+  return;
+}
+
+/*********************************************************************
+ ** void ESSRSortOddEven(f,phi,pf,eslambda,N,I,gen,threads,arena)   **
+ ** the sweeps of ESSRSort, pipelined                               **
+ ** at step k, sweep s compares pair (j,j+1), j = k - 2*s, as in    **
+ ** ESSRSort; sweep s+1 is two pairs behind sweep s, so the pairs   **
+ ** of a step are disjoint and all odd or all even, and every pair  **
+ ** sees the same comparisons in the same order as in ESSRSort      **
+ ** u of sweep s and pair j is the same draw as in ESSRSort, so the **
+ ** ranking is the one ESSRSort gives, for any number of threads    **
+ ** the sweeps after the first one without swaps have already       **
+ ** started when it finishes, so the ranking is done again from I   **
+ ** with only the sweeps before it                                  **
+ ** the threads are the caller and the helpers of ESSRTeamStart,    **
+ ** fewer than asked for if some could not be started               **
+ *********************************************************************/
+void ESSRSortOddEven(double *f, double *phi, double pf, int eslambda,   \
+                     int N, int *I, int gen, int threads, ShareArena *arena)
+{
+  ESSRShared shared;
+  int *start;
+
+  if(eslambda < 2 || N < 1)
+    return;
+  if(threads > eslambda/2)
+    threads = eslambda/2;
+  if(threads < 1)
+    threads = 1;
+  threads = ESSRTeamStart(threads);
+
+  shared.f = f;
+  shared.phi = phi;
+  shared.pf = pf;
+  shared.eslambda = eslambda;
+  shared.N = N;
+  shared.I = I;
+  shared.gen = gen;
+  shared.threads = threads;
+  shared.arena = arena;
+  shared.swaps = ShareArenaMallocM1i(arena, N);
+  if(threads > 1)
+    pthread_barrier_init(&shared.barrier, NULL, threads);
+  start = ShareArenaMallocM1i(arena, eslambda);
+  memcpy(start, I, eslambda*sizeof(int));
+
+  ESSROddEvenRun(&shared);
+  if(shared.stop >= 0)
+  {
+    memcpy(I, start, eslambda*sizeof(int));
+    shared.N = shared.stop;
+    if(shared.N > 0)
+      ESSROddEvenRun(&shared);
+  }
+
+  if(threads > 1)
+    pthread_barrier_destroy(&shared.barrier);
+
+  return;
+}
@@ -29,17 +29,35 @@
 #ifndef ESSRSORT_HPP
 #define ESSRSORT_HPP
 
+#include "sharefunc.hpp"
+
 #define essrDefPf 0.45
+#define essrDefParallelMin 1024
+
+/*********************************************************************
+ ** random stream of the ranking's draws, apart from the ES streams **
+ ** esDefStream* of ESES.hpp                                        **
+ *********************************************************************/
+#define essrDefStream 16
+
+/*********************************************************************
+ ** number of threads the odd-even ranking may use, 1 by default    **
+ *********************************************************************/
+extern int essrThreads;
 
 /*********************************************************************
  ** Stochastic Bubble Sort                                          **
- ** void ESSRSort(f,phi,pf,eslambda,N,I)                            **
+ ** void ESSRSort(f,phi,pf,eslambda,N,I,gen,arena)                  **
  ** f[eslambda]: fitness                                            **
  ** phi[eslambda]: constraints                                      **
  ** pf: stochastic ranking, in (0,1), generally pf<0.5, pf=0.45     **
  ** eslambda: population size -- offspring or parent+offspring      **
  ** N: usually N=eslambda                                           **
  ** I[eslambda]: sort index                                         **
+ ** gen: generation, u of sweep i and pair j is the draw            **
+ **      (gen, i, j, essrDefStream)                                 **
+ ** arena: where the ranking's temporaries come from, the caller    **
+ **        resets it                                                **
  **                                                                 **
  ** for i=1 to N do                                                 **
  **   for j=1 to eslambda-1 do                                      **
@@ -53,7 +71,37 @@
  **   if(numberOFswap == 0)                                         **
  **     break                                                       **
  *********************************************************************/
-void ESSRSort(double *, double *, double , int , int , int *);
+void ESSRSort(double *, double *, double , int , int , int *, int,   \
+              ShareArena *);
 
-#endif
+/*********************************************************************
+ ** all-feasible ranking                                            **
+ ** void ESSRSortFeasible(f,eslambda,I,arena)                       **
+ ** stable sort of I on f, what ESSRSort gives when every phi is 0, **
+ ** in O(eslambda*log(eslambda)) and without drawing any u          **
+ *********************************************************************/
+void ESSRSortFeasible(double *, int , int *, ShareArena *);
+
+/*********************************************************************
+ ** parallel stochastic ranking                                     **
+ ** void ESSRSortOddEven(f,phi,pf,eslambda,N,I,gen,threads,arena)   **
+ ** the sweeps of ESSRSort pipelined as an odd-even transposition:  **
+ ** at step k sweep s compares pair (j,j+1), j = k - 2*s, so a      **
+ ** step's pairs are disjoint and split between threads             **
+ ** every pair is compared in the same order and with the same u as **
+ ** in ESSRSort, so the ranking is the one ESSRSort gives, for any  **
+ ** number of threads                                               **
+ ** ESSRSort uses it if eslambda >= essrDefParallelMin              **
+ ** the threads are started by the first ranking that needs them    **
+ ** and kept until ESSRTeamFree                                     **
+ *********************************************************************/
+void ESSRSortOddEven(double *, double *, double , int , int , int *, int,   \
+                     int, ShareArena *);
 
+/*********************************************************************
+ ** void ESSRTeamFree()                                             **
+ ** end the threads ESSRSortOddEven keeps between rankings          **
+ *********************************************************************/
+void ESSRTeamFree();
+
+#endif
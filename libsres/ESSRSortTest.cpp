@@ -0,0 +1,319 @@
+/*********************************************************************
+ ** Stochastic Ranking Evolution Strategy                           **
+ ** statistical equivalence test of the stochastic ranking          **
+ **                                                                 **
+ ** For ACADEMIC RESEARCH, this is licensed with GPL license        **
+ ** For COMMERCIAL ACTIVITIES, please contact the authors           **
+ **                                                                 **
+ ** This program is distributed in the hope that it will be useful, **
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of  **
+ ** MERCHANTABILITY of FITNESS FOR A PARTICULAR PURPOSE. See the    **
+ ** GNU General Public License for more details.                    **
+ **                                                                 **
+ ** build: scons test=1, or                                         **
+ **   g++ -O2 -pthread -D MEMPOOL libsres/ESSRSortTest.cpp          **
+ **       libsres/ESSRSort.cpp libsres/sharefunc.cpp                **
+ **       source/memory.cpp -o essrsort-test                        **
+ ** run: ./essrsort-test [trials], exits with 0 if every case       **
+ **      passes                                                     **
+ *********************************************************************/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sharefunc.hpp"
+#include "ESSRSort.hpp"
+
+#include "../source/structs.hpp"
+
+terminal* term = NULL;
+
+/*********************************************************************
+ ** rank bins of the rank histograms, and the significance level    **
+ ** each case is tested at before the Bonferroni correction         **
+ *********************************************************************/
+#define essrTestBins 8
+#define essrTestAlpha 0.001
+
+/*********************************************************************
+ ** the stochastic bubble sort as it was before the Philox streams, **
+ ** drawing u of every comparison from erand48 in sweep order       **
+ ** ESSRTestBaseline(f,phi,pf,eslambda,N,I,xsubi)                   **
+ *********************************************************************/
+static void ESSRTestBaseline(double *f, double *phi, double pf,   \
+                             int eslambda, int N, int *I,   \
+                             unsigned short xsubi[3])
+{
+  int i, j, tmp;
+  double u;
+  int nSwap;
+
+  for(i=0; i<N; i++)
+  {
+    nSwap = 0;
+    for(j=0; j<eslambda-1; j++)
+    {
+      u = erand48(xsubi);
+      if( (ShareIsZero(phi[I[j]]-phi[I[j+1]]) ==shareDefTrue  \
+                     && ShareIsZero(phi[I[j]])==shareDefTrue)  \
+          || u < pf )
+      {
+        if( f[I[j]] > f[I[j+1]] )
+        {
+          tmp = I[j];
+          I[j] = I[j+1];
+          I[j+1] = tmp;
+          nSwap++;
+        }
+      }
+      else
+      {
+        if( phi[I[j]] > phi[I[j+1]]  )
+        {
+          tmp = I[j];
+          I[j] = I[j+1];
+          I[j+1] = tmp;
+          nSwap++;
+        }
+      }
+    }
+    if(nSwap <=0)
+      break;
+  }
+
+  return;
+}
+
+/*********************************************************************
+ ** count which rank bin every individual ends up in over trials    **
+ ** rankings, with ESSRSort if baseline is 0, else the baseline     **
+ ** ESSRTestHistogram(f,phi,eslambda,trials,baseline,pfrank,counts, **
+ **                   arena)                                        **
+ ** pfrank: pf the rankings use                                     **
+ ** counts[eslambda*essrTestBins]: the histograms, filled in        **
+ *********************************************************************/
+static void ESSRTestHistogram(double *f, double *phi, int eslambda,   \
+                              int trials, int baseline, double pfrank,   \
+                              long *counts, ShareArena *arena)
+{
+  int t, r;
+  int *I;
+  unsigned short xsubi[3];
+
+  I = ShareMallocM1i(eslambda);
+  memset(counts, 0, eslambda*essrTestBins*sizeof(long));
+  for(t=0; t<trials; t++)
+  {
+    for(r=0; r<eslambda; r++)
+      I[r] = r;
+    if(baseline)
+    {
+      xsubi[0] = 0x330e;
+      xsubi[1] = (unsigned short)t;
+      xsubi[2] = (unsigned short)(t >> 16);
+      ESSRTestBaseline(f, phi, pfrank, eslambda, eslambda, I, xsubi);
+    }
+    else
+    {
+      ShareArenaReset(arena);
+      ESSRSort(f, phi, pfrank, eslambda, eslambda, I, t, arena);
+    }
+    for(r=0; r<eslambda; r++)
+      counts[I[r]*essrTestBins + r*essrTestBins/eslambda]++;
+  }
+  ShareFreeM1i(I);
+
+  return;
+}
+
+/*********************************************************************
+ ** chi-square test of homogeneity of every individual's two rank   **
+ ** histograms, Bonferroni corrected over the individuals           **
+ ** ESSRTestCompare(a,b,eslambda,zmax)                              **
+ ** zmax: the largest statistic, as a standard normal deviate by    **
+ **       the Wilson-Hilferty transform                             **
+ ** return: the smallest p-value times eslambda                     **
+ *********************************************************************/
+static double ESSRTestCompare(long *a, long *b, int eslambda, double *zmax)
+{
+  int i, k, df;
+  long na, nb;
+  double x, e, z, p, pmin;
+
+  pmin = 1;
+  *zmax = -1e9;
+  for(i=0; i<eslambda; i++)
+  {
+    na = nb = 0;
+    df = -1;
+    for(k=0; k<essrTestBins; k++)
+    {
+      na += a[i*essrTestBins + k];
+      nb += b[i*essrTestBins + k];
+      if(a[i*essrTestBins + k] + b[i*essrTestBins + k] > 0)
+        df++;
+    }
+    if(df < 1)
+      continue;
+    x = 0;
+    for(k=0; k<essrTestBins; k++)
+    {
+      if(a[i*essrTestBins + k] + b[i*essrTestBins + k] == 0)
+        continue;
+      e = (double)(a[i*essrTestBins + k] + b[i*essrTestBins + k])   \
+          *na/(na + nb);
+      x += (a[i*essrTestBins + k] - e)*(a[i*essrTestBins + k] - e)/e;
+      e = (double)(a[i*essrTestBins + k] + b[i*essrTestBins + k])   \
+          *nb/(na + nb);
+      x += (b[i*essrTestBins + k] - e)*(b[i*essrTestBins + k] - e)/e;
+    }
+    z = (pow(x/df, 1.0/3) - (1 - 2.0/(9*df)))/sqrt(2.0/(9*df));
+    p = 0.5*erfc(z/sqrt(2.0));
+    if(z > *zmax)
+      *zmax = z;
+    if(p < pmin)
+      pmin = p;
+  }
+
+  return pmin*eslambda < 1 ? pmin*eslambda : 1;
+}
+
+/*********************************************************************
+ ** rank one population with ESSRSort and with the baseline and     **
+ ** compare them, then compare the baseline with itself at a lower  **
+ ** pf to show the test can tell rankings apart                     **
+ ** ESSRTestCase(name,eslambda,infeasible,trials,arena)             **
+ ** infeasible: share of individuals with a constraint violation    **
+ ** return: 1 if ESSRSort matches and the control does not, else 0  **
+ *********************************************************************/
+static int ESSRTestCase(const char *name, int eslambda, double infeasible,   \
+                        int trials, ShareArena *arena)
+{
+  double *f, *phi;
+  long *sorted, *baseline, *control;
+  double psame, pcontrol, zsame, zcontrol;
+  unsigned short xsubi[3] = {1, 2, 3};
+  int i, pass;
+
+  f = ShareMallocM1d(eslambda);
+  phi = ShareMallocM1d(eslambda);
+  sorted = (long *)ShareMallocM1c(eslambda*essrTestBins*sizeof(long));
+  baseline = (long *)ShareMallocM1c(eslambda*essrTestBins*sizeof(long));
+  control = (long *)ShareMallocM1c(eslambda*essrTestBins*sizeof(long));
+  for(i=0; i<eslambda; i++)
+  {
+    f[i] = erand48(xsubi);
+    phi[i] = erand48(xsubi) < infeasible ? erand48(xsubi) : 0;
+  }
+
+  ESSRTestHistogram(f, phi, eslambda, trials, 0, 0.45, sorted, arena);
+  ESSRTestHistogram(f, phi, eslambda, trials, 1, 0.45, baseline, arena);
+  ESSRTestHistogram(f, phi, eslambda, trials, 1, 0.40, control, arena);
+  psame = ESSRTestCompare(sorted, baseline, eslambda, &zsame);
+  pcontrol = ESSRTestCompare(control, baseline, eslambda, &zcontrol);
+  pass = psame >= essrTestAlpha && pcontrol < essrTestAlpha;
+
+  printf("%-28s lambda=%5d trials=%6d  ESSRSort vs baseline: "   \
+         "p=%.4f z=%6.2f  pf 0.40 control: p=%.2g z=%6.2f  %s\n",   \
+         name, eslambda, trials, psame, zsame, pcontrol, zcontrol,   \
+         pass ? "ok" : "FAILED");
+
+  ShareFreeM1d(f);
+  ShareFreeM1d(phi);
+  ShareFreeM1c((char *)sorted);
+  ShareFreeM1c((char *)baseline);
+  ShareFreeM1c((char *)control);
+
+  return pass;
+}
+
+/*********************************************************************
+ ** rank populations with every phi 0 with ESSRSort, i.e. with      **
+ ** ESSRSortFeasible, and with the baseline from the same shuffled  **
+ ** starting ranking, and check that both give the same ranking     **
+ ** f only takes a few values, so most individuals tie and the tie  **
+ ** order has to match too                                          **
+ ** ESSRTestFeasible(eslambda,trials,arena)                         **
+ ** return: 1 if every ranking matches exactly, else 0              **
+ *********************************************************************/
+static int ESSRTestFeasible(int eslambda, int trials, ShareArena *arena)
+{
+  double *f, *phi;
+  int *I, *J;
+  unsigned short xsubi[3] = {4, 5, 6};
+  int t, r, k, tmp, mismatches;
+
+  f = ShareMallocM1d(eslambda);
+  phi = ShareMallocM1d(eslambda);
+  I = ShareMallocM1i(eslambda);
+  J = ShareMallocM1i(eslambda);
+  mismatches = 0;
+  for(t=0; t<trials; t++)
+  {
+    for(r=0; r<eslambda; r++)
+    {
+      f[r] = (int)(erand48(xsubi)*8);
+      phi[r] = 0;
+      I[r] = r;
+    }
+    for(r=eslambda-1; r>0; r--)
+    {
+      k = (int)(erand48(xsubi)*(r + 1));
+      tmp = I[r];
+      I[r] = I[k];
+      I[k] = tmp;
+    }
+    memcpy(J, I, eslambda*sizeof(int));
+    ESSRTestBaseline(f, phi, 0.45, eslambda, eslambda, J, xsubi);
+    ShareArenaReset(arena);
+    ESSRSort(f, phi, 0.45, eslambda, eslambda, I, t, arena);
+    if(memcmp(I, J, eslambda*sizeof(int)) != 0)
+      mismatches++;
+  }
+
+  printf("%-28s lambda=%5d trials=%6d  rankings that differ from "   \
+         "the baseline: %d  %s\n", "all feasible", eslambda, trials,   \
+         mismatches, mismatches == 0 ? "ok" : "FAILED");
+
+  ShareFreeM1d(f);
+  ShareFreeM1d(phi);
+  ShareFreeM1i(I);
+  ShareFreeM1i(J);
+
+  return mismatches == 0;
+}
+
+int main(int argc, char **argv)
+{
+  ShareArena arena;
+  unsigned int seed;
+  int trials, pass;
+
+  trials = argc > 1 ? atoi(argv[1]) : 2000;
+  ShareSeed(7, &seed);
+  ShareArenaInit(&arena);
+
+  pass = 1;
+  pass &= ESSRTestCase("bubble passes", 60, 0.5, trials, &arena);
+  pass &= ESSRTestCase("bubble passes, mostly feasible", 60, 0.1,   \
+                       trials, &arena);
+  essrThreads = 1;
+  pass &= ESSRTestCase("odd-even, 1 thread", essrDefParallelMin, 0.5,   \
+                       trials/10, &arena);
+  essrThreads = 4;
+  pass &= ESSRTestCase("odd-even, 4 threads", essrDefParallelMin, 0.5,   \
+                       trials/10, &arena);
+  pass &= ESSRTestFeasible(1, 10, &arena);
+  pass &= ESSRTestFeasible(2, 100, &arena);
+  pass &= ESSRTestFeasible(7, 100, &arena);
+  pass &= ESSRTestFeasible(60, 100, &arena);
+  pass &= ESSRTestFeasible(333, 100, &arena);
+  pass &= ESSRTestFeasible(essrDefParallelMin, 20, &arena);
+  pass &= ESSRTestFeasible(essrDefParallelMin*2 + 3, 10, &arena);
+
+  ESSRTeamFree();
+  ShareArenaFree(&arena);
+
+  return pass ? 0 : 1;
+}
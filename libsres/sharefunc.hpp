@@ -25,6 +25,8 @@
 #ifndef SHAREFUNC_HPP
 #define SHAREFUNC_HPP
 
+#include <stddef.h>
+
 #define shareDefSeed 0
 #define shareDefTrue 1
 #define shareDefFalse 0
@@ -32,34 +34,54 @@
 #define shareDefMaxLine 4096
 #define shareDefNullYes 0
 #define shareDefNullNo 1
+#define shareDefAlign 64
+
+/*********************************************************************
+ ** counter-based random streams                                    **
+ ** every draw is Philox4x32-10 of its counter (dim, ind, gen,      **
+ ** stream) under the seed's key, so it depends only on what it is  **
+ ** drawn for, not on how many draws came before it or on which     **
+ ** thread or processor draws it                                    **
+ ** gen: generation, ind: individual, dim: dimension                **
+ ** stream: what the draw is for, so two uses never share draws     **
+ **                                                                 **
+ ** void SharePhilox(ctr, key, out)                                 **
+ ** out[4] = Philox4x32-10 of ctr[4] under key[2]                   **
+ *********************************************************************/
+void SharePhilox(const unsigned int *, const unsigned int *,   \
+                 unsigned int *);
 
 /*********************************************************************
  ** uniform random                                                  **
  ** to output a random value between min and max                    **
- ** double ShareRand(min,max)                                       **
+ ** double ShareRand(min,max,gen,ind,dim,stream)                    **
  ** min: min value                                                  **
  ** max: max value                                                  **
  **                                                                 **
- ** return value = min + (max-min)*rand()/(RAND_MAX)                **
+ ** return value = min + (max-min)*u, u in [0,1) with 53 bits       **
  **                                                                 **
- ** void ShareRandVec(s, n, min, max)                               **
- ** return s=vec(n)                                                 **
+ ** void ShareRandVec(s, n, min, max, gen, ind, stream)             **
+ ** return s=vec(n), s[dim] = ShareRand(min,max,gen,ind,dim,stream) **
  *********************************************************************/
-double ShareRand(double , double );
-void ShareRandVec(double *, int, double, double);
+double ShareRand(double , double , unsigned int, unsigned int,   \
+                 unsigned int, unsigned int);
+void ShareRandVec(double *, int, double, double, unsigned int,   \
+                  unsigned int, unsigned int);
 
 /*********************************************************************
  ** gaussian random: normal distribution                            **
  ** N(mean, dev)                                                    **
+ ** double ShareNormalRand(mean,dev,gen,ind,dim,stream)             **
+ ** Box-Muller of the two uniforms of the draw's block              **
  **                                                                 **
- ** void ShareNormalRandVec(s, n, mean, dev)                        **
- ** return s=vec(n)                                                 **
- **                                                                 **
- ** source code from                                                **
- **        http://remus.rutgers.edu/~rhoads/Code/code.html          **
+ ** void ShareNormalRandVec(s, n, mean, dev, gen, ind, stream)      **
+ ** return s=vec(n), s[2k] and s[2k+1] are the cos and sin values   **
+ ** of block dim = k, so a block gives two normals                  **
  *********************************************************************/
-double ShareNormalRand(double , double );
-void ShareNormalRandVec(double *, int, double, double);
+double ShareNormalRand(double , double , unsigned int, unsigned int,   \
+                       unsigned int, unsigned int);
+void ShareNormalRandVec(double *, int, double, double, unsigned int,   \
+                        unsigned int, unsigned int);
 
 /*********************************************************************
  ** to set random seed                                              **
@@ -67,6 +89,7 @@ void ShareNormalRandVec(double *, int, double, double);
  ** if inseed==0, then use pid*time as seed                         **
  ** if inseed!=0, use this seed users set                           **
  ** outseed is to be used in the next step                          **
+ ** the seed is the key of every random stream                      **
  *********************************************************************/
 void ShareSeed(unsigned int, unsigned int *);
 
@@ -112,6 +135,18 @@ double * ShareMallocM1d(int);
  ** ShareFreeM1d(s)                                                 **
  *********************************************************************/
 void ShareFreeM1d(double *);
+/*********************************************************************
+ ** to malloc memories aligned to shareDefAlign bytes               **
+ ** ShareMallocAlignedM1d(size): size*double, zeroed                **
+ ** ShareAlignedStride(size): size rounded up to a whole number of  **
+ **   aligned blocks, to keep every row of a matrix aligned         **
+ **                                                                 **
+ ** to free memories                                                **
+ ** ShareFreeAlignedM1d(s)                                          **
+ *********************************************************************/
+double * ShareMallocAlignedM1d(int);
+int ShareAlignedStride(int);
+void ShareFreeAlignedM1d(double *);
 /*********************************************************************
  ** to malloc memories                                              **
  ** ShareMallocM2d(size1, size2)                                    **
@@ -130,6 +165,45 @@ void ShareFreeM2d(double **, int);
  *********************************************************************/
 double ***ShareMallocM3d(int , int , int );
 void ShareFreeM3d(double ***, int , int );
+/*********************************************************************
+ ** ShareArena: bump allocator for the temporaries of a generation  **
+ ** block[size]: the memory handed out, aligned to shareDefAlign    **
+ ** used: bytes of block handed out since the last reset            **
+ ** need: bytes asked for since the last reset, block included      **
+ ** spill: blocks mallocated for what did not fit in block, each    **
+ **   starting with the pointer to the next one                     **
+ **                                                                 **
+ ** ShareArenaInit(arena): empty arena                              **
+ ** ShareArenaReset(arena): take back everything handed out; block  **
+ **   is first grown to need if it spilled, so once a generation    **
+ **   fits, later ones draw from block without any malloc           **
+ ** ShareArenaFree(arena): free block and spill                     **
+ **                                                                 **
+ ** to take memories from an arena, zeroed, aligned, valid until    **
+ ** the next reset, never freed on their own                        **
+ ** ShareArenaMallocM1c(arena, size): size*char                     **
+ ** ShareArenaMallocM1i(arena, size): size*int                      **
+ ** ShareArenaMallocM1d(arena, size): size*double                   **
+ ** ShareArenaMallocM2d(arena, size1, size2): size1*(double*),      **
+ **   size2*double                                                  **
+ *********************************************************************/
+typedef struct ShareArena
+  {
+    char *raw;
+    char *block;
+    size_t size;
+    size_t used;
+    size_t need;
+    char *spill;
+  } ShareArena;
+
+void ShareArenaInit(ShareArena *);
+void ShareArenaReset(ShareArena *);
+void ShareArenaFree(ShareArena *);
+char * ShareArenaMallocM1c(ShareArena *, int);
+int * ShareArenaMallocM1i(ShareArena *, int);
+double * ShareArenaMallocM1d(ShareArena *, int);
+double ** ShareArenaMallocM2d(ShareArena *, int, int);
 /*********************************************************************
  ** to check if it's equal to zero                                  **
  ** if(x<min) return true                                           **
@@ -0,0 +1,279 @@
+/*
+Stochastically ranked evolutionary strategy sampler for zebrafish segmentation
+Copyright (C) 2013 Ahmet Ay, Jack Holland, Adriana Sperlea, Sebastian Sangervasi
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+cache.cpp contains functions for the fitness cache, which remembers the score of every parameter set so a set libSRES produces again is not simulated again.
+libSRES repeats sets often: parents are copied into offspring slots unchanged and, with no retries, out-of-bounds mutations fall back to the parent's values.
+*/
+
+#include <cmath> // Needed for nearbyint
+
+#include "cache.hpp" // Function declarations
+
+#include "macros.hpp"
+#include "sres.hpp"
+
+extern terminal* term; // Declared in init.cpp
+
+fitness_cache* cache = NULL; // The global fitness cache, NULL when every set is evaluated
+
+/* init_cache creates the fitness cache if the user enabled it
+	parameters:
+		ip: the program's input parameters
+	returns: nothing
+	notes:
+		Caching assumes the simulation is deterministic, i.e. it always gives the same parameter set the same score.
+	todo:
+*/
+void init_cache (input_params& ip) {
+	if (ip.memoize == MEMOIZE_NONE) {
+		return;
+	}
+	int tag = mem_tag(MEM_TAG_CACHE);
+	cache = new fitness_cache(ip.num_dims, 1 + NUM_CONSTRAINTS, ip.memoize == MEMOIZE_ROUNDED, ip.printing_precision);
+	mem_tag(tag);
+}
+
+/* free_cache prints how often the fitness cache was used and frees it
+	parameters:
+	returns: nothing
+	notes:
+	todo:
+*/
+void free_cache () {
+	if (cache == NULL) {
+		return;
+	}
+	if (cache->hits + cache->misses > 0) {
+		term->rank(get_rank());
+		cout << term->blue << "Fitness cache: " << term->reset << cache->hits << term->blue << " hits, " << term->reset << cache->misses << term->blue << " misses" << term->reset << endl;
+	}
+	delete cache;
+	cache = NULL;
+}
+
+/* fitness_cached scores the given parameter sets, taking every score it can from the cache and evaluating only the rest
+	parameters:
+		sets: the array of parameter sets to score
+		num_sets: the number of parameter sets in the array
+		scores: the array to store each set's score in
+		constraints: the arrays to store each set's constraint values in
+		evaluate: the function that evaluates the sets missing from the cache
+	returns: nothing
+	notes:
+		Sets repeated within the batch are evaluated once: the first is added to the cache before evaluation and the rest find it there.
+		Keys added during this call have indices of at least first_new, which marks their values as not yet evaluated.
+		A cached penalty is not treated as a score: a penalty stands for a failure that may not happen again, so the set is evaluated again under its existing key.
+	todo:
+*/
+void fitness_cached (double** sets, int num_sets, double* scores, double** constraints, ESfcnFGBatch evaluate) {
+	double** miss_sets = (double**)mallocate(sizeof(double*) * num_sets);
+	double** miss_constraints = (double**)mallocate(sizeof(double*) * num_sets);
+	double* miss_scores = (double*)mallocate(sizeof(double) * num_sets);
+	int* miss_keys = (int*)mallocate(sizeof(int) * num_sets);
+	int* set_keys = (int*)mallocate(sizeof(int) * num_sets);
+	double* key = (double*)mallocate(sizeof(double) * cache->num_dims);
+	
+	// Look every set up, adding the ones not found
+	int first_new = cache->num_keys;
+	int num_misses = 0;
+	for (int i = 0; i < num_sets; i++) {
+		make_cache_key(sets[i], key);
+		uint64_t hash = hash_set(key, cache->num_dims);
+		set_keys[i] = find_cache(cache, key, hash);
+		double* values = set_keys[i] != -1 && set_keys[i] < first_new ? cache->values + set_keys[i] * cache->num_values : NULL;
+		if (set_keys[i] == -1 || (values != NULL && values[0] == PENALTY_FITNESS)) {
+			if (set_keys[i] == -1) {
+				set_keys[i] = add_cache(cache, key, hash);
+			} else {
+				values[0] = 0; // Later copies of the set in this call find it being evaluated instead of penalized
+			}
+			miss_keys[num_misses] = set_keys[i];
+			miss_sets[num_misses] = sets[i];
+			miss_constraints[num_misses] = constraints != NULL ? constraints[i] : NULL;
+			num_misses++;
+			cache->misses++;
+		} else {
+			cache->hits++;
+		}
+	}
+	
+	// Evaluate the missing sets and store their values
+	if (num_misses > 0) {
+		evaluate(miss_sets, num_misses, miss_scores, miss_constraints);
+	}
+	for (int i = 0; i < num_misses; i++) {
+		double* values = cache->values + miss_keys[i] * cache->num_values;
+		values[0] = miss_scores[i];
+		for (int j = 0; j < NUM_CONSTRAINTS; j++) {
+			values[1 + j] = miss_constraints[i][j];
+		}
+	}
+	
+	// Copy every set's values out of the cache
+	for (int i = 0; i < num_sets; i++) {
+		double* values = cache->values + set_keys[i] * cache->num_values;
+		scores[i] = values[0];
+		for (int j = 0; j < NUM_CONSTRAINTS; j++) {
+			constraints[i][j] = values[1 + j];
+		}
+	}
+	
+	mfree(miss_sets);
+	mfree(miss_constraints);
+	mfree(miss_scores);
+	mfree(miss_keys);
+	mfree(set_keys);
+	mfree(key);
+}
+
+/* make_cache_key converts the given parameter set into the key it is cached under
+	parameters:
+		set: the parameter set
+		key: the array to store the key in
+	returns: nothing
+	notes:
+		Rounded keys hold each parameter multiplied by 10^printing_precision and rounded, so sets printed identically share a score.
+		Adding 0.0 turns -0.0 into 0.0 so both round to the same bit pattern.
+	todo:
+*/
+void make_cache_key (const double* set, double* key) {
+	if (cache->rounded) {
+		for (int i = 0; i < cache->num_dims; i++) {
+			key[i] = nearbyint(set[i] * cache->scale) + 0.0;
+		}
+	} else {
+		memcpy(key, set, sizeof(double) * cache->num_dims);
+	}
+}
+
+/* hash_set hashes the bit pattern of the given parameter set
+	parameters:
+		set: the parameter set
+		num_dims: the number of parameters in the set
+	returns: the hash
+	notes:
+		Each parameter is mixed in with the splitmix64 finalizer, which spreads nearby doubles across the whole table.
+	todo:
+*/
+uint64_t hash_set (const double* set, int num_dims) {
+	uint64_t hash = num_dims;
+	for (int i = 0; i < num_dims; i++) {
+		uint64_t bits;
+		memcpy(&bits, set + i, sizeof(uint64_t));
+		hash ^= bits + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+		hash ^= hash >> 30;
+		hash *= 0xbf58476d1ce4e5b9ULL;
+		hash ^= hash >> 27;
+		hash *= 0x94d049bb133111ebULL;
+		hash ^= hash >> 31;
+	}
+	return hash;
+}
+
+/* find_cache finds the given key in the given cache
+	parameters:
+		table_cache: the cache to search
+		key: the key to find
+		hash: the key's hash
+	returns: the index of the key, or -1 if it is not cached
+	notes:
+	todo:
+*/
+int find_cache (fitness_cache* table_cache, const double* key, uint64_t hash) {
+	int mask = table_cache->capacity - 1;
+	for (int slot = hash & mask; table_cache->table[slot] != -1; slot = (slot + 1) & mask) {
+		int index = table_cache->table[slot];
+		if (table_cache->hashes[index] == hash && memcmp(table_cache->keys + index * table_cache->num_dims, key, sizeof(double) * table_cache->num_dims) == 0) {
+			return index;
+		}
+	}
+	return -1;
+}
+
+/* add_cache adds the given key to the given cache, leaving its values to be filled in
+	parameters:
+		table_cache: the cache to add the key to
+		key: the key to add, which must not be cached already
+		hash: the key's hash
+	returns: the index of the key
+	notes:
+	todo:
+*/
+int add_cache (fitness_cache* table_cache, const double* key, uint64_t hash) {
+	int tag = mem_tag(MEM_TAG_CACHE);
+	
+	// Grow the arrays of keys and values if they are full
+	if (table_cache->num_keys == table_cache->max_keys) {
+		int max_keys = table_cache->max_keys * 2;
+		double* keys = (double*)mallocate(sizeof(double) * table_cache->num_dims * max_keys);
+		double* values = (double*)mallocate(sizeof(double) * table_cache->num_values * max_keys);
+		uint64_t* hashes = (uint64_t*)mallocate(sizeof(uint64_t) * max_keys);
+		memcpy(keys, table_cache->keys, sizeof(double) * table_cache->num_dims * table_cache->num_keys);
+		memcpy(values, table_cache->values, sizeof(double) * table_cache->num_values * table_cache->num_keys);
+		memcpy(hashes, table_cache->hashes, sizeof(uint64_t) * table_cache->num_keys);
+		mfree(table_cache->keys);
+		mfree(table_cache->values);
+		mfree(table_cache->hashes);
+		table_cache->keys = keys;
+		table_cache->values = values;
+		table_cache->hashes = hashes;
+		table_cache->max_keys = max_keys;
+	}
+	
+	// Keep the table at most half full so probes stay short
+	if (2 * (table_cache->num_keys + 1) > table_cache->capacity) {
+		grow_cache_table(table_cache);
+	}
+	
+	int index = table_cache->num_keys++;
+	memcpy(table_cache->keys + index * table_cache->num_dims, key, sizeof(double) * table_cache->num_dims);
+	table_cache->hashes[index] = hash;
+	int mask = table_cache->capacity - 1;
+	int slot = hash & mask;
+	while (table_cache->table[slot] != -1) {
+		slot = (slot + 1) & mask;
+	}
+	table_cache->table[slot] = index;
+	mem_tag(tag);
+	return index;
+}
+
+/* grow_cache_table doubles the size of the given cache's hash table and reinserts every key
+	parameters:
+		table_cache: the cache to grow
+	returns: nothing
+	notes:
+	todo:
+*/
+void grow_cache_table (fitness_cache* table_cache) {
+	mfree(table_cache->table);
+	table_cache->capacity *= 2;
+	table_cache->table = (int*)mallocate(sizeof(int) * table_cache->capacity);
+	for (int i = 0; i < table_cache->capacity; i++) {
+		table_cache->table[i] = -1;
+	}
+	int mask = table_cache->capacity - 1;
+	for (int index = 0; index < table_cache->num_keys; index++) {
+		int slot = table_cache->hashes[index] & mask;
+		while (table_cache->table[slot] != -1) {
+			slot = (slot + 1) & mask;
+		}
+		table_cache->table[slot] = index;
+	}
+}
@@ -0,0 +1,39 @@
+/*
+Stochastically ranked evolutionary strategy sampler for zebrafish segmentation
+Copyright (C) 2013 Ahmet Ay, Jack Holland, Adriana Sperlea, Sebastian Sangervasi
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+cache.hpp contains function declarations for cache.cpp.
+*/
+
+#ifndef CACHE_HPP
+#define CACHE_HPP
+
+#include "structs.hpp"
+
+extern fitness_cache* cache; // Declared in cache.cpp
+
+void init_cache(input_params&);
+void free_cache();
+void fitness_cached(double**, int, double*, double**, ESfcnFGBatch);
+void make_cache_key(const double*, double*);
+uint64_t hash_set(const double*, int);
+int find_cache(fitness_cache*, const double*, uint64_t);
+int add_cache(fitness_cache*, const double*, uint64_t);
+void grow_cache_table(fitness_cache*);
+
+#endif
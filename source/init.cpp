@@ -20,7 +20,16 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 init.cpp contains initialization functions used before any simulations start.
 */
 
+// Include MPI if compiled with it
+#if defined(MPI)
+	#undef MPI // MPI uses this macro as well, so temporarily undefine it
+	#include <mpi.h> // Needed for MPI_Bcast, MPI_COMM_WORLD
+	#define MPI // The MPI macro should be checked only for definition, not value
+#endif
+
 #include <cmath> // Needed for log10
+#include <fcntl.h> // Needed for open, fcntl, O_CLOEXEC
+#include <unistd.h> // Needed for access, pread, close
 
 #include "init.hpp" // Function declarations
 
@@ -142,8 +151,88 @@ void accept_input_params (int num_args, char** args, input_params& ip) {
 				if (ip.printing_precision < 1) {
 					usage("The printing precision must be a positive integer. Set -e or --printing-precision to at least 1.");
 				}
+			} else if (option_set(option, "-o", "--plugin")) {
+				ensure_nonempty(option, value);
+				store_filename(&(ip.plugin_file), value);
+			} else if (option_set(option, "-m", "--memoize")) {
+				ensure_nonempty(option, value);
+				if (strcmp(value, "none") == 0) {
+					ip.memoize = MEMOIZE_NONE;
+				} else if (strcmp(value, "exact") == 0) {
+					ip.memoize = MEMOIZE_EXACT;
+				} else if (strcmp(value, "rounded") == 0) {
+					ip.memoize = MEMOIZE_ROUNDED;
+				} else {
+					usage("The fitness cache mode must be none, exact or rounded. Set -m or --memoize to one of them.");
+				}
+			} else if (option_set(option, "-S", "--store")) {
+				ensure_nonempty(option, value);
+				store_filename(&(ip.store_file), value);
+			} else if (option_set(option, "-t", "--timeout")) {
+				ensure_nonempty(option, value);
+				ip.timeout = atof(value);
+				if (ip.timeout < 0) {
+					usage("The simulation timeout must be a nonnegative number. Set -t or --timeout to at least 0.");
+				}
+			} else if (option_set(option, "-k", "--timeout-factor")) {
+				ensure_nonempty(option, value);
+				ip.timeout_factor = atof(value);
+				if (ip.timeout_factor < 0) {
+					usage("The adaptive timeout factor must be a nonnegative number. Set -k or --timeout-factor to at least 0.");
+				}
+			} else if (option_set(option, "-F", "--on-failure")) {
+				ensure_nonempty(option, value);
+				if (strcmp(value, "exit") == 0) {
+					ip.on_failure = FAILURE_EXIT;
+				} else if (strcmp(value, "retry") == 0) {
+					ip.on_failure = FAILURE_RETRY;
+				} else if (strcmp(value, "penalty") == 0) {
+					ip.on_failure = FAILURE_PENALTY;
+				} else {
+					usage("The failure policy must be exit, retry or penalty. Set -F or --on-failure to one of them.");
+				}
+			} else if (option_set(option, "-i", "--islands")) {
+				ensure_nonempty(option, value);
+				ip.num_islands = atoi(value);
+				if (ip.num_islands < 1) {
+					usage("The number of islands must be a positive integer. Set -i or --islands to at least 1.");
+				}
+			} else if (option_set(option, "-M", "--migration-interval")) {
+				ensure_nonempty(option, value);
+				ip.migration_interval = atoi(value);
+				if (ip.migration_interval < 1) {
+					usage("The migration interval must be a positive integer. Set -M or --migration-interval to at least 1.");
+				}
+			} else if (option_set(option, "-T", "--topology")) {
+				ensure_nonempty(option, value);
+				if (strcmp(value, "ring") == 0) {
+					ip.topology = TOPOLOGY_RING;
+				} else if (strcmp(value, "random") == 0) {
+					ip.topology = TOPOLOGY_RANDOM;
+				} else {
+					usage("The migration topology must be ring or random. Set -T or --topology to one of them.");
+				}
+			} else if (option_set(option, "-w", "--workers")) {
+				ensure_nonempty(option, value);
+				ip.num_workers = atoi(value);
+				if (ip.num_workers < 0) {
+					usage("The number of simulation workers must be a nonnegative integer. Set -w or --workers to at least 0.");
+				}
+			} else if (option_set(option, "-j", "--jobs")) {
+				ensure_nonempty(option, value);
+				ip.num_jobs = atoi(value);
+				if (ip.num_jobs < 1) {
+					usage("At least one simulation must run at a time. Set -j or --jobs to at least 1.");
+				}
+			} else if (option_set(option, "-b", "--batch-size")) {
+				ensure_nonempty(option, value);
+				ip.batch_size = atoi(value);
+				if (ip.batch_size < 0) {
+					usage("The batch size must be a nonnegative integer. Set -b or --batch-size to at least 0.");
+				}
 			} else if (option_set(option, "-a", "--arguments")) {
 				ensure_nonempty(option, value);
+				int tag = mem_tag(MEM_TAG_ARGV);
 				++i;
 				ip.num_sim_args = num_args - i + NUM_IMPLICIT_SIM_ARGS;
 				ip.sim_args = (char**)mallocate(sizeof(char*) * (ip.num_sim_args));
@@ -152,7 +241,11 @@ void accept_input_params (int num_args, char** args, input_params& ip) {
 					ip.sim_args[j] = (char*)mallocate(sizeof(char) * (strlen(arg) + 1));
 					sprintf(ip.sim_args[j], "%s", arg);
 				}
+				mem_tag(tag);
 				i = num_args;
+			} else if (option_set(option, "-A", "--steady-state")) {
+				ip.steady_state = true;
+				i--;
 			} else if (option_set(option, "-c", "--no-color")) {
 				mfree(term->blue);
 				mfree(term->red);
@@ -176,6 +269,12 @@ void accept_input_params (int num_args, char** args, input_params& ip) {
 					term->set_verbose_streambuf(ip.null_stream->rdbuf());
 				}
 				i--;
+			} else if (option_set(option, "-u", "--memory-usage")) {
+				ip.memory_usage = true;
+				#if defined(MEMTRACK)
+					enable_heap_tracking(); // Tracking starts here instead of after every option is read so the simulation's arguments, which -a puts last, are counted
+				#endif
+				i--;
 			} else if (option_set(option, "-h", "--help")) {
 				usage("");
 				i--;
@@ -234,6 +333,23 @@ void check_input_params (input_params& ip) {
 	if (ip.ranges_file == NULL) {
 		usage("A ranges file must be specified! Set the ranges file with -r or --ranges-file.");
 	}
+	#if !defined(MEMTRACK)
+		if (ip.memory_usage) {
+			usage("Tracking memory usage requires the memory tracker. Compile with memtrack=1 or leave out -u or --memory-usage.");
+		}
+	#endif
+	#if !defined(MPI)
+		if (ip.num_islands > 1) {
+			usage("The island model requires MPI. Compile with mpi=1 or set -i or --islands to 1.");
+		}
+	#else
+		if (ip.steady_state) {
+			usage("The steady-state engine does not support MPI. Compile without mpi=1 or leave out -A or --steady-state.");
+		}
+	#endif
+	if (ip.steady_state && (ip.num_workers > 0 || ip.plugin_file != NULL)) {
+		usage("The steady-state engine launches a simulation per offspring. Leave out -w or --workers and -o or --plugin, or leave out -A or --steady-state.");
+	}
 	printing_precision = ip.printing_precision; // ip cannot be imported into a C file so the printing precision must be its own global
 }
 
@@ -258,6 +374,7 @@ void init_verbosity (input_params& ip) {
 	todo:
 */
 void init_sim_args (input_params& ip) {
+	int tag = mem_tag(MEM_TAG_ARGV);
 	if (ip.num_sim_args == 0) { // If the arguments were not initialized in accept_input_params (i.e. the user did not specify simulation arguments with -a or --arguments)
 		ip.num_sim_args = NUM_IMPLICIT_SIM_ARGS; // "simulation --pipe-in x --pipe-out y" takes 5 terms and the final NULL element makes the sum 6
 		ip.sim_args = (char**)mallocate(sizeof(char*) * NUM_IMPLICIT_SIM_ARGS);
@@ -266,10 +383,55 @@ void init_sim_args (input_params& ip) {
 	// Initialize the implicit arguments
 	ip.sim_args[0] = copy_str("simulation");
 	ip.sim_args[ip.num_sim_args - 5] = copy_str("--pipe-in");
-	ip.sim_args[ip.num_sim_args - 4] = copy_str("0");
+	ip.sim_args[ip.num_sim_args - 4] = NULL;
+	store_pipe(ip.sim_args, ip.num_sim_args - 4, SIM_PIPE_IN_FD);
 	ip.sim_args[ip.num_sim_args - 3] = copy_str("--pipe-out");
-	ip.sim_args[ip.num_sim_args - 2] = copy_str("0");
+	ip.sim_args[ip.num_sim_args - 2] = NULL;
+	store_pipe(ip.sim_args, ip.num_sim_args - 2, SIM_PIPE_OUT_FD);
 	ip.sim_args[ip.num_sim_args - 1] = NULL;
+	mem_tag(tag);
+}
+
+/* init_sim_file checks that the simulation can be executed and opens it once so every launch executes the same file without looking up its path again
+	parameters:
+		ip: the program's input parameters
+	returns: nothing
+	notes:
+		Simulations are executed through the open file descriptor's /proc/self/fd entry when it exists, otherwise through the simulation's filename.
+		Scripts (files starting with "#!") are always executed through their filename since their interpreter reopens the script by the path it is given and the file descriptor is closed on exec.
+	todo:
+*/
+void init_sim_file (input_params& ip) {
+	if (ip.plugin_file != NULL) { // Simulations are never launched when a fitness plugin scores the parameter sets
+		return;
+	}
+	
+	ostream& v = term->verbose();
+	v << term->blue << "Checking that the simulation file exists and can be executed " << term->reset << ". . . ";
+	int fd = open(ip.sim_file, O_RDONLY | O_CLOEXEC);
+	if (fd == -1 || access(ip.sim_file, X_OK) == -1) {
+		term->failed_exec();
+		exit(EXIT_EXEC_ERROR);
+	}
+	
+	// Keep the file above the file descriptors simulations receive their pipes on so spawning never closes it
+	ip.sim_fd = fcntl(fd, F_DUPFD_CLOEXEC, SIM_PIPE_OUT_FD + 1);
+	if (ip.sim_fd == -1 || close(fd) == -1) {
+		term->failed_exec();
+		exit(EXIT_EXEC_ERROR);
+	}
+	
+	// Use the /proc entry of the open file if the simulation is a binary and /proc is mounted
+	char magic[2] = {0, 0};
+	bool script = pread(ip.sim_fd, magic, 2, 0) == 2 && magic[0] == '#' && magic[1] == '!';
+	char fd_path[32];
+	sprintf(fd_path, "/proc/self/fd/%d", ip.sim_fd);
+	if (!script && access(fd_path, X_OK) == 0) {
+		ip.sim_exec_path = copy_str(fd_path);
+	} else {
+		ip.sim_exec_path = copy_str(ip.sim_file);
+	}
+	v << term->blue << "Done: " << term->reset << "executing " << ip.sim_exec_path << endl;
 }
 
 /* copy_args copies the given array of arguments
@@ -295,13 +457,33 @@ char** copy_args (char** args, int num_args) {
 		sp: parameters required by libSRES to put the ranges in
 	returns: nothing
 	notes:
+		With MPI only rank 0 reads and parses the file, then broadcasts the bounds, so a large run does not open the file once per process on a shared filesystem.
+		Rank 0 broadcasts whether it succeeded before the bounds, so a missing or malformed file ends every rank with the same status instead of leaving the others waiting for bounds that never come.
 	todo:
 */
 void read_ranges (input_params& ip, input_data& ranges_data, sres_params& sp) {
-	read_file(&ranges_data);
+	int tag = mem_tag(MEM_TAG_POPULATION);
 	sp.lb = (double*)mallocate(sizeof(double) * ip.num_dims); // Lower bounds
 	sp.ub = (double*)mallocate(sizeof(double) * ip.num_dims); // Upper bounds
-	parse_ranges_file(ranges_data.buffer, ip, sp);
+	mem_tag(tag);
+	int status = EXIT_SUCCESS;
+	if (get_rank() == 0) {
+		if (!read_file(&ranges_data)) {
+			status = EXIT_FILE_READ_ERROR;
+		} else if (!parse_ranges_file(ranges_data.buffer, ip, sp)) {
+			status = EXIT_INPUT_ERROR;
+		}
+	}
+	#if defined(MPI)
+		MPI_Bcast(&status, 1, MPI_INT, 0, MPI_COMM_WORLD);
+	#endif
+	if (status != EXIT_SUCCESS) {
+		exit(status);
+	}
+	#if defined(MPI)
+		MPI_Bcast(sp.lb, ip.num_dims, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+		MPI_Bcast(sp.ub, ip.num_dims, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+	#endif
 }
 
 /* store_pipe stores the given pipe file descriptor into the given index in the array of arguments
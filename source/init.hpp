@@ -34,6 +34,7 @@ void ensure_nonempty(const char*, const char*);
 void check_input_params(input_params&);
 void init_verbosity(input_params&);
 void init_sim_args(input_params&);
+void init_sim_file(input_params&);
 char** copy_args(char**, int);
 void read_ranges(input_params&, input_data&, sres_params&);
 void store_pipe(char**, int, int);
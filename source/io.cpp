@@ -20,17 +20,29 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 io.cpp contains functions for input and output of files and pipes. All I/O related functions should be placed in this file.
 */
 
+#include <algorithm> // Needed for min, nth_element
+#include <cerrno> // Needed for errno, EINTR
+#include <ctime> // Needed for clock_gettime, CLOCK_MONOTONIC
+#include <fcntl.h> // Needed for fcntl, O_CLOEXEC
 #include <sys/wait.h> // Needed for waitpid
-#include <unistd.h> // Needed for pipe, read, write, close, fork, execv
+#include <signal.h> // Needed for sigset_t, sigemptyset, sigaddset, SIGPIPE
+#include <spawn.h> // Needed for posix_spawn
+#include <unistd.h> // Needed for pipe2, read, write, close
 
 #include "io.hpp" // Function declarations
 
 #include "init.hpp"
 #include "macros.hpp"
+#include "pool.hpp"
+#include "supervisor.hpp"
 #include "sres.hpp"
 
 extern terminal* term; // Declared in init.cpp
 extern input_params ip; // Declared in main.cpp
+extern sim_pool* pool; // Declared in pool.cpp
+extern eval_counts evals; // Declared in sres.cpp
+
+sim_timing timing; // The recent simulation times adaptive timeouts are based on
 
 /* store_filename stores the given value in the given field
 	parameters:
@@ -49,12 +61,13 @@ void store_filename (char** field, const char* value) {
 /* read_file takes an input_data struct and stores the contents of the associated file in a string
 	parameters:
 		ifd: the input_data struct to contain the file name, buffer to store the contents, size of the file, and current index
-	returns: nothing
+	returns: true if the file was read, false if it could not be opened, read or closed
 	notes:
 		The buffer in ifd will be sized large enough to fit the file
+		Failures are printed but left to the caller to exit on, so with MPI every rank can be told before exiting.
 	todo:
 */
-void read_file (input_data* ifd) {
+bool read_file (input_data* ifd) {
 	int rank = get_rank();
 	ostream& v = term->verbose();
 	term->rank(rank, v);
@@ -64,7 +77,7 @@ void read_file (input_data* ifd) {
 	FILE* file = fopen(ifd->filename, "r");
 	if (file == NULL) {
 		cout << term->red << "Couldn't open " << ifd->filename << "!" << term->reset << endl;
-		exit(EXIT_FILE_READ_ERROR);
+		return false;
 	}
 	
 	// Seek to the end of the file, grab its size, and then rewind
@@ -74,23 +87,27 @@ void read_file (input_data* ifd) {
 	rewind(file);
 	
 	// Allocate enough memory to contain the whole file
+	int tag = mem_tag(MEM_TAG_IO);
 	ifd->buffer = (char*)mallocate(sizeof(char) * size + 1);
+	mem_tag(tag);
 	
 	// Copy the file's contents into the buffer
 	long result = fread(ifd->buffer, 1, size, file);
 	if (result != size) {
 		cout << term->red << "Couldn't read from " << ifd->filename << term->reset << endl;
-		exit(EXIT_FILE_READ_ERROR);
+		fclose(file);
+		return false;
 	}
 	ifd->buffer[size] = '\0';
 	
 	// Close the file
 	if (fclose(file) != 0) {
 		cout << term->red << "Couldn't close " << ifd->filename << term->reset << endl;
-		exit(EXIT_FILE_READ_ERROR);
+		return false;
 	}
 	
 	term->done(v);
+	return true;
 }
 
 /* parse_ranges_file reads the given buffer and stores every range found in the given ranges array
@@ -98,22 +115,23 @@ void read_file (input_data* ifd) {
 		buffer: the buffer with the ranges to read
 		ip: the program's input parameters
 		sp: parameters required by libSRES with arrays in which to store the lower and upper bounds of each range
-	returns: nothing
+	returns: true if every range was read, false if the file has more ranges than dimensions or a range without an upper bound
 	notes:
 		The buffer should contain one range per line, starting the name of the parameter followed by the bracked enclosed lower and then upper bound optionally followed by comments.
 		e.g. 'msh1 [30, 65] comment'
 		The name of the parameter is so humans can conveniently read the file and has no semantic value to this parser.
 		Blank lines and lines starting with # will be ignored. Anything after the upper bound is ignored.
+		Failures are printed but left to the caller to exit on, so with MPI every rank can be told before exiting.
 	todo:
 */
-void parse_ranges_file (char* buffer, input_params& ip, sres_params& sp) {
+bool parse_ranges_file (char* buffer, input_params& ip, sres_params& sp) {
 	int i = 0;
 	int rate = 0;
 	for (; buffer[i] != '\0'; i++) {
 		// Ensure that the number of rates in the given ranges file does not exceed the given number of dimensions
 		if (rate >= ip.num_dims) {
 			cout << term->red << "The number of rates in the given ranges file does not match the given number of dimensions! Please check that the rates file matches the number of dimensions (" << ip.num_dims << ")." << term->reset << endl;
-		exit(EXIT_INPUT_ERROR);
+			return false;
 		}
 		
 		// Ignore lines starting with #
@@ -129,7 +147,11 @@ void parse_ranges_file (char* buffer, input_params& ip, sres_params& sp) {
 		
 		// Read the bounds
 		sp.lb[rate] = atof(buffer + i);
-		while (buffer[i] != ',') {i++;}
+		while (buffer[i] != ',' && buffer[i] != '\n' && buffer[i] != '\0') {i++;}
+		if (buffer[i] != ',') {
+			cout << term->red << "The range of rate " << rate + 1 << " in the given ranges file has no upper bound! Please check that every range is written as [lower, upper]." << term->reset << endl;
+			return false;
+		}
 		i++;
 		sp.ub[rate] = atof(buffer + i);
 		if (sp.lb[rate] < 0 || sp.ub[rate] < 0) { // If the ranges are invalid then set them to 0
@@ -140,7 +162,9 @@ void parse_ranges_file (char* buffer, input_params& ip, sres_params& sp) {
 		// Skip any comments until the end of the line
 		while (buffer[i] != '\n' && buffer[i] != '\0') {i++;}
 		rate++;
+		if (buffer[i] == '\0') {break;}
 	}
+	return true;
 }
 
 /* open_file opens the file with the given name and stores it in the given output file stream
@@ -178,117 +202,282 @@ void open_file (ofstream* file_pointer, char* file_name, bool append) {
 	todo:
 */
 double simulate_set (double parameters[]) {
-	// Get the MPI rank of the process
+	double score;
+	simulate_sets(&parameters, 1, &score);
+	return score;
+}
+
+/* simulate_sets runs simulations on the given parameter sets, sending them in batches of the size specified by the user
+	parameters:
+		sets: the array of parameter sets to simulate
+		num_sets: the number of parameter sets in the array
+		scores: the array to store each set's score in
+	returns: nothing
+	notes:
+		A batch size of 0 sends every set to one simulation or, if the worker pool is running, splits the sets evenly between the workers.
+	todo:
+*/
+void simulate_sets (double* sets[], int num_sets, double scores[]) {
+	int batch_size = ip.batch_size;
+	if (batch_size == 0) {
+		int parallel = pool != NULL ? pool->num_workers : ip.num_jobs; // How many simulations run at once
+		batch_size = (num_sets + parallel - 1) / parallel;
+	}
+
+	if (pool != NULL) {
+		simulate_sets_pool(sets, num_sets, batch_size, scores);
+	} else {
+		simulate_sets_supervised(sets, num_sets, batch_size, scores);
+	}
+}
+
+/* start_simulation launches a simulation process connected to the sampler by a pair of pipes
+	parameters:
+		fd_write: a pointer to store the file descriptor parameter sets should be written to
+		fd_read: a pointer to store the file descriptor scores should be read from
+	returns: the PID of the simulation process
+	notes:
+		Separate pipes are used for each direction so the sampler never reads back what it wrote and a simulation can stay alive for more than one parameter set.
+		Every pipe is created close-on-exec and only the child's own ends are duplicated onto SIM_PIPE_IN_FD and SIM_PIPE_OUT_FD for the simulation, so simulations running side by side never inherit each other's pipes and always see the end of their input when the sampler closes it.
+		The simulation is spawned with posix_spawn from the file opened by init_sim_file with the arguments built by init_sim_args, so launching costs the same however much memory the sampler uses.
+		The simulation leads a process group of its own, so killing the group with kill(-pid, ...) also kills whatever a wrapper script started, which would otherwise keep the score pipe open.
+	todo:
+*/
+pid_t start_simulation (int* fd_write, int* fd_read) {
 	int rank = get_rank();
 	ostream& v = term->verbose();
 	
-	// Create a pipe
-	int pipes[2];
+	// Create one pipe for the parameter sets and one for the scores
+	int pipe_sets[2];
+	int pipe_scores[2];
 	v << "  ";
 	term->rank(rank, v);
-	v << term->blue << "Creating a pipe " << term->reset << ". . . ";
-	if (pipe(pipes) == -1) {
+	v << term->blue << "Creating pipes " << term->reset << ". . . ";
+	if (pipe2(pipe_sets, O_CLOEXEC) == -1 || pipe2(pipe_scores, O_CLOEXEC) == -1) {
 		term->failed_pipe_create();
 		exit(EXIT_PIPE_CREATE_ERROR);
 	}
-	v << term->blue << "Done: " << term->reset << "using file descriptors " << pipes[0] << " and " << pipes[1] << endl;
+	pipe_sets[0] = raise_fd(pipe_sets[0]);
+	pipe_scores[1] = raise_fd(pipe_scores[1]);
+	v << term->blue << "Done: " << term->reset << "using file descriptors " << pipe_sets[0] << ", " << pipe_sets[1] << ", " << pipe_scores[0] << " and " << pipe_scores[1] << endl;
 	
-	// Copy the user-specified simulation arguments and fill the copy with the pipe's file descriptors
-	char** sim_args = copy_args(ip.sim_args, ip.num_sim_args);
-	store_pipe(sim_args, ip.num_sim_args - 4, pipes[0]);
-	store_pipe(sim_args, ip.num_sim_args - 2, pipes[1]);
+	// Move the simulation's ends of the pipes onto the file descriptors its prebuilt arguments name, which also clears their close-on-exec flags
+	posix_spawn_file_actions_t actions;
+	posix_spawnattr_t attributes;
+	sigset_t no_signals;
+	sigset_t default_signals;
+	sigemptyset(&no_signals);
+	sigemptyset(&default_signals);
+	sigaddset(&default_signals, SIGPIPE); // The worker pool and the supervisor ignore SIGPIPE, which would otherwise be inherited
+	if (posix_spawn_file_actions_init(&actions) != 0 || posix_spawnattr_init(&attributes) != 0 ||
+		posix_spawn_file_actions_adddup2(&actions, pipe_sets[0], SIM_PIPE_IN_FD) != 0 ||
+		posix_spawn_file_actions_adddup2(&actions, pipe_scores[1], SIM_PIPE_OUT_FD) != 0 ||
+		posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETPGROUP) != 0 ||
+		posix_spawnattr_setpgroup(&attributes, 0) != 0 ||
+		posix_spawnattr_setsigmask(&attributes, &no_signals) != 0 ||
+		posix_spawnattr_setsigdefault(&attributes, &default_signals) != 0) {
+		term->failed_fork();
+		exit(EXIT_FORK_ERROR);
+	}
 	
-	// Fork the process so the child can run the simulation
+	// Spawn the simulation, which shares the parent's memory until it executes instead of copying its page tables like fork
 	v << "  ";
 	term->rank(rank, v);
-	v << term->blue << "Forking the process " << term->reset << ". . . ";
-	pid_t pid = fork();
-	if (pid == -1) {
-		term->failed_fork();
-		exit(EXIT_FORK_ERROR);
+	v << term->blue << "Spawning the simulation " << term->reset << ". . . ";
+	pid_t pid;
+	int error = posix_spawn(&pid, ip.sim_exec_path, &actions, &attributes, ip.sim_args, environ);
+	posix_spawn_file_actions_destroy(&actions);
+	posix_spawnattr_destroy(&attributes);
+	if (error != 0) {
+		term->failed_exec();
+		exit(EXIT_EXEC_ERROR);
 	}
-	if (pid == 0) { // The child runs the simulation
-		v << "  ";
-		term->rank(rank, v);
-		v << term->blue << "Checking that the simulation file exists and can be executed " << term->reset << ". . . ";
-		if (access(ip.sim_file, X_OK) == -1) {
-			term->failed_exec();
-			exit(EXIT_EXEC_ERROR);
-		}
-		term->done(v);
-		if (execv(ip.sim_file, sim_args) == -1) {
-			term->failed_exec();
-			exit(EXIT_EXEC_ERROR);
-		}
-	} else { // The parent pipes in the parameter set to run
-		v << term->blue << "Done: " << term->reset << "the child process's PID is " << pid << endl;
-		v << "  ";
-		term->rank(rank, v);
-		v << term->blue << "Writing to the pipe " << term->reset << "(file descriptor " << pipes[1] << ") . . . ";
-		write_pipe(pipes[1], parameters);
-		term->done(v);
+	v << term->blue << "Done: " << term->reset << "the child process's PID is " << pid << endl;
+	
+	// The parent keeps only its own ends of the pipes
+	if (close(pipe_sets[0]) == -1 || close(pipe_scores[1]) == -1) {
+		term->failed_pipe_create();
+		exit(EXIT_PIPE_CREATE_ERROR);
 	}
+	*fd_write = pipe_sets[1];
+	*fd_read = pipe_scores[0];
 	
-	// Wait for the child to finish simulating
+	return pid;
+}
+
+/* raise_fd moves the given close-on-exec file descriptor above the ones simulations receive their pipes on
+	parameters:
+		fd: the file descriptor to move
+	returns: the file descriptor, which is a new one if the given one was moved
+	notes:
+		Without this, duplicating one pipe onto SIM_PIPE_IN_FD could overwrite the other pipe before it is duplicated onto SIM_PIPE_OUT_FD.
+	todo:
+*/
+int raise_fd (int fd) {
+	if (fd > SIM_PIPE_OUT_FD) {
+		return fd;
+	}
+	int new_fd = fcntl(fd, F_DUPFD_CLOEXEC, SIM_PIPE_OUT_FD + 1);
+	if (new_fd == -1 || close(fd) == -1) {
+		term->failed_pipe_create();
+		exit(EXIT_PIPE_CREATE_ERROR);
+	}
+	return new_fd;
+}
+
+/* wait_simulation waits for the given simulation process to exit
+	parameters:
+		pid: the PID of the simulation process
+	returns: nothing
+	notes:
+		The simulation's pipes should be drained before calling this function, otherwise a simulation blocked on a full pipe will never exit.
+	todo:
+*/
+void wait_simulation (pid_t pid) {
 	int status = 0;
 	waitpid(pid, &status, WUNTRACED);
 	if (WIFEXITED(status) == 0) {
 		term->failed_child();
 		exit(EXIT_CHILD_ERROR);
 	}
-	
-	// Close the writing end of the pipe
-	if (close(pipes[1]) == -1) {
-		term->failed_pipe_write();
-		exit(EXIT_PIPE_WRITE_ERROR);
+}
+
+/* monotonic_time gets the time of a clock that never jumps, for measuring how long simulations take
+	parameters:
+	returns: the time in seconds
+	notes:
+	todo:
+*/
+double monotonic_time () {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+/* record_latency stores how long a simulation that succeeded took per parameter set
+	parameters:
+		started: the monotonic time the simulation was launched at
+		num_sets: the number of parameter sets the simulation was sent
+	returns: nothing
+	notes:
+	todo:
+*/
+void record_latency (double started, int num_sets) {
+	timing.latencies[timing.next_latency] = (monotonic_time() - started) / num_sets;
+	timing.next_latency = (timing.next_latency + 1) % LATENCY_SAMPLES;
+	timing.num_latencies = min(timing.num_latencies + 1, LATENCY_SAMPLES);
+}
+
+/* sim_deadline calculates when a simulation launched at the given time should be killed
+	parameters:
+		started: the monotonic time the simulation was launched at
+		num_sets: the number of parameter sets the simulation was sent
+	returns: the monotonic time to kill the simulation at, or 0 if it may run forever
+	notes:
+		The adaptive limit is the user's factor times the 99th percentile of recent times, and applies once MIN_LATENCY_SAMPLES times have been seen; until then only the fixed limit applies.
+		When both limits are set the smaller one is used, so the fixed limit also caps the adaptive one.
+	todo:
+*/
+double sim_deadline (double started, int num_sets) {
+	double per_set = ip.timeout;
+	if (ip.timeout_factor > 0 && timing.num_latencies >= MIN_LATENCY_SAMPLES) {
+		int n = timing.num_latencies;
+		int p99 = min(n - 1, (int)(0.99 * n));
+		memcpy(timing.sorted, timing.latencies, sizeof(double) * n);
+		nth_element(timing.sorted, timing.sorted + p99, timing.sorted + n);
+		double adaptive = ip.timeout_factor * timing.sorted[p99];
+		per_set = per_set > 0 ? min(per_set, adaptive) : adaptive;
 	}
-	
-	// Pipe in the simulation's score
-	int max_score;
-	int score;
-	v << "  ";
-	term->rank(rank, v);
-	v << term->blue << "Reading the pipe " << term->reset << "(file descriptor " << pipes[0] << ") . . . ";
-	read_pipe(pipes[0], &max_score, &score);
-	v << term->blue << "Done: " << term->reset << "(raw score " << score << " / " << max_score << ")" << endl;
-	
-	// Close the reading end of the pipe
-	v << "  ";
-	term->rank(rank, v);
-	v << term->blue << "Closing the reading end of the pipe " << term->reset << "(file descriptor " << pipes[0] << ") . . . ";
-	if (close(pipes[0]) == -1) {
-		term->failed_pipe_read();
-		exit(EXIT_PIPE_WRITE_ERROR);
+	return per_set > 0 ? started + per_set * num_sets : 0;
+}
+
+/* penalize_sets gives the given parameter sets the penalty fitness after their simulation failed
+	parameters:
+		scores: the array of the sets' scores
+		num_sets: the number of sets in the array
+	returns: nothing
+	notes:
+	todo:
+*/
+void penalize_sets (double scores[], int num_sets) {
+	for (int i = 0; i < num_sets; i++) {
+		scores[i] = PENALTY_FITNESS;
 	}
-	term->done(v);
-	
-	// Free the simulation arguments
-	for (int i = 0; sim_args[i] != NULL; i++) {
-		mfree(sim_args[i]);
+	evals.penalized += num_sets;
+}
+
+/* exit_failed_simulation reports a simulation's failure and stops the sampler, for when the user did not choose to retry or penalize failures
+	parameters:
+		timed_out: whether the simulation was killed for running past its deadline
+		crashed: whether the simulation exited abnormally
+	returns: nothing
+	notes:
+		A simulation that exited normally without sending every score is reported as a pipe error, as it always has been.
+	todo:
+*/
+void exit_failed_simulation (bool timed_out, bool crashed) {
+	if (timed_out) {
+		term->failed_timeout();
+		exit(EXIT_CHILD_ERROR);
+	} else if (crashed) {
+		term->failed_child();
+		exit(EXIT_CHILD_ERROR);
 	}
-	mfree(sim_args);
-	
-	// libSRES requires scores from 0 to 1 with 0 being a perfect score so convert the simulation's score format into libSRES's
+	term->failed_pipe_read();
+	exit(EXIT_PIPE_READ_ERROR);
+}
+
+/* convert_score converts a simulation's score into a libSRES fitness
+	parameters:
+		max_score: the maximum score the simulation could have received
+		score: the score the simulation actually received
+	returns: the fitness
+	notes:
+		libSRES requires scores from 0 to 1 with 0 being a perfect score.
+	todo:
+*/
+double convert_score (int max_score, int score) {
 	return 1 - ((double)score / max_score);
 }
 
-/* write_pipe writes the given parameter set to the given pipe
+/* write_pipe writes the given parameter sets to the given pipe
 	parameters:
 		fd: the file descriptor of the pipe to write to
-		parameters: the parameter set to pipe
+		sets: the array of parameter sets to pipe
+		num_sets: the number of parameter sets in the array
 	returns: nothing
 	notes:
 	todo:
 */
-void write_pipe (int fd, double parameters[]) {
-	write_pipe_int(fd, ip.num_dims); // Write the number of dimensions, i.e. parameters per set, being sent
-	write_pipe_int(fd, 1); // Write that one parameter set is being sent
-	if (write(fd, parameters, sizeof(double) * ip.num_dims) == -1) {
+void write_pipe (int fd, double* sets[], int num_sets) {
+	if (!try_write_pipe(fd, sets, num_sets)) {
 		term->failed_pipe_write();
 		exit(EXIT_PIPE_WRITE_ERROR);
 	}
 }
 
+/* try_write_pipe writes the given parameter sets to the given pipe without exiting on failure
+	parameters:
+		fd: the file descriptor of the pipe to write to
+		sets: the array of parameter sets to pipe
+		num_sets: the number of parameter sets in the array
+	returns: true if every set was written, false otherwise
+	notes:
+		This function exists so persistent workers can be restarted instead of ending the program when they die.
+	todo:
+*/
+bool try_write_pipe (int fd, double* sets[], int num_sets) {
+	if (!write_pipe_bytes(fd, &(ip.num_dims), sizeof(int)) || !write_pipe_bytes(fd, &num_sets, sizeof(int))) { // Write the number of dimensions, i.e. parameters per set, and the number of sets being sent
+		return false;
+	}
+	for (int i = 0; i < num_sets; i++) {
+		if (!write_pipe_bytes(fd, sets[i], sizeof(double) * ip.num_dims)) {
+			return false;
+		}
+	}
+	return true;
+}
+
 /* write_pipe_int writes the given integer to the given pipe
 	parameters:
 		fd: the file descriptor of the pipe to write to
@@ -298,12 +487,37 @@ void write_pipe (int fd, double parameters[]) {
 	todo:
 */
 void write_pipe_int (int fd, int value) {
-	if (write(fd, &value, sizeof(int)) == -1) {
+	if (!write_pipe_bytes(fd, &value, sizeof(int))) {
 		term->failed_pipe_write();
 		exit(EXIT_PIPE_WRITE_ERROR);
 	}
 }
 
+/* write_pipe_bytes writes the given number of bytes to the given pipe, continuing after partial writes
+	parameters:
+		fd: the file descriptor of the pipe to write to
+		bytes: a pointer to the bytes to write
+		size: the number of bytes to write
+	returns: true if every byte was written, false otherwise
+	notes:
+	todo:
+*/
+bool write_pipe_bytes (int fd, const void* bytes, size_t size) {
+	const char* cur = (const char*)bytes;
+	while (size > 0) {
+		ssize_t written = write(fd, cur, size);
+		if (written == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+		cur += written;
+		size -= written;
+	}
+	return true;
+}
+
 /* read_pipe reads the maximum score and the received score from the given pipe
 	parameters:
 		fd: the file descriptor of the pipe to write to
@@ -314,8 +528,61 @@ void write_pipe_int (int fd, int value) {
 	todo:
 */
 void read_pipe (int fd, int* max_score, int* score) {
-	read_pipe_int(fd, max_score);
-	read_pipe_int(fd, score);
+	if (!try_read_pipe(fd, max_score, score)) {
+		term->failed_pipe_read();
+		exit(EXIT_PIPE_READ_ERROR);
+	}
+}
+
+/* try_read_pipe reads the maximum score and the received score from the given pipe without exiting on failure
+	parameters:
+		fd: the file descriptor of the pipe to write to
+		max_score: a pointer to store the maximum score the simulation could have received
+		score: a pointer to store the score the simulation actually received
+	returns: true if both scores were read, false if the pipe failed or the simulation closed it first
+	notes:
+	todo:
+*/
+bool try_read_pipe (int fd, int* max_score, int* score) {
+	return read_pipe_bytes(fd, max_score, sizeof(int)) && read_pipe_bytes(fd, score, sizeof(int));
+}
+
+/* read_scores reads the score of every set in a batch from the given pipe
+	parameters:
+		fd: the file descriptor of the pipe to read from
+		num_sets: the number of parameter sets in the batch
+		scores: the array to store each set's score in
+	returns: nothing
+	notes:
+	todo:
+*/
+void read_scores (int fd, int num_sets, double scores[]) {
+	if (!try_read_scores(fd, num_sets, scores)) {
+		term->failed_pipe_read();
+		exit(EXIT_PIPE_READ_ERROR);
+	}
+}
+
+/* try_read_scores reads the score of every set in a batch from the given pipe without exiting on failure
+	parameters:
+		fd: the file descriptor of the pipe to read from
+		num_sets: the number of parameter sets in the batch
+		scores: the array to store each set's score in
+	returns: true if every score was read, false if the pipe failed or the simulation closed it first
+	notes:
+		The simulation replies with one (maximum score, score) pair per set, in the order the sets were sent.
+	todo:
+*/
+bool try_read_scores (int fd, int num_sets, double scores[]) {
+	for (int i = 0; i < num_sets; i++) {
+		int max_score;
+		int score;
+		if (!try_read_pipe(fd, &max_score, &score)) {
+			return false;
+		}
+		scores[i] = convert_score(max_score, score);
+	}
+	return true;
 }
 
 /* read_pipe_int writes an integer from the given pipe
@@ -327,12 +594,40 @@ void read_pipe (int fd, int* max_score, int* score) {
 	todo:
 */
 void read_pipe_int (int fd, int* address) {
-	if (read(fd, address, sizeof(int)) == -1) {
+	if (!read_pipe_bytes(fd, address, sizeof(int))) {
 		term->failed_pipe_read();
 		exit(EXIT_PIPE_READ_ERROR);
 	}
 }
 
+/* read_pipe_bytes reads the given number of bytes from the given pipe, continuing after partial reads
+	parameters:
+		fd: the file descriptor of the pipe to read from
+		bytes: a pointer to store the bytes read
+		size: the number of bytes to read
+	returns: true if every byte was read, false if the pipe failed or was closed first
+	notes:
+	todo:
+*/
+bool read_pipe_bytes (int fd, void* bytes, size_t size) {
+	char* cur = (char*)bytes;
+	while (size > 0) {
+		ssize_t received = read(fd, cur, size);
+		if (received == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+		if (received == 0) {
+			return false;
+		}
+		cur += received;
+		size -= received;
+	}
+	return true;
+}
+
 /* close_if_open closes the given output file stream if it is open
 	parameters:
 		file: a pointer to the output file stream to close
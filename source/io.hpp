@@ -26,14 +26,30 @@ io.hpp contains function declarations for io.cpp.
 #include "structs.hpp"
 
 void store_filename(char**, const char*);
-void read_file(input_data*);
-void parse_ranges_file (char*, input_params&, sres_params&);
+bool read_file(input_data*);
+bool parse_ranges_file (char*, input_params&, sres_params&);
 void open_file(ofstream*, char*, bool);
 double simulate_set(double[]);
-void write_pipe(int, double[]);
+void simulate_sets(double*[], int, double[]);
+pid_t start_simulation(int*, int*);
+int raise_fd(int);
+void wait_simulation(pid_t);
+double monotonic_time();
+void record_latency(double, int);
+double sim_deadline(double, int);
+void penalize_sets(double[], int);
+void exit_failed_simulation(bool, bool);
+double convert_score(int, int);
+void write_pipe(int, double*[], int);
+bool try_write_pipe(int, double*[], int);
 void write_pipe_int(int, int);
+bool write_pipe_bytes(int, const void*, size_t);
 void read_pipe(int, int*, int*);
+bool try_read_pipe(int, int*, int*);
+void read_scores(int, int, double[]);
+bool try_read_scores(int, int, double[]);
 void read_pipe_int(int, int*);
+bool read_pipe_bytes(int, void*, size_t);
 void close_if_open(ofstream&);
 
 #endif
@@ -0,0 +1,352 @@
+/*
+Stochastically ranked evolutionary strategy sampler for zebrafish segmentation
+Copyright (C) 2013 Ahmet Ay, Jack Holland, Adriana Sperlea, Sebastian Sangervasi
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+island.cpp contains functions for the island model, where the MPI processes are split into islands that each evolve their own population and every so often send their best individual to another island.
+Migration never waits: migrants are sent with MPI_Isend and taken in whenever they have arrived, so islands running at different speeds do not hold each other up.
+*/
+
+// Include MPI if compiled with it
+#if defined(MPI)
+	#undef MPI // MPI uses this macro as well, so temporarily undefine it
+	#include <mpi.h> // Needed for MPI_Comm_split, MPI_Isend, MPI_Iprobe, MPI_Gather
+	#define MPI // The MPI macro should be checked only for definition, not value
+#endif
+
+#include <cmath> // Needed for HUGE_VAL
+#include <cstdlib> // Needed for rand_r
+
+#include "island.hpp" // Function declarations
+
+#include "macros.hpp"
+#include "sres.hpp"
+
+extern terminal* term; // Declared in init.cpp
+
+#if defined(MPI)
+	sim_islands* islands = NULL; // The global island model, NULL when every process works on one population
+#endif
+
+/* init_islands splits the MPI processes into the number of islands the user wants and points libSRES at this process's island
+	parameters:
+		ip: the program's input parameters
+	returns: nothing
+	notes:
+		Islands are contiguous blocks of ranks, so island 0's leader is rank 0 of MPI_COMM_WORLD and prints the run's progress as usual.
+		Each island seeds libSRES with the user's seed plus its index so the islands explore differently.
+		This function must be called before init_sres since libSRES evaluates the initial population while initializing.
+	todo:
+*/
+void init_islands (input_params& ip) {
+	#if defined(MPI)
+		if (ip.num_islands <= 1) {
+			return;
+		}
+		int rank = get_rank();
+		int num_procs;
+		MPI_Comm_size(MPI_COMM_WORLD, &num_procs);
+		if (ip.num_islands > num_procs) {
+			if (rank == 0) {
+				term->failed_islands();
+			}
+			exit(EXIT_INPUT_ERROR);
+		}
+	
+		int island = (int)((long)rank * ip.num_islands / num_procs);
+		islands = new sim_islands(island, ip.num_islands);
+		MPI_Comm_split(MPI_COMM_WORLD, island, rank, &(islands->comm));
+		int island_rank;
+		MPI_Comm_rank(islands->comm, &island_rank);
+		MPI_Comm_split(MPI_COMM_WORLD, island_rank == 0 ? 0 : MPI_UNDEFINED, rank, &(islands->leaders));
+		esMPIComm = islands->comm;
+	
+		ip.seed += island;
+		islands->topology_seed = ip.seed;
+	
+		ostream& v = term->verbose();
+		term->rank(rank, v);
+		v << term->blue << "Joined island " << term->reset << island << term->blue << " of " << term->reset << ip.num_islands << endl;
+	#endif
+}
+
+/* free_islands frees the island communicators and points libSRES back at every process
+	parameters:
+	returns: nothing
+	notes:
+		merge_islands must be called before this function so no migrant is still in flight.
+	todo:
+*/
+void free_islands () {
+	#if defined(MPI)
+		if (islands == NULL) {
+			return;
+		}
+		esMPIComm = MPI_COMM_WORLD;
+		if (islands->leaders != MPI_COMM_NULL) {
+			MPI_Comm_free(&(islands->leaders));
+		}
+		MPI_Comm_free(&(islands->comm));
+		delete islands;
+		islands = NULL;
+	#endif
+}
+
+/* migrate takes in the migrants that have arrived at this island and, every migration interval, sends this island's best individual to another island
+	parameters:
+		ip: the program's input parameters
+		sp: parameters required by libSRES
+	returns: nothing
+	notes:
+		This function should be called after every generation; it does nothing on processes that are not an island's leader.
+	todo:
+*/
+void migrate (input_params& ip, sres_params& sp) {
+	#if defined(MPI)
+		if (islands == NULL || islands->leaders == MPI_COMM_NULL) {
+			return;
+		}
+		receive_migrants(sp, true);
+		if (sp.stats->curgen % ip.migration_interval == 0 && sp.stats->bestindvdl != NULL) {
+			send_migrant(ip, sp);
+		}
+	#endif
+}
+
+#if defined(MPI)
+/* migrant_size calculates the number of doubles in a migrant message
+	parameters:
+		param: libSRES's parameters
+	returns: the size of a migrant, i.e. f, phi, g[constraint], op[dim] and sp[dim]
+	notes:
+	todo:
+*/
+int migrant_size (ESParameter* param) {
+	return 2 + param->constraint + 2 * param->dim;
+}
+
+/* send_migrant sends a copy of this island's best individual to the next island of the user's topology without waiting for it to arrive
+	parameters:
+		ip: the program's input parameters
+		sp: parameters required by libSRES
+	returns: nothing
+	notes:
+		Migrants that have arrived are freed first, so only migrants still in flight take up memory.
+	todo:
+*/
+void send_migrant (input_params& ip, sres_params& sp) {
+	ESParameter* param = sp.param;
+	ESIndividual* best = sp.stats->bestindvdl;
+	int size = migrant_size(param);
+	
+	// Free the migrants that have been delivered, keeping the rest at the front of the arrays
+	int kept = 0;
+	for (int i = 0; i < islands->num_sends; i++) {
+		int delivered;
+		MPI_Test(&(islands->sends[i]), &delivered, MPI_STATUS_IGNORE);
+		if (delivered) {
+			mfree(islands->migrants[i]);
+		} else {
+			islands->sends[kept] = islands->sends[i];
+			islands->migrants[kept] = islands->migrants[i];
+			kept++;
+		}
+	}
+	islands->num_sends = kept;
+	if (islands->num_sends == islands->max_sends) {
+		grow_sends();
+	}
+	
+	// Pack the individual
+	double* migrant = (double*)mallocate(sizeof(double) * size);
+	migrant[0] = best->f;
+	migrant[1] = best->phi;
+	memcpy(migrant + 2, best->g, sizeof(double) * param->constraint);
+	memcpy(migrant + 2 + param->constraint, best->op, sizeof(double) * param->dim);
+	memcpy(migrant + 2 + param->constraint + param->dim, best->sp, sizeof(double) * param->dim);
+	
+	// Pick the destination and send
+	int dest;
+	if (ip.topology == TOPOLOGY_RING) {
+		dest = (islands->island + 1) % islands->num_islands;
+	} else {
+		dest = rand_r(&(islands->topology_seed)) % (islands->num_islands - 1);
+		if (dest >= islands->island) {
+			dest++;
+		}
+	}
+	MPI_Isend(migrant, size, MPI_DOUBLE, dest, MIGRANT_TAG, islands->leaders, &(islands->sends[islands->num_sends]));
+	islands->migrants[islands->num_sends] = migrant;
+	islands->num_sends++;
+	islands->sent[dest]++;
+	islands->emigrated++;
+}
+
+/* grow_sends doubles the room for migrants in flight
+	parameters:
+	returns: nothing
+	notes:
+	todo:
+*/
+void grow_sends () {
+	int max_sends = islands->max_sends == 0 ? 4 : islands->max_sends * 2;
+	MPI_Request* sends = (MPI_Request*)mallocate(sizeof(MPI_Request) * max_sends);
+	double** migrants = (double**)mallocate(sizeof(double*) * max_sends);
+	for (int i = 0; i < islands->num_sends; i++) {
+		sends[i] = islands->sends[i];
+		migrants[i] = islands->migrants[i];
+	}
+	mfree(islands->sends);
+	mfree(islands->migrants);
+	islands->sends = sends;
+	islands->migrants = migrants;
+	islands->max_sends = max_sends;
+}
+
+/* receive_migrants receives every migrant that has arrived at this island without waiting for more
+	parameters:
+		sp: parameters required by libSRES
+		take_in: whether to put the migrants into the population or just receive them
+	returns: the number of migrants received
+	notes:
+	todo:
+*/
+int receive_migrants (sres_params& sp, bool take_in) {
+	int size = migrant_size(sp.param);
+	double* migrant = (double*)mallocate(sizeof(double) * size);
+	int received = 0;
+	int arrived;
+	MPI_Iprobe(MPI_ANY_SOURCE, MIGRANT_TAG, islands->leaders, &arrived, MPI_STATUS_IGNORE);
+	while (arrived) {
+		MPI_Recv(migrant, size, MPI_DOUBLE, MPI_ANY_SOURCE, MIGRANT_TAG, islands->leaders, MPI_STATUS_IGNORE);
+		if (take_in) {
+			take_in_migrant(sp, migrant);
+		}
+		received++;
+		MPI_Iprobe(MPI_ANY_SOURCE, MIGRANT_TAG, islands->leaders, &arrived, MPI_STATUS_IGNORE);
+	}
+	mfree(migrant);
+	return received;
+}
+
+/* take_in_migrant replaces the worst individual of this island's population with the given migrant
+	parameters:
+		sp: parameters required by libSRES
+		migrant: the migrant, packed as send_migrant packs it
+	returns: nothing
+	notes:
+		The population holds the generation's evaluated offspring at this point, so the migrant is ranked with them at the start of the next generation.
+	todo:
+*/
+void take_in_migrant (sres_params& sp, double* migrant) {
+	ESParameter* param = sp.param;
+	ESPopulation* population = sp.population;
+	int worst = 0;
+	for (int i = 1; i < param->lambda; i++) {
+		if (population->phi[i] > population->phi[worst] || (population->phi[i] == population->phi[worst] && population->f[i] > population->f[worst])) {
+			worst = i;
+		}
+	}
+	
+	ESIndividual* member = population->member[worst];
+	member->f = migrant[0];
+	member->phi = migrant[1];
+	memcpy(member->g, migrant + 2, sizeof(double) * param->constraint);
+	memcpy(member->op, migrant + 2 + param->constraint, sizeof(double) * param->dim);
+	memcpy(member->sp, migrant + 2 + param->constraint + param->dim, sizeof(double) * param->dim);
+	population->f[worst] = member->f;
+	population->phi[worst] = member->phi;
+	islands->immigrated++;
+}
+
+#endif
+
+/* merge_islands waits for every migrant still in flight and prints the best individual of every island and of the whole run
+	parameters:
+		sp: parameters required by libSRES
+	returns: nothing
+	notes:
+		The leaders learn how many migrants were sent to them in total, so each one receives exactly the migrants still on their way before anything is freed.
+		The merged report is printed by rank 0 of MPI_COMM_WORLD in libSRES's statistics format, with island 0's statistics replaced by the best island's.
+	todo:
+*/
+void merge_islands (sres_params& sp) {
+	#if defined(MPI)
+		if (islands == NULL || islands->leaders == MPI_COMM_NULL) {
+			return;
+		}
+	
+		// Receive the migrants still on their way and wait for this island's to arrive
+		int expected;
+		MPI_Reduce_scatter_block(islands->sent, &expected, 1, MPI_INT, MPI_SUM, islands->leaders);
+		int remaining = expected - islands->immigrated;
+		while (remaining > 0) {
+			remaining -= receive_migrants(sp, false);
+		}
+		MPI_Waitall(islands->num_sends, islands->sends, MPI_STATUSES_IGNORE);
+		for (int i = 0; i < islands->num_sends; i++) {
+			mfree(islands->migrants[i]);
+		}
+		islands->num_sends = 0;
+	
+		// Gather every island's best individual and migration counts
+		ESParameter* param = sp.param;
+		ESStatistics* stats = sp.stats;
+		int size = 5 + param->dim;
+		double* summary = (double*)mallocate(sizeof(double) * size);
+		summary[0] = stats->bestindvdl != NULL ? stats->bestindvdl->f : HUGE_VAL;
+		summary[1] = stats->bestindvdl != NULL ? stats->bestindvdl->phi : HUGE_VAL;
+		summary[2] = stats->bestgen;
+		summary[3] = islands->emigrated;
+		summary[4] = islands->immigrated;
+		if (stats->bestindvdl != NULL) {
+			memcpy(summary + 5, stats->bestindvdl->op, sizeof(double) * param->dim);
+		}
+		int leader;
+		MPI_Comm_rank(islands->leaders, &leader);
+		double* summaries = leader == 0 ? (double*)mallocate(sizeof(double) * size * islands->num_islands) : NULL;
+		MPI_Gather(summary, size, MPI_DOUBLE, summaries, size, MPI_DOUBLE, 0, islands->leaders);
+		mfree(summary);
+		if (leader != 0 || stats->bestindvdl == NULL) {
+			mfree(summaries);
+			return;
+		}
+	
+		// Print each island's best fitness and then the best island's statistics
+		int best = 0;
+		long emigrated = 0;
+		long immigrated = 0;
+		for (int i = 0; i < islands->num_islands; i++) {
+			double* island = summaries + size * i;
+			cout << term->blue << "Island " << term->reset << i << term->blue << ": best fitness " << term->reset << island[0] << term->blue << " in generation " << term->reset << (int)island[2] << endl;
+			if (island[1] < summaries[size * best + 1] || (island[1] == summaries[size * best + 1] && island[0] < summaries[size * best])) {
+				best = i;
+			}
+			emigrated += (long)island[3];
+			immigrated += (long)island[4];
+		}
+		cout << term->blue << "Migrants: " << term->reset << emigrated << term->blue << " sent, " << term->reset << immigrated << term->blue << " taken in, best island: " << term->reset << best << endl;
+		double* island = summaries + size * best;
+		stats->bestindvdl->f = island[0];
+		stats->bestindvdl->phi = island[1];
+		stats->bestgen = (int)island[2];
+		memcpy(stats->bestindvdl->op, island + 5, sizeof(double) * param->dim);
+		ESPrintStat(stats, param);
+		mfree(summaries);
+	#endif
+}
+
@@ -0,0 +1,42 @@
+/*
+Stochastically ranked evolutionary strategy sampler for zebrafish segmentation
+Copyright (C) 2013 Ahmet Ay, Jack Holland, Adriana Sperlea, Sebastian Sangervasi
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+island.hpp contains function declarations for island.cpp.
+*/
+
+#ifndef ISLAND_HPP
+#define ISLAND_HPP
+
+#include "structs.hpp"
+
+void init_islands(input_params&);
+void free_islands();
+void migrate(input_params&, sres_params&);
+void merge_islands(sres_params&);
+#if defined(MPI)
+extern sim_islands* islands; // Declared in island.cpp
+
+int migrant_size(ESParameter*);
+void send_migrant(input_params&, sres_params&);
+void grow_sends();
+int receive_migrants(sres_params&, bool);
+void take_in_migrant(sres_params&, double*);
+#endif
+
+#endif
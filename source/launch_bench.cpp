@@ -0,0 +1,213 @@
+/*
+Stochastically ranked evolutionary strategy sampler for zebrafish segmentation
+Copyright (C) 2013 Ahmet Ay, Jack Holland, Adriana Sperlea, Sebastian Sangervasi
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+launch_bench.cpp contains a benchmark of how long launching a simulation takes against how much memory the sampler uses, comparing the fork and execv start_simulation used to launch with against the posix_spawn it launches with now.
+It is built only on request with 'scons bench=1', or by hand with:
+	g++ -O2 source/launch_bench.cpp -o launch-bench
+Run it as 'launch-bench [launches] [program] [MB ...]', e.g. 'launch-bench 200 /bin/true 16 256 1024 2048', where every MB is a resident set size the benchmark grows to before timing the launches at it.
+*/
+
+#include <fcntl.h> // Needed for O_CLOEXEC
+#include <signal.h> // Needed for sigset_t
+#include <spawn.h> // Needed for posix_spawn
+#include <stdio.h> // Needed for printf
+#include <stdlib.h> // Needed for malloc, atoi, atol
+#include <string.h> // Needed for memset, strerror
+#include <sys/wait.h> // Needed for waitpid
+#include <time.h> // Needed for clock_gettime
+#include <unistd.h> // Needed for fork, execv, pipe2, dup2, close, access
+
+#include "macros.hpp"
+
+#define BENCH_DEFAULT_LAUNCHES 200
+#define BENCH_MAX_SIZES 64
+
+static const size_t default_sizes[] = {16, 256, 1024, 2048}; // The resident set sizes in MB swept when none are given
+
+/* bench_now gets the current time
+	parameters:
+	returns: the number of seconds since an arbitrary point, monotonically increasing
+	notes:
+	todo:
+*/
+static double bench_now () {
+	timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/* open_pipes creates the two pipes start_simulation creates for every simulation
+	parameters:
+		pipe_sets: the pipe the parameter sets go through
+		pipe_scores: the pipe the scores come back through
+	returns: nothing
+	notes:
+	todo:
+*/
+static void open_pipes (int pipe_sets[2], int pipe_scores[2]) {
+	if (pipe2(pipe_sets, O_CLOEXEC) == -1 || pipe2(pipe_scores, O_CLOEXEC) == -1) {
+		perror("launch-bench could not create a pipe");
+		exit(EXIT_FAILURE);
+	}
+}
+
+/* close_pipes closes both pipes once the simulation has exited
+	parameters:
+		pipe_sets: the pipe the parameter sets go through
+		pipe_scores: the pipe the scores come back through
+	returns: nothing
+	notes:
+	todo:
+*/
+static void close_pipes (int pipe_sets[2], int pipe_scores[2]) {
+	close(pipe_sets[0]);
+	close(pipe_sets[1]);
+	close(pipe_scores[0]);
+	close(pipe_scores[1]);
+}
+
+/* launch_fork launches the program the way start_simulation did before posix_spawn, with fork, moving the pipes in the child and execv, and waits for it to exit
+	parameters:
+		program: the path of the program to launch
+		args: the program's arguments
+	returns: nothing
+	notes:
+		fork copies the sampler's page tables, so this gets slower the more memory the sampler uses.
+	todo:
+*/
+static void launch_fork (const char* program, char** args) {
+	int pipe_sets[2];
+	int pipe_scores[2];
+	open_pipes(pipe_sets, pipe_scores);
+	pid_t pid = fork();
+	if (pid == -1) {
+		perror("launch-bench could not fork");
+		exit(EXIT_FAILURE);
+	}
+	if (pid == 0) {
+		if (dup2(pipe_sets[0], SIM_PIPE_IN_FD) == -1 || dup2(pipe_scores[1], SIM_PIPE_OUT_FD) == -1) {
+			_exit(127);
+		}
+		execv(program, args);
+		_exit(127);
+	}
+	waitpid(pid, NULL, 0);
+	close_pipes(pipe_sets, pipe_scores);
+}
+
+/* launch_spawn launches the program the way start_simulation does, with posix_spawn and the same file actions and attributes, and waits for it to exit
+	parameters:
+		program: the path of the program to launch
+		args: the program's arguments
+	returns: nothing
+	notes:
+	todo:
+*/
+static void launch_spawn (const char* program, char** args) {
+	int pipe_sets[2];
+	int pipe_scores[2];
+	open_pipes(pipe_sets, pipe_scores);
+	posix_spawn_file_actions_t actions;
+	posix_spawnattr_t attributes;
+	sigset_t no_signals;
+	sigset_t default_signals;
+	sigemptyset(&no_signals);
+	sigemptyset(&default_signals);
+	sigaddset(&default_signals, SIGPIPE);
+	posix_spawn_file_actions_init(&actions);
+	posix_spawnattr_init(&attributes);
+	posix_spawn_file_actions_adddup2(&actions, pipe_sets[0], SIM_PIPE_IN_FD);
+	posix_spawn_file_actions_adddup2(&actions, pipe_scores[1], SIM_PIPE_OUT_FD);
+	posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+	posix_spawnattr_setsigmask(&attributes, &no_signals);
+	posix_spawnattr_setsigdefault(&attributes, &default_signals);
+	pid_t pid;
+	int error = posix_spawn(&pid, program, &actions, &attributes, args, environ);
+	posix_spawn_file_actions_destroy(&actions);
+	posix_spawnattr_destroy(&attributes);
+	if (error != 0) {
+		fprintf(stderr, "launch-bench could not spawn %s: %s\n", program, strerror(error));
+		exit(EXIT_FAILURE);
+	}
+	waitpid(pid, NULL, 0);
+	close_pipes(pipe_sets, pipe_scores);
+}
+
+/* bench_launches times launching the program the given number of times
+	parameters:
+		launch: launch_fork or launch_spawn
+		program: the path of the program to launch
+		args: the program's arguments
+		launches: the number of times to launch it
+	returns: the number of microseconds a launch took on average, including waiting for the program to exit
+	notes:
+	todo:
+*/
+static double bench_launches (void (*launch)(const char*, char**), const char* program, char** args, int launches) {
+	double start = bench_now();
+	for (int i = 0; i < launches; i++) {
+		launch(program, args);
+	}
+	return (bench_now() - start) * 1e6 / launches;
+}
+
+/* main grows the resident set to every given size in turn and times both ways of launching at it
+	parameters:
+		argc: the number of command-line arguments
+		argv: the array of command-line arguments, optionally the number of launches, the program and the sizes in MB
+	returns: 0 on success, a positive integer on failure
+	notes:
+	todo:
+*/
+int main (int argc, char** argv) {
+	int launches = argc > 1 ? atoi(argv[1]) : BENCH_DEFAULT_LAUNCHES;
+	const char* program = argc > 2 ? argv[2] : "/bin/true";
+	size_t sizes[BENCH_MAX_SIZES];
+	int num_sizes = 0;
+	if (argc > 3) {
+		for (int i = 3; i < argc && num_sizes < BENCH_MAX_SIZES; i++) {
+			sizes[num_sizes++] = atol(argv[i]);
+		}
+	} else {
+		for (size_t i = 0; i < sizeof(default_sizes) / sizeof(default_sizes[0]); i++) {
+			sizes[num_sizes++] = default_sizes[i];
+		}
+	}
+	if (launches < 1 || access(program, X_OK) == -1) {
+		fprintf(stderr, "usage: launch-bench [launches] [program] [MB ...]\n");
+		return EXIT_FAILURE;
+	}
+
+	char* args[] = {(char*)program, NULL};
+	printf("%10s %18s %18s\n", "RSS (MB)", "fork+execv (us)", "posix_spawn (us)");
+	for (int i = 0; i < num_sizes; i++) {
+		// Touch every page of the size so it counts toward the resident set, as the sampler's population and caches do
+		char* memory = (char*)malloc(sizes[i] << 20);
+		if (memory == NULL) {
+			fprintf(stderr, "launch-bench could not allocate %zu MB\n", sizes[i]);
+			return EXIT_FAILURE;
+		}
+		memset(memory, 1, sizes[i] << 20);
+		double fork_time = bench_launches(launch_fork, program, args, launches);
+		double spawn_time = bench_launches(launch_spawn, program, args, launches);
+		printf("%10zu %18.0f %18.0f\n", sizes[i], fork_time, spawn_time);
+		free(memory);
+	}
+	return 0;
+}
@@ -26,6 +26,68 @@ macros.hpp contains every constant and macro function used in the program.
 // The number of implicit arguments sent to the simulation
 #define NUM_IMPLICIT_SIM_ARGS 6
 
+// The file descriptors every simulation receives its ends of the pipes on, so its arguments can be built once
+#define SIM_PIPE_IN_FD 3
+#define SIM_PIPE_OUT_FD 4
+
+// The number of constraints libSRES checks each parameter set against
+#define NUM_CONSTRAINTS 0
+
+// How the fitness cache matches parameter sets
+#define MEMOIZE_NONE 0 // No cache
+#define MEMOIZE_EXACT 1 // Sets match when every parameter has the same bit pattern
+#define MEMOIZE_ROUNDED 2 // Sets match when every parameter rounds to the same value at the printing precision
+
+// The first bytes of an evaluation store file and of each of its records
+#define STORE_MAGIC "SRESLOG1"
+#define STORE_MAGIC_SIZE 8
+#define STORE_RECORD_MAGIC 0x52534552
+
+// The phases of a run evaluations are counted toward
+#define EVAL_PHASE_INIT 0 // Evaluating the initial population
+#define EVAL_PHASE_GENERATION 1 // Evaluating the offspring of a generation
+
+// What happens to a simulation that crashes or times out
+#define FAILURE_EXIT 0 // Stop the sampler
+#define FAILURE_RETRY 1 // Simulate the sets again, up to MAX_SIM_RETRIES times, and then give them the penalty
+#define FAILURE_PENALTY 2 // Give the sets the penalty fitness
+
+// The number of times a crashed or timed out simulation's sets are simulated again with the retry policy
+#define MAX_SIM_RETRIES 2
+
+// The fitness given to sets whose simulation failed, which is worse than any score a simulation can report (1 - score / max_score is at most 1)
+#define PENALTY_FITNESS 2.0
+
+// The number of recent per-set simulation times kept for adaptive timeouts, and how many must be seen before the adaptive timeout applies
+#define LATENCY_SAMPLES 1024
+#define MIN_LATENCY_SAMPLES 20
+
+// Which island an island sends its migrants to
+#define TOPOLOGY_RING 0 // The next island, wrapping around
+#define TOPOLOGY_RANDOM 1 // Any other island, picked again for every migration
+
+// The MPI tag of a message carrying a migrant between islands
+#define MIGRANT_TAG 1
+
+// Which of a job's file descriptors an epoll event of the supervisor is for
+#define JOB_FD_SCORES 0 // The pipe scores are read from
+#define JOB_FD_EXIT 1 // The pidfd that becomes readable when the simulation exits
+#define JOB_FD_SETS 2 // The pipe parameter sets are written to
+
+// The number of times a persistent simulation worker is restarted for the same parameter set before giving up
+#define MAX_WORKER_RESTARTS 2
+
+// The size classes of the memory pool: blocks up to MEM_MAX_CLASS_SIZE bytes are pooled, larger ones come from malloc
+#define MEM_NUM_CLASSES 28
+#define MEM_MAX_CLASS_SIZE 4096
+// MEM_BATCH and MEM_CHUNK_SIZE can be overridden with -D to re-check them with memory-bench (see memory_bench.cpp)
+#ifndef MEM_BATCH
+	#define MEM_BATCH 32 // The number of blocks a thread takes from or gives back to the shared free lists at once
+#endif
+#ifndef MEM_CHUNK_SIZE
+	#define MEM_CHUNK_SIZE 65536 // The number of bytes requested from malloc when a size class runs out of blocks
+#endif
+
 // Exit statuses
 #define EXIT_SUCCESS			0
 #define EXIT_MEMORY_ERROR		1
@@ -39,6 +101,7 @@ macros.hpp contains every constant and macro function used in the program.
 #define EXIT_EXEC_ERROR			9
 #define EXIT_CHILD_ERROR		10
 #define EXIT_INPUT_ERROR		11
+#define EXIT_PLUGIN_ERROR		12
 
 // Macros for commonly used functions small enough to inject directly into the code
 #define SQUARE(x) ((x) * (x))
@@ -30,9 +30,15 @@ Avoid putting functions in main.cpp that could be put in a more specific file.
 
 #include "main.hpp" // Function declarations
 
+#include "cache.hpp"
 #include "init.hpp"
+#include "island.hpp"
 #include "macros.hpp"
+#include "plugin.hpp"
+#include "pool.hpp"
 #include "sres.hpp"
+#include "store.hpp"
+#include "supervisor.hpp"
 
 using namespace std;
 
@@ -63,6 +69,13 @@ int main (int argc, char** argv) {
 	check_input_params(ip);
 	init_verbosity(ip);
 	init_sim_args(ip);
+	init_sim_file(ip);
+	init_cache(ip);
+	init_store(ip);
+	init_plugin(ip);
+	init_pool(ip);
+	init_supervisor(ip);
+	init_islands(ip);
 	
 	// Read the specified input files
 	input_data ranges_data(ip.ranges_file);
@@ -73,9 +86,17 @@ int main (int argc, char** argv) {
 	init_sres(ip, sp);
 	
 	// Run libSRES
-	run_sres(sp);
+	run_sres(ip, sp);
+	merge_islands(sp);
+	print_evaluations();
 	
 	// Free used memory, wrap up libSRES, etc.
+	free_cache();
+	free_store();
+	free_plugin();
+	free_pool();
+	free_supervisor();
+	free_islands();
 	free_sres(sp);
 	#if defined(MEMTRACK)
 		print_heap_usage();
@@ -110,10 +131,24 @@ void usage (const char* message) {
 	cout << "-g, --generations        [int]        : the number of generations to run before returning results, min=1, default=1750" << endl;
 	cout << "-s, --seed               [int]        : the seed used in the evolutionary strategy (not simulations), min=1, default=time" << endl;
 	cout << "-e, --printing-precision [int]        : how many digits of precision parameters should be printed with, min=1, default=6" << endl;
+	cout << "-o, --plugin             [filename]   : the relative filename of a shared library implementing sres_plugin.h to call instead of the simulation, default=none" << endl;
+	cout << "-m, --memoize            [string]     : reuse the score of a parameter set seen before, none=never, exact=if every parameter is identical, rounded=if every parameter prints identically, default=none" << endl;
+	cout << "-S, --store              [filename]   : the relative filename of a file of scores to reuse and add to, shared between runs and processes using the same simulation and arguments, default=none" << endl;
+	cout << "-t, --timeout            [float]      : the number of seconds a simulation may take per parameter set before it is killed, 0=no limit, min=0, default=0" << endl;
+	cout << "-k, --timeout-factor     [float]      : kill a simulation taking longer than this many times the 99th percentile of recent simulation times per set, 0=no limit, min=0, default=0" << endl;
+	cout << "-F, --on-failure         [string]     : what to do when a simulation crashes or times out, exit=stop the sampler, retry=simulate the sets again up to 2 times and then penalize them, penalty=give the sets the worst fitness, default=exit" << endl;
+	cout << "-i, --islands            [int]        : the number of islands to split the MPI processes into, each evolving its own population and exchanging its best individual with the others, min=1, default=1" << endl;
+	cout << "-M, --migration-interval [int]        : the number of generations between an island's migrations, min=1, default=10" << endl;
+	cout << "-T, --topology           [string]     : which island an island's migrants go to, ring=the next island, random=any other island, default=ring" << endl;
+	cout << "-w, --workers            [int]        : the number of simulations to keep alive and reuse for every parameter set, 0=launch one per set, min=0, default=0" << endl;
+	cout << "-j, --jobs               [int]        : the number of simulations to run at once when not using workers, or the number of threads calling the plugin, min=1, default=1" << endl;
+	cout << "-b, --batch-size         [int]        : the number of parameter sets to send to a simulation at once, 0=a whole generation split evenly between the jobs or workers, min=0, default=1" << endl;
 	cout << "-a, --arguments          [N/A]        : every argument following this will be sent to the simulation" << endl;
+	cout << "-A, --steady-state       [N/A]        : evolve one offspring at a time, launching a new one whenever a simulation finishes instead of waiting for the whole generation, default=unused" << endl;
 	cout << "-c, --no-color           [N/A]        : disable coloring the terminal output, default=unused" << endl;
 	cout << "-v, --verbose            [N/A]        : print detailed messages about the program state" << endl;
 	cout << "-q, --quiet              [N/A]        : hide the terminal output, default=unused" << endl;
+	cout << "-u, --memory-usage       [N/A]        : track heap usage by category and print it after every generation and its peak at exit (requires compiling with memtrack=1), default=unused" << endl;
 	cout << "-l, --licensing          [N/A]        : view licensing information (no simulations will be run)" << endl;
 	cout << "-h, --help               [N/A]        : view usage information (i.e. this)" << endl;
 	cout << endl << term->blue << "Example: ./sres-sampler " << term->reset << endl << endl;
@@ -19,8 +19,11 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 /*
 memory.cpp contains functions related to memory management. All memory related functions should be placed in this file.
 Many features and functions are enabled only when scons-compiling with 'memtrack=1', which defines the MEMTRACK macro used for memory tracking.
+Blocks of up to MEM_MAX_CLASS_SIZE bytes come from a thread-caching memory pool unless scons-compiling with 'pool=0', which leaves out the MEMPOOL macro.
 */
 
+#include <new> // Needed for placement new
+
 #include "memory.hpp" // Function declarations
 
 #include "macros.hpp"
@@ -28,40 +31,331 @@ Many features and functions are enabled only when scons-compiling with 'memtrack
 
 extern terminal* term; // Declared in init.cpp
 
-// Variables the memory tracker uses to keep track of heap usage
+// Variables the memory tracker uses to keep track of heap usage, which are only changed atomically since any thread can allocate
 #if defined(MEMTRACK)
+	bool heap_tracking = false; // Whether or not the user asked for tracking, which is the only cost of the memory tracker otherwise
 	size_t heap_current = 0;
 	size_t heap_total = 0;
+	size_t heap_peak = 0; // The most heap_current has ever been
+	size_t tag_current[MEM_NUM_TAGS]; // heap_current split by category
+	size_t tag_peak[MEM_NUM_TAGS]; // The most each category has ever used
+	static __thread int current_tag = MEM_TAG_OTHER; // The category the calling thread's allocations are counted toward
+#endif
+
+// Variables the memory pool uses to share free blocks between threads, which are constant-initialized so operator new works before any constructor runs
+#if defined(MEMPOOL)
+	static const size_t class_sizes[MEM_NUM_CLASSES] = {16, 32, 48, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 448, 512, 640, 768, 896, 1024, 1280, 1536, 1792, 2048, 2560, 3072, 3584, 4096}; // The number of bytes a block of each size class has room for
+	static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER; // Guards the shared free lists
+	static mem_header* pool_blocks[MEM_NUM_CLASSES]; // The shared free blocks of each size class
+	static pthread_once_t pool_once = PTHREAD_ONCE_INIT; // Makes sure pool_key is created only once
+	static pthread_key_t pool_key; // Gives each thread's cache back to the shared free lists when the thread exits
+	static __thread mem_cache* pool_cache = NULL; // The calling thread's cache
 #endif
 
+#if defined(MEMPOOL)
+
+/* size_class gets the size class of the given number of bytes
+	parameters:
+		size: the number of bytes requested, which must be positive
+	returns: the index of the smallest size class with room for the given number of bytes, MEM_NUM_CLASSES if no class has enough room
+	notes:
+		Sizes up to 128 B are rounded up to a multiple of 16 B and larger sizes to a multiple of a quarter of the power of two below them.
+	todo:
+*/
+static inline size_t size_class (size_t size) {
+	if (size <= 128) {
+		return (size - 1) >> 4;
+	} else if (size > MEM_MAX_CLASS_SIZE) {
+		return MEM_NUM_CLASSES;
+	}
+	int power = sizeof(unsigned long) * 8 - 1 - __builtin_clzl(size - 1);
+	return 8 + 4 * (power - 7) + (((size - 1) >> (power - 2)) & 3);
+}
+
+/* pool_lock_all locks the shared free lists before the process forks
+	parameters:
+	returns: nothing
+	notes:
+		The child of a fork has only the forking thread, so the lists are locked across the fork to keep the child from inheriting them half-changed or locked by a thread it does not have.
+	todo:
+*/
+static void pool_lock_all () {
+	pthread_mutex_lock(&pool_lock);
+}
+
+/* pool_unlock_all unlocks the shared free lists after the process forks, in both the parent and the child
+	parameters:
+	returns: nothing
+	notes:
+	todo:
+*/
+static void pool_unlock_all () {
+	pthread_mutex_unlock(&pool_lock);
+}
+
+/* pool_flush gives every block in the given thread cache back to the shared free lists and frees the cache
+	parameters:
+		arg: the cache of a thread that is exiting
+	returns: nothing
+	notes:
+		This function is called by pthreads when a thread that allocated exits.
+	todo:
+*/
+static void pool_flush (void* arg) {
+	mem_cache* cache = (mem_cache*)arg;
+	pthread_mutex_lock(&pool_lock);
+	for (int i = 0; i < MEM_NUM_CLASSES; i++) {
+		while (cache->blocks[i] != NULL) {
+			mem_header* block = cache->blocks[i];
+			cache->blocks[i] = *(mem_header**)(block + 1);
+			*(mem_header**)(block + 1) = pool_blocks[i];
+			pool_blocks[i] = block;
+		}
+	}
+	pthread_mutex_unlock(&pool_lock);
+	free(cache);
+	pool_cache = NULL;
+}
+
+/* pool_init sets up the memory pool the first time any thread uses it
+	parameters:
+	returns: nothing
+	notes:
+	todo:
+*/
+static void pool_init () {
+	pthread_key_create(&pool_key, pool_flush);
+	pthread_atfork(pool_lock_all, pool_unlock_all, pool_unlock_all);
+}
+
+/* pool_thread_cache gets the calling thread's cache, creating it if the thread has not allocated before
+	parameters:
+	returns: the calling thread's cache
+	notes:
+		The cache itself comes from malloc since the pool cannot allocate from itself before the cache exists.
+	todo:
+*/
+static inline mem_cache* pool_thread_cache () {
+	mem_cache* cache = pool_cache;
+	if (cache == NULL) {
+		pthread_once(&pool_once, pool_init);
+		void* mem = malloc(sizeof(mem_cache));
+		if (mem == NULL) {
+			term->no_memory();
+			exit(EXIT_MEMORY_ERROR);
+		}
+		cache = new (mem) mem_cache();
+		pool_cache = cache;
+		pthread_setspecific(pool_key, cache);
+	}
+	return cache;
+}
+
+/* pool_refill fills the given thread cache's free list of the given size class
+	parameters:
+		cache: the calling thread's cache
+		sclass: the size class whose free list is empty
+	returns: nothing
+	notes:
+		Up to MEM_BATCH blocks are taken from the shared free list, and a new chunk is carved into blocks if it has none.
+		Chunks are never given back to the system, so the pool holds the most memory the program's small blocks ever needed at once.
+	todo:
+*/
+static void pool_refill (mem_cache* cache, size_t sclass) {
+	pthread_mutex_lock(&pool_lock);
+	while (pool_blocks[sclass] != NULL && cache->num_blocks[sclass] < MEM_BATCH) {
+		mem_header* block = pool_blocks[sclass];
+		pool_blocks[sclass] = *(mem_header**)(block + 1);
+		*(mem_header**)(block + 1) = cache->blocks[sclass];
+		cache->blocks[sclass] = block;
+		cache->num_blocks[sclass]++;
+	}
+	pthread_mutex_unlock(&pool_lock);
+	if (cache->blocks[sclass] != NULL) {
+		return;
+	}
+	
+	size_t block_size = sizeof(mem_header) + class_sizes[sclass];
+	size_t num_blocks = MEM_CHUNK_SIZE / block_size;
+	if (num_blocks < MEM_BATCH) {
+		num_blocks = MEM_BATCH;
+	}
+	char* chunk = (char*)malloc(block_size * num_blocks);
+	if (chunk == NULL) {
+		term->no_memory();
+		exit(EXIT_MEMORY_ERROR);
+	}
+	for (size_t i = 0; i < num_blocks; i++) {
+		mem_header* block = (mem_header*)(chunk + i * block_size);
+		block->size_class = sclass;
+		*(mem_header**)(block + 1) = cache->blocks[sclass];
+		cache->blocks[sclass] = block;
+	}
+	cache->num_blocks[sclass] += num_blocks;
+}
+
+/* pool_allocate takes a block of the given size class from the calling thread's cache
+	parameters:
+		sclass: the size class of the block
+	returns: the header of the block
+	notes:
+	todo:
+*/
+static inline mem_header* pool_allocate (size_t sclass) {
+	mem_cache* cache = pool_thread_cache();
+	if (cache->blocks[sclass] == NULL) {
+		pool_refill(cache, sclass);
+	}
+	mem_header* block = cache->blocks[sclass];
+	cache->blocks[sclass] = *(mem_header**)(block + 1);
+	cache->num_blocks[sclass]--;
+	return block;
+}
+
+/* pool_release puts the given block back in the calling thread's cache
+	parameters:
+		block: the header of the block
+	returns: nothing
+	notes:
+		A block may be released by a different thread than the one that allocated it, in which case it joins the releasing thread's cache.
+		Once a free list is 2 * MEM_BATCH long, MEM_BATCH of its blocks are given back to the shared free list so one thread freeing what another allocated does not hoard them.
+	todo:
+*/
+static inline void pool_release (mem_header* block) {
+	mem_cache* cache = pool_thread_cache();
+	size_t sclass = block->size_class;
+	*(mem_header**)(block + 1) = cache->blocks[sclass];
+	cache->blocks[sclass] = block;
+	if (++cache->num_blocks[sclass] < 2 * MEM_BATCH) {
+		return;
+	}
+	
+	pthread_mutex_lock(&pool_lock);
+	for (int i = 0; i < MEM_BATCH; i++) {
+		block = cache->blocks[sclass];
+		cache->blocks[sclass] = *(mem_header**)(block + 1);
+		*(mem_header**)(block + 1) = pool_blocks[sclass];
+		pool_blocks[sclass] = block;
+	}
+	pthread_mutex_unlock(&pool_lock);
+	cache->num_blocks[sclass] -= MEM_BATCH;
+}
+
+#endif
+
+#if defined(MEMTRACK)
+
+/* raise_peak raises the given peak to the given amount if the amount is higher
+	parameters:
+		peak: a pointer to the peak
+		amount: the amount just reached
+	returns: nothing
+	notes:
+		The peak is compared and swapped so two threads raising it at once cannot lower it.
+	todo:
+*/
+static inline void raise_peak (size_t* peak, size_t amount) {
+	size_t old = *peak;
+	while (amount > old && !__sync_bool_compare_and_swap(peak, old, amount)) {
+		old = *peak;
+	}
+}
+
+/* track_allocation counts the given number of bytes toward the heap usage and the given category
+	parameters:
+		size: the number of bytes allocated
+		tag: the category of the allocation
+	returns: nothing
+	notes:
+	todo:
+*/
+static inline void track_allocation (size_t size, int tag) {
+	__sync_fetch_and_add(&heap_total, size);
+	raise_peak(&heap_peak, __sync_add_and_fetch(&heap_current, size));
+	raise_peak(&tag_peak[tag], __sync_add_and_fetch(&tag_current[tag], size));
+}
+
+/* track_free takes the given number of bytes off the heap usage and the given category
+	parameters:
+		size: the number of bytes freed
+		tag: the category of the allocation
+	returns: nothing
+	notes:
+	todo:
+*/
+static inline void track_free (size_t size, int tag) {
+	__sync_fetch_and_sub(&heap_current, size);
+	__sync_fetch_and_sub(&tag_current[tag], size);
+}
+
+#endif
+
+/* mem_tag sets the category the calling thread's allocations are counted toward
+	parameters:
+		tag: one of the MEM_TAG_ macros
+	returns: the category that was set before, to set again once the tagged allocations are done
+	notes:
+		Tags nest: code tagging its allocations sets its tag, allocates, then sets the returned tag again, so the innermost tag wins.
+		The tag is only recorded if memory tracking is compiled in and turned on, and it costs nothing else.
+	todo:
+*/
+int mem_tag (int tag) {
+	#if defined(MEMTRACK)
+		int previous = current_tag;
+		current_tag = tag;
+		return previous;
+	#else
+		return MEM_TAG_OTHER;
+	#endif
+}
+
 /* mallocate allocates a block of memory with the given size
 	parameters:
 		size: the number of bytes to allocate
 	returns: a pointer to the block of memory allocated
 	notes:
 		This function is a thin wrapper for malloc that exits if the memory cannot be allocated or a nonpositive size is given.
-		If memory tracking is enabled, extra bytes are allocated with every request to store the size of the request. The memory tracker does not count these extra bytes when reporting heap usage.
+		If the memory pool is compiled in, blocks of up to MEM_MAX_CLASS_SIZE bytes are taken from it instead of malloc.
+		If the memory pool or memory tracking is compiled in, every block is preceded by a mem_header storing the size of the request and its category. The memory tracker does not count these extra bytes when reporting heap usage.
 		Memory allocated with mallocate should be freed with mfree, not free.
+		This function is safe to call from any thread.
 	todo:
 */
 void* mallocate (size_t size) {
 	if (size > 0) {
-		void* block;
-		#if defined(MEMTRACK)
-			block = malloc(sizeof(size_t) + size);
+		#if defined(MEMPOOL) || defined(MEMTRACK)
+			mem_header* block;
+			#if defined(MEMPOOL)
+				size_t sclass = size_class(size);
+				if (sclass < MEM_NUM_CLASSES) {
+					block = pool_allocate(sclass);
+				} else {
+					block = (mem_header*)malloc(sizeof(mem_header) + size);
+					if (block != NULL) {
+						block->size_class = MEM_NUM_CLASSES;
+					}
+				}
+			#else
+				block = (mem_header*)malloc(sizeof(mem_header) + size);
+			#endif
 		#else
-			block = malloc(size);
+			void* block = malloc(size);
 		#endif
 		if (block == NULL) {
 			term->no_memory();
 			exit(EXIT_MEMORY_ERROR);
 		}
-		#if defined(MEMTRACK)
-			heap_current += size;
-			heap_total += size;
-			size_t* sizeblock = (size_t*)block;
-			*sizeblock = size;
-			return (void*)(sizeblock + 1);
+		#if defined(MEMPOOL) || defined(MEMTRACK)
+			block->size = size;
+			#if defined(MEMTRACK)
+				if (heap_tracking) {
+					block->tag = current_tag;
+					track_allocation(size, block->tag);
+				} else {
+					block->tag = MEM_NUM_TAGS;
+				}
+			#endif
+			return (void*)(block + 1);
 		#else
 			return block;
 		#endif
@@ -95,25 +389,40 @@ void* callocate (size_t elements, size_t size) {
 	returns: a pointer to the block of memory allocated
 	notes:
 		This function is a thin wrapper for realloc that uses mallocate instead of malloc.
+		A pooled block is reused for any size its size class has room for.
 		Memory allocated with reallocate should be freed with mfree, not free.
 		This function exists because libSRES used realloc.
 	todo:
 */
 void* reallocate (void* mem, size_t size) {
-	#if defined(MEMTRACK)
+	#if defined(MEMPOOL) || defined(MEMTRACK)
 		if (mem == NULL) {
 			return mallocate(size);
-		} else {
-			size_t* sizeblock = (size_t*)mem - 1;
-			if (*sizeblock < size) {
-				void* newmem = mallocate(size);
-				memcpy(newmem, mem, *sizeblock);
-				mfree(sizeblock);
-				return newmem;
-			} else {
-				return mem;
+		}
+		mem_header* block = (mem_header*)mem - 1;
+		size_t room = block->size;
+		#if defined(MEMPOOL)
+			if (block->size_class < MEM_NUM_CLASSES) {
+				room = class_sizes[block->size_class];
 			}
+		#endif
+		if (size > room) {
+			void* newmem = mallocate(size);
+			memcpy(newmem, mem, block->size);
+			mfree(mem);
+			return newmem;
 		}
+		#if defined(MEMTRACK)
+			if (block->tag < MEM_NUM_TAGS) {
+				if (size > block->size) {
+					track_allocation(size - block->size, block->tag);
+				} else {
+					track_free(block->size - size, block->tag);
+				}
+			}
+		#endif
+		block->size = size;
+		return mem;
 	#else
 		return realloc(mem, size);
 	#endif
@@ -124,16 +433,26 @@ void* reallocate (void* mem, size_t size) {
 		mem: a pointer to the block of memory to free
 	returns: nothing
 	notes:
-		This function is a thin wrapper for free that ensures the extra bytes allocated when memory tracking is on are also freed.
-		Always use this function to free memory allocated with mallocate since free will not work properly when memory tracking is on.
+		This function is a thin wrapper for free that ensures the extra bytes allocated when the memory pool or memory tracking is on are also freed and that pooled blocks go back to the pool.
+		Always use this function to free memory allocated with mallocate since free will not work properly when the memory pool or memory tracking is on.
 	todo:
 */
 void mfree (void* mem) {
-	#if defined(MEMTRACK)
+	#if defined(MEMPOOL) || defined(MEMTRACK)
 		if (mem != NULL) {
-			size_t* memblock = (size_t*)mem - 1;
-			heap_current -= *memblock;
-			free(memblock);
+			mem_header* block = (mem_header*)mem - 1;
+			#if defined(MEMTRACK)
+				if (block->tag < MEM_NUM_TAGS) {
+					track_free(block->size, block->tag);
+				}
+			#endif
+			#if defined(MEMPOOL)
+				if (block->size_class < MEM_NUM_CLASSES) {
+					pool_release(block);
+					return;
+				}
+			#endif
+			free(block);
 		}
 	#else
 		free(mem);
@@ -212,24 +531,88 @@ static void print_mem_amount (size_t mem) {
 	} else {
 		cout << dmem << " B";
 	}
+}
+
+/* print_tag_amounts prints the given amount of every category that has used any memory
+	parameters:
+		amounts: the array of each category's amount, i.e. tag_current or tag_peak
+	returns: nothing
+	notes:
+		A category that has never used memory is left out since its amount is always 0.
+	todo:
+*/
+static void print_tag_amounts (size_t* amounts) {
+	static const char* tag_names[MEM_NUM_TAGS] = {"other", "population", "scratch", "I/O", "cache", "arguments"};
+	bool first = true;
+	for (int i = 0; i < MEM_NUM_TAGS; i++) {
+		if (tag_peak[i] > 0) {
+			cout << term->blue << (first ? "" : ", ") << tag_names[i] << " " << term->reset;
+			print_mem_amount(amounts[i]);
+			first = false;
+		}
+	}
 	cout << endl;
 }
 
-/* print_heap_usage prints the current and total heap usage calculated with the memory tracker
+/* enable_heap_tracking turns on the memory tracker for every allocation made from now on
+	parameters:
+	returns: nothing
+	notes:
+		Blocks allocated before this function is called are never counted, not even when they are freed.
+		This function must be called before the program starts any threads.
+	todo:
+*/
+void enable_heap_tracking () {
+	heap_tracking = true;
+}
+
+/* print_heap_snapshot prints the current and peak heap usage and how much of the current usage each category takes up, if the memory tracker is on
+	parameters:
+		rank: the MPI rank of the process, whose heap is the one measured
+		generation: the generation the snapshot was taken after
+	returns: nothing
+	notes:
+		This function is called after every generation, so a category whose usage keeps growing shows up over a run.
+	todo:
+*/
+void print_heap_snapshot (int rank, int generation) {
+	if (!heap_tracking) {
+		return;
+	}
+	term->rank(rank);
+	cout << term->blue << "Heap after generation " << term->reset << generation << term->blue << ": " << term->reset;
+	print_mem_amount(heap_current);
+	cout << term->blue << " (peak " << term->reset;
+	print_mem_amount(heap_peak);
+	cout << term->blue << "): " << term->reset;
+	print_tag_amounts(tag_current);
+}
+
+/* print_heap_usage prints the current, total and peak heap usage calculated with the memory tracker, if it is on
 	parameters:
 	returns: nothing
 	notes:
 		Current heap usage indicates how much unfreed memory is on the heap.
 		Total heap usage indicates how much memory has been allocated since the program's inception.
+		Peak heap usage indicates the most memory that was on the heap at once, overall and for each category on its own.
 		Do not call this function after free_terminal or reset_cout since it uses terminal colors allocated by init_terminal and quiet mode does not work after reset_cout.
 	todo:
 */
 void print_heap_usage () {
+	if (!heap_tracking) {
+		return;
+	}
 	cout << term->blue << "Current heap usage:\t" << term->reset;
 	print_mem_amount(heap_current);
+	cout << endl;
 	cout << term->blue << "Total heap usage:\t" << term->reset;
 	print_mem_amount(heap_total);
+	cout << endl;
+	cout << term->blue << "Peak heap usage:\t" << term->reset;
+	print_mem_amount(heap_peak);
+	cout << endl;
+	cout << term->blue << "Peak by category:\t" << term->reset;
+	print_tag_amounts(tag_peak);
 }
 
 #endif
-
@@ -25,6 +25,15 @@ memory.hpp contains function declarations for memory.cpp
 
 #include <stdlib.h> // Needed for size_t
 
+// The categories the memory tracker splits heap usage into, defined here instead of macros.hpp since libSRES tags its allocations too
+#define MEM_TAG_OTHER 0 // Anything not tagged with one of the categories below
+#define MEM_TAG_POPULATION 1 // libSRES's parameters, population and statistics
+#define MEM_TAG_SCRATCH 2 // Temporary space reused every generation, e.g. libSRES's arena
+#define MEM_TAG_IO 3 // Input file contents and the buffers of pipes and files
+#define MEM_TAG_CACHE 4 // The fitness cache and the evaluation store's index
+#define MEM_TAG_ARGV 5 // The simulation's arguments
+#define MEM_NUM_TAGS 6
+
 // These memory functions have been added to the libSRES code, which is compiled as C code, so 'extern "C"' must be added to prevent C++'s signature mangling from hiding the names from C
 #ifdef __cplusplus
 extern "C" {
@@ -33,10 +42,13 @@ void* mallocate(size_t);
 void* callocate(size_t, size_t);
 void* reallocate(void*, size_t);
 void mfree(void*);
+int mem_tag(int);
 #ifdef __cplusplus
 }
 #endif
 #if defined(MEMTRACK)
+	void enable_heap_tracking();
+	void print_heap_snapshot(int, int);
 	void print_heap_usage();
 #endif
 
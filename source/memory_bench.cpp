@@ -0,0 +1,214 @@
+/*
+Stochastically ranked evolutionary strategy sampler for zebrafish segmentation
+Copyright (C) 2013 Ahmet Ay, Jack Holland, Adriana Sperlea, Sebastian Sangervasi
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+memory_bench.cpp contains a microbenchmark of the memory pool in memory.cpp against glibc's malloc and free, timing the same workloads through both in one run.
+It is built only on request with 'scons bench=1', or by hand with:
+	g++ -O2 -pthread -D MEMPOOL source/memory_bench.cpp source/memory.cpp -o memory-bench
+To re-check MEM_BATCH or MEM_CHUNK_SIZE, rebuild with e.g. '-D MEM_BATCH=64 -D MEM_CHUNK_SIZE=262144' and compare the pool's times.
+Without MEMPOOL, mallocate falls through to malloc, so both columns time glibc.
+*/
+
+#include <pthread.h> // Needed for pthread_create, pthread_join
+#include <stdio.h> // Needed for printf
+#include <stdlib.h> // Needed for malloc, free, atoi, rand
+#include <time.h> // Needed for clock_gettime
+
+#include "macros.hpp"
+#include "memory.hpp"
+#include "structs.hpp"
+
+terminal* term = NULL; // memory.cpp uses the terminal only to report errors, which this benchmark does not set up
+
+#define BENCH_SIZES 4096 // The number of request sizes the workloads cycle through
+#define BENCH_LIVE 1024 // The number of blocks the batch workload holds at once
+#define BENCH_MAX_THREADS 64
+
+// The allocator a workload goes through
+struct bench_allocator {
+	const char* name;
+	void* (*allocate)(size_t);
+	void (*release)(void*);
+};
+
+// The arguments each thread of a workload is started with
+struct bench_args {
+	const bench_allocator* allocator;
+	int rounds;
+};
+
+static size_t sizes[BENCH_SIZES]; // The request sizes, mostly small ones with every fourth up to a page as the sampler's buffers and arrays are
+
+/* glibc_malloc and glibc_free call malloc and free directly so the pool's times have a baseline in the same binary
+	parameters:
+		size: the number of bytes to allocate
+		block: the block to free
+	returns: glibc_malloc returns the allocated block
+	notes:
+	todo:
+*/
+static void* glibc_malloc (size_t size) {
+	return malloc(size);
+}
+
+static void glibc_free (void* block) {
+	free(block);
+}
+
+/* pool_malloc and pool_free go through mallocate and mfree, i.e. the memory pool when compiled with MEMPOOL
+	parameters:
+		size: the number of bytes to allocate
+		block: the block to free
+	returns: pool_malloc returns the allocated block
+	notes:
+	todo:
+*/
+static void* pool_malloc (size_t size) {
+	return mallocate(size);
+}
+
+static void pool_free (void* block) {
+	mfree(block);
+}
+
+/* bench_now gets the current time
+	parameters:
+	returns: the number of seconds since an arbitrary point, monotonically increasing
+	notes:
+	todo:
+*/
+static double bench_now () {
+	timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/* bench_pairs allocates and immediately frees a block of every size, which is the best case of both allocators
+	parameters:
+		arg: the bench_args the thread was started with
+	returns: NULL
+	notes:
+		Each block is written to so the allocation cannot be optimized out.
+	todo:
+*/
+static void* bench_pairs (void* arg) {
+	bench_args* args = (bench_args*)arg;
+	for (int r = 0; r < args->rounds; r++) {
+		for (int i = 0; i < BENCH_SIZES; i++) {
+			char* block = (char*)args->allocator->allocate(sizes[i]);
+			block[0] = 1;
+			args->allocator->release(block);
+		}
+	}
+	return NULL;
+}
+
+/* bench_batch allocates BENCH_LIVE blocks before freeing any of them, as a generation's population and buffers are, which makes the pool refill from and give back to the shared free lists in MEM_BATCH blocks
+	parameters:
+		arg: the bench_args the thread was started with
+	returns: NULL
+	notes:
+	todo:
+*/
+static void* bench_batch (void* arg) {
+	bench_args* args = (bench_args*)arg;
+	char* blocks[BENCH_LIVE];
+	for (int r = 0; r < args->rounds; r++) {
+		for (int i = 0; i < BENCH_LIVE; i++) {
+			blocks[i] = (char*)args->allocator->allocate(sizes[(r + i) % BENCH_SIZES]);
+			blocks[i][0] = 1;
+		}
+		for (int i = 0; i < BENCH_LIVE; i++) {
+			args->allocator->release(blocks[i]);
+		}
+	}
+	return NULL;
+}
+
+/* bench_run times a workload on the given number of threads at once
+	parameters:
+		workload: the workload each thread runs
+		allocator: the allocator the workload goes through
+		threads: the number of threads to run the workload on
+		rounds: the number of rounds each thread runs
+		ops_per_round: the number of allocations a round makes
+	returns: the number of nanoseconds an allocation and its free took, averaged over every thread
+	notes:
+	todo:
+*/
+static double bench_run (void* (*workload)(void*), const bench_allocator* allocator, int threads, int rounds, int ops_per_round) {
+	pthread_t ids[BENCH_MAX_THREADS];
+	bench_args args = {allocator, rounds};
+	double start = bench_now();
+	for (int i = 0; i < threads; i++) {
+		if (pthread_create(&ids[i], NULL, workload, &args) != 0) {
+			fprintf(stderr, "memory-bench could not start thread %d\n", i);
+			exit(EXIT_FAILURE);
+		}
+	}
+	for (int i = 0; i < threads; i++) {
+		pthread_join(ids[i], NULL);
+	}
+	return (bench_now() - start) * 1e9 / ((double)rounds * ops_per_round * threads);
+}
+
+/* main times every workload through glibc and the memory pool at 1 thread and at the given number of threads
+	parameters:
+		argc: the number of command-line arguments
+		argv: the array of command-line arguments, optionally the number of threads to compare (default 4) and a scale on the rounds (default 1)
+	returns: 0 on success, a positive integer on failure
+	notes:
+	todo:
+*/
+int main (int argc, char** argv) {
+	int threads = argc > 1 ? atoi(argv[1]) : 4;
+	int scale = argc > 2 ? atoi(argv[2]) : 1;
+	if (threads < 1 || threads > BENCH_MAX_THREADS || scale < 1) {
+		fprintf(stderr, "usage: memory-bench [threads (1-%d)] [scale]\n", BENCH_MAX_THREADS);
+		return EXIT_FAILURE;
+	}
+
+	srand(1);
+	for (int i = 0; i < BENCH_SIZES; i++) {
+		sizes[i] = (rand() % 4 == 0) ? 8 + rand() % 4000 : 8 + rand() % 248;
+	}
+
+	static const bench_allocator allocators[2] = {{"glibc", glibc_malloc, glibc_free}, {"pool", pool_malloc, pool_free}};
+	int thread_counts[2] = {1, threads};
+	#if defined(MEMPOOL)
+		printf("MEM_BATCH %d, MEM_CHUNK_SIZE %d\n", MEM_BATCH, MEM_CHUNK_SIZE);
+	#else
+		printf("compiled without MEMPOOL, so pool is glibc too\n");
+	#endif
+	printf("%-24s %12s %12s\n", "ns per allocation", allocators[0].name, allocators[1].name);
+	for (int t = 0; t < (threads == 1 ? 1 : 2); t++) {
+		char label[64];
+		double times[2];
+		for (int a = 0; a < 2; a++) {
+			times[a] = bench_run(bench_pairs, &allocators[a], thread_counts[t], 2000 * scale, BENCH_SIZES);
+		}
+		snprintf(label, sizeof(label), "pairs, %d thread%s", thread_counts[t], thread_counts[t] == 1 ? "" : "s");
+		printf("%-24s %12.1f %12.1f\n", label, times[0], times[1]);
+		for (int a = 0; a < 2; a++) {
+			times[a] = bench_run(bench_batch, &allocators[a], thread_counts[t], 8000 * scale, BENCH_LIVE);
+		}
+		snprintf(label, sizeof(label), "batch of %d, %d thread%s", BENCH_LIVE, thread_counts[t], thread_counts[t] == 1 ? "" : "s");
+		printf("%-24s %12.1f %12.1f\n", label, times[0], times[1]);
+	}
+	return 0;
+}
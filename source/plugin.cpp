@@ -0,0 +1,239 @@
+/*
+Stochastically ranked evolutionary strategy sampler for zebrafish segmentation
+Copyright (C) 2013 Ahmet Ay, Jack Holland, Adriana Sperlea, Sebastian Sangervasi
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+plugin.cpp contains functions for loading a fitness plugin and calling it from several threads.
+A plugin is a shared library implementing the interface in sres_plugin.h, which scores parameter sets in the sampler's own process instead of in launched simulations.
+*/
+
+#include <dlfcn.h> // Needed for dlopen, dlsym, dlclose, dlerror
+
+#include "plugin.hpp" // Function declarations
+
+#include "macros.hpp"
+#include "sres.hpp"
+
+extern terminal* term; // Declared in init.cpp
+
+sim_plugin* plugin = NULL; // The global fitness plugin, NULL when parameter sets are scored by simulations
+
+/* init_plugin loads the fitness plugin if the user specified one and starts the threads that call it
+	parameters:
+		ip: the program's input parameters
+	returns: nothing
+	notes:
+		The user's number of jobs sets the number of threads, the main thread included.
+		Each helper thread creates its own state and reports back before this returns, so a plugin failing to initialize stops the sampler before any generation runs.
+	todo:
+*/
+void init_plugin (input_params& ip) {
+	if (ip.plugin_file == NULL) {
+		return;
+	}
+	
+	int rank = get_rank();
+	ostream& v = term->verbose();
+	term->rank(rank, v);
+	v << term->blue << "Loading the fitness plugin " << term->reset << ip.plugin_file << " . . . ";
+	plugin = new sim_plugin(ip.num_dims, ip.num_jobs);
+	plugin->library = dlopen(ip.plugin_file, RTLD_NOW | RTLD_LOCAL);
+	if (plugin->library == NULL) {
+		term->failed_plugin_load(dlerror());
+		exit(EXIT_PLUGIN_ERROR);
+	}
+	sres_plugin_abi_version_fn abi_version = (sres_plugin_abi_version_fn)find_plugin_function("sres_plugin_abi_version", true);
+	if (abi_version() != SRES_PLUGIN_ABI_VERSION) {
+		term->failed_plugin_load("it was built for a different version of sres_plugin.h");
+		exit(EXIT_PLUGIN_ERROR);
+	}
+	plugin->fitness = (sres_plugin_fitness_fn)find_plugin_function("sres_plugin_fitness", true);
+	plugin->init_state = (sres_plugin_init_fn)find_plugin_function("sres_plugin_init", false);
+	plugin->free_state = (sres_plugin_free_fn)find_plugin_function("sres_plugin_free", false);
+	term->done(v);
+	
+	// Create the main thread's state and start the helpers, which create their own
+	term->rank(rank, v);
+	v << term->blue << "Starting " << term->reset << plugin->num_threads << term->blue << " plugin threads " << term->reset << ". . . ";
+	if (plugin->init_state != NULL && plugin->init_state(plugin->num_dims, 0, &(plugin->states[0])) != 0) {
+		term->failed_plugin();
+		exit(EXIT_PLUGIN_ERROR);
+	}
+	plugin->busy = plugin->num_threads - 1;
+	for (int i = 1; i < plugin->num_threads; i++) {
+		if (pthread_create(&(plugin->threads[i]), NULL, run_plugin_thread, (void*)(long)i) != 0) {
+			term->failed_plugin_load("a thread could not be started");
+			exit(EXIT_PLUGIN_ERROR);
+		}
+	}
+	pthread_mutex_lock(&(plugin->lock));
+	while (plugin->busy > 0) {
+		pthread_cond_wait(&(plugin->work_done), &(plugin->lock));
+	}
+	pthread_mutex_unlock(&(plugin->lock));
+	if (plugin->failed) {
+		term->failed_plugin();
+		exit(EXIT_PLUGIN_ERROR);
+	}
+	term->done(v);
+}
+
+/* free_plugin stops the plugin threads, frees their states and unloads the plugin
+	parameters:
+	returns: nothing
+	notes:
+	todo:
+*/
+void free_plugin () {
+	if (plugin == NULL) {
+		return;
+	}
+	
+	pthread_mutex_lock(&(plugin->lock));
+	plugin->stopping = true;
+	pthread_cond_broadcast(&(plugin->work_ready));
+	pthread_mutex_unlock(&(plugin->lock));
+	for (int i = 1; i < plugin->num_threads; i++) {
+		pthread_join(plugin->threads[i], NULL);
+	}
+	if (plugin->free_state != NULL) {
+		plugin->free_state(plugin->states[0]);
+	}
+	dlclose(plugin->library);
+	delete plugin;
+	plugin = NULL;
+}
+
+/* find_plugin_function looks up a function the plugin exports
+	parameters:
+		name: the name of the function
+		required: whether the sampler should exit if the plugin does not export the function
+	returns: the address of the function, or NULL if it is optional and not exported
+	notes:
+	todo:
+*/
+void* find_plugin_function (const char* name, bool required) {
+	void* function = dlsym(plugin->library, name);
+	if (function == NULL && required) {
+		term->failed_plugin_load(dlerror());
+		exit(EXIT_PLUGIN_ERROR);
+	}
+	return function;
+}
+
+/* run_plugin_thread is the body of every helper thread, which creates its plugin state and then scores its share of every posted batch until told to stop
+	parameters:
+		arg: the index of the thread, cast to a pointer
+	returns: NULL
+	notes:
+		Helpers never print or exit themselves; they record failures in the plugin struct for the main thread to report.
+	todo:
+*/
+void* run_plugin_thread (void* arg) {
+	int thread = (int)(long)arg;
+	bool ok = plugin->init_state == NULL || plugin->init_state(plugin->num_dims, thread, &(plugin->states[thread])) == 0;
+	
+	pthread_mutex_lock(&(plugin->lock));
+	plugin->failed = plugin->failed || !ok;
+	if (--(plugin->busy) == 0) {
+		pthread_cond_signal(&(plugin->work_done));
+	}
+	int last_batch = plugin->batch;
+	while (true) {
+		// Sleep until a new batch is posted or the sampler is done
+		while (!plugin->stopping && plugin->batch == last_batch) {
+			pthread_cond_wait(&(plugin->work_ready), &(plugin->lock));
+		}
+		if (plugin->stopping) {
+			break;
+		}
+		last_batch = plugin->batch;
+		pthread_mutex_unlock(&(plugin->lock));
+		
+		ok = evaluate_plugin_sets(thread);
+		
+		pthread_mutex_lock(&(plugin->lock));
+		plugin->failed = plugin->failed || !ok;
+		if (--(plugin->busy) == 0) {
+			pthread_cond_signal(&(plugin->work_done));
+		}
+	}
+	pthread_mutex_unlock(&(plugin->lock));
+	
+	if (plugin->free_state != NULL) {
+		plugin->free_state(plugin->states[thread]);
+	}
+	return NULL;
+}
+
+/* evaluate_plugin scores the given parameter sets with the fitness plugin, spreading them across every plugin thread
+	parameters:
+		sets: the array of parameter sets to score
+		num_sets: the number of parameter sets in the array
+		scores: the array to store each set's fitness in
+		constraints: the arrays to store each set's constraint values in
+	returns: nothing
+	notes:
+		The main thread scores sets too, so a single thread runs the plugin without any locking or waking.
+	todo:
+*/
+void evaluate_plugin (double** sets, int num_sets, double* scores, double** constraints) {
+	pthread_mutex_lock(&(plugin->lock));
+	plugin->sets = sets;
+	plugin->scores = scores;
+	plugin->constraints = constraints;
+	plugin->num_sets = num_sets;
+	plugin->next_set = 0;
+	if (plugin->num_threads > 1 && num_sets > 1) {
+		plugin->busy = plugin->num_threads - 1;
+		plugin->batch++;
+		pthread_cond_broadcast(&(plugin->work_ready));
+	}
+	pthread_mutex_unlock(&(plugin->lock));
+	
+	bool ok = evaluate_plugin_sets(0);
+	
+	pthread_mutex_lock(&(plugin->lock));
+	while (plugin->busy > 0) {
+		pthread_cond_wait(&(plugin->work_done), &(plugin->lock));
+	}
+	ok = ok && !plugin->failed;
+	pthread_mutex_unlock(&(plugin->lock));
+	if (!ok) {
+		term->failed_plugin();
+		exit(EXIT_PLUGIN_ERROR);
+	}
+}
+
+/* evaluate_plugin_sets scores sets of the posted batch with the given thread's plugin state until none are left
+	parameters:
+		thread: the index of the calling thread
+	returns: true if every set the thread took was scored, false if the plugin reported an error
+	notes:
+		Threads take one set at a time so a set that takes longer to score does not hold up the others.
+	todo:
+*/
+bool evaluate_plugin_sets (int thread) {
+	int set;
+	while ((set = __sync_fetch_and_add(&(plugin->next_set), 1)) < plugin->num_sets) {
+		double* constraints = plugin->constraints != NULL ? plugin->constraints[set] : NULL;
+		if (plugin->fitness(plugin->states[thread], plugin->sets[set], plugin->num_dims, plugin->scores + set, constraints, NUM_CONSTRAINTS) != 0) {
+			return false;
+		}
+	}
+	return true;
+}
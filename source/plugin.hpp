@@ -0,0 +1,37 @@
+/*
+Stochastically ranked evolutionary strategy sampler for zebrafish segmentation
+Copyright (C) 2013 Ahmet Ay, Jack Holland, Adriana Sperlea, Sebastian Sangervasi
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+plugin.hpp contains function declarations for plugin.cpp.
+*/
+
+#ifndef PLUGIN_HPP
+#define PLUGIN_HPP
+
+#include "structs.hpp"
+
+extern sim_plugin* plugin; // Declared in plugin.cpp
+
+void init_plugin(input_params&);
+void free_plugin();
+void* find_plugin_function(const char*, bool);
+void* run_plugin_thread(void*);
+void evaluate_plugin(double**, int, double*, double**);
+bool evaluate_plugin_sets(int);
+
+#endif
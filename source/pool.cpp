@@ -0,0 +1,399 @@
+/*
+Stochastically ranked evolutionary strategy sampler for zebrafish segmentation
+Copyright (C) 2013 Ahmet Ay, Jack Holland, Adriana Sperlea, Sebastian Sangervasi
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+pool.cpp contains functions for the pool of persistent simulation workers.
+A worker is a simulation started once and kept alive, reading parameter sets from its input pipe until the pipe is closed and writing back a score for each one.
+*/
+
+#include <algorithm> // Needed for min
+#include <cerrno> // Needed for errno, EINTR
+#include <cmath> // Needed for ceil
+#include <csignal> // Needed for signal, kill, SIGPIPE, SIGKILL
+#include <fcntl.h> // Needed for fcntl, O_NONBLOCK
+#include <poll.h> // Needed for poll, pollfd, POLLIN, POLLOUT
+#include <sys/wait.h> // Needed for waitpid
+#include <unistd.h> // Needed for read, write, close
+
+#include "pool.hpp" // Function declarations
+
+#include "io.hpp"
+#include "macros.hpp"
+#include "sres.hpp"
+
+extern terminal* term; // Declared in init.cpp
+extern input_params ip; // Declared in main.cpp
+extern eval_counts evals; // Declared in sres.cpp
+
+sim_pool* pool = NULL; // The global pool of workers, NULL when every parameter set launches its own simulation
+
+/* init_pool starts the persistent simulation workers if the pool is enabled
+	parameters:
+		ip: the program's input parameters
+	returns: nothing
+	notes:
+		SIGPIPE is ignored so a worker dying while a set is being written to it surfaces as a failed write the pool can recover from instead of ending the sampler.
+	todo:
+*/
+void init_pool (input_params& ip) {
+	if (ip.num_workers == 0 || ip.plugin_file != NULL) {
+		return;
+	}
+	
+	int rank = get_rank();
+	ostream& v = term->verbose();
+	term->rank(rank, v);
+	v << term->blue << "Starting " << term->reset << ip.num_workers << term->blue << " simulation workers " << term->reset << ". . ." << endl;
+	
+	signal(SIGPIPE, SIG_IGN);
+	pool = new sim_pool(ip.num_workers);
+	for (int i = 0; i < pool->num_workers; i++) {
+		start_worker(pool->workers[i]);
+	}
+	
+	term->rank(rank, v);
+	term->done(v);
+}
+
+/* free_pool stops every worker and frees the pool
+	parameters:
+	returns: nothing
+	notes:
+		Does nothing if the pool is not running.
+	todo:
+*/
+void free_pool () {
+	if (pool == NULL) {
+		return;
+	}
+	for (int i = 0; i < pool->num_workers; i++) {
+		stop_worker(pool->workers[i]);
+	}
+	delete pool;
+	pool = NULL;
+}
+
+/* start_worker launches the simulation process of the given worker
+	parameters:
+		worker: the worker to start
+	returns: nothing
+	notes:
+		The worker's pipes are non-blocking so every write and read can give up at its batch's deadline.
+	todo:
+*/
+void start_worker (sim_worker& worker) {
+	worker.pid = start_simulation(&(worker.fd_write), &(worker.fd_read));
+	if (fcntl(worker.fd_write, F_SETFL, O_NONBLOCK) == -1) {
+		term->failed_pipe_write();
+		exit(EXIT_PIPE_WRITE_ERROR);
+	}
+	if (fcntl(worker.fd_read, F_SETFL, O_NONBLOCK) == -1) {
+		term->failed_pipe_read();
+		exit(EXIT_PIPE_READ_ERROR);
+	}
+}
+
+/* stop_worker closes the given worker's input so its simulation exits and then waits for it
+	parameters:
+		worker: the worker to stop
+	returns: nothing
+	notes:
+		A worker that exits abnormally after its input is closed is an error just like a simulation that fails in the usual mode.
+	todo:
+*/
+void stop_worker (sim_worker& worker) {
+	if (worker.pid == 0) {
+		return;
+	}
+	if (close(worker.fd_write) == -1) {
+		term->failed_pipe_write();
+		exit(EXIT_PIPE_WRITE_ERROR);
+	}
+	if (close(worker.fd_read) == -1) {
+		term->failed_pipe_read();
+		exit(EXIT_PIPE_READ_ERROR);
+	}
+	wait_simulation(worker.pid);
+	worker.pid = 0;
+	worker.fd_write = -1;
+	worker.fd_read = -1;
+}
+
+/* restart_worker replaces the simulation process of a worker that died or stopped responding
+	parameters:
+		worker: the worker to restart
+	returns: nothing
+	notes:
+		The old process is killed in case it is still alive and then reaped so it does not linger as a zombie.
+	todo:
+*/
+void restart_worker (sim_worker& worker) {
+	int rank = get_rank();
+	ostream& v = term->verbose();
+	v << "  ";
+	term->rank(rank, v);
+	v << term->yellow << "Restarting the simulation worker " << term->reset << "(PID " << worker.pid << ") . . . " << endl;
+	
+	close(worker.fd_write);
+	close(worker.fd_read);
+	kill(-worker.pid, SIGKILL); // The whole process group, so nothing the worker started outlives it
+	waitpid(worker.pid, NULL, 0);
+	start_worker(worker);
+}
+
+/* simulate_sets_pool splits the given parameter sets into batches and hands them to the workers in the pool
+	parameters:
+		sets: the array of parameter sets to simulate
+		num_sets: the number of parameter sets in the array
+		batch_size: the number of parameter sets to send to a worker at once
+		scores: the array to store each set's score in
+	returns: nothing
+	notes:
+		Every worker is sent a batch before any reply is read so the workers simulate their batches at the same time.
+		If a worker dies before returning its scores it is restarted and its batch is sent again, up to MAX_WORKER_RESTARTS times.
+		A worker still reading or simulating its batch past the batch's deadline is restarted too. What happens to a batch that timed out, or that is still failing after the restarts, depends on the user's failure policy.
+	todo:
+*/
+void simulate_sets_pool (double* sets[], int num_sets, int batch_size, double scores[]) {
+	int num_workers = pool->num_workers;
+	bool* sent = (bool*)mallocate(sizeof(bool) * num_workers);
+	bool* timed_out = (bool*)mallocate(sizeof(bool) * num_workers);
+	double* started = (double*)mallocate(sizeof(double) * num_workers);
+	double* deadlines = (double*)mallocate(sizeof(double) * num_workers);
+	for (int first = 0; first < num_sets; first += batch_size * num_workers) {
+		// Send one batch to each worker
+		for (int i = 0; i < num_workers; i++) {
+			int start = first + i * batch_size;
+			if (start < num_sets) {
+				int size = min(batch_size, num_sets - start);
+				started[i] = monotonic_time();
+				deadlines[i] = sim_deadline(started[i], size);
+				sent[i] = send_worker(pool->workers[i], sets + start, size, deadlines[i], &(timed_out[i]));
+			}
+		}
+		
+		// Collect the scores of each batch, resending the batches of workers that died or timed out
+		for (int i = 0; i < num_workers; i++) {
+			int start = first + i * batch_size;
+			if (start >= num_sets) {
+				break;
+			}
+			sim_worker& worker = pool->workers[i];
+			int size = min(batch_size, num_sets - start);
+			bool succeeded = true;
+			for (int restarts = 0; !sent[i] || !collect_worker(worker, size, scores + start, deadlines[i], &(timed_out[i])); restarts++) {
+				if (sent[i] || timed_out[i]) {
+					count_wasted(size);
+					if (timed_out[i]) {
+						evals.timed_out++;
+					} else {
+						evals.crashed++;
+					}
+				}
+				if (ip.on_failure == FAILURE_EXIT) {
+					if (timed_out[i]) {
+						kill(-worker.pid, SIGKILL); // Exiting stops the workers, which would wait forever for one that hangs
+						exit_failed_simulation(true, false);
+					}
+					if (restarts == MAX_WORKER_RESTARTS) {
+						term->failed_worker();
+						exit(EXIT_CHILD_ERROR);
+					}
+				}
+				restart_worker(worker);
+				if (ip.on_failure == FAILURE_PENALTY || (ip.on_failure == FAILURE_RETRY && restarts == MAX_SIM_RETRIES)) {
+					penalize_sets(scores + start, size);
+					succeeded = false;
+					break;
+				}
+				if (ip.on_failure == FAILURE_RETRY) {
+					evals.retried++;
+				}
+				started[i] = monotonic_time();
+				deadlines[i] = sim_deadline(started[i], size);
+				sent[i] = send_worker(worker, sets + start, size, deadlines[i], &(timed_out[i]));
+			}
+			if (succeeded) {
+				record_latency(started[i], size);
+			}
+		}
+	}
+	mfree(deadlines);
+	mfree(started);
+	mfree(timed_out);
+	mfree(sent);
+}
+
+/* send_worker writes the given batch of parameter sets to the given worker, giving up at the batch's deadline
+	parameters:
+		worker: the worker to write to
+		sets: the array of parameter sets to send
+		num_sets: the number of parameter sets in the array
+		deadline: the monotonic time to give up at, or 0 to wait as long as the worker takes to read
+		timed_out: a pointer to store whether the worker stopped reading until the deadline passed
+	returns: true if every set was written, false if the worker closed its input or timed out first
+	notes:
+		A batch larger than the pipe buffer is only written as fast as the worker reads it, so a worker that hangs partway through reading is still caught.
+	todo:
+*/
+bool send_worker (sim_worker& worker, double* sets[], int num_sets, double deadline, bool* timed_out) {
+	*timed_out = false;
+	if (!write_worker_bytes(worker.fd_write, &(ip.num_dims), sizeof(int), deadline, timed_out) || !write_worker_bytes(worker.fd_write, &num_sets, sizeof(int), deadline, timed_out)) { // Write the number of dimensions, i.e. parameters per set, and the number of sets being sent
+		return false;
+	}
+	for (int i = 0; i < num_sets; i++) {
+		if (!write_worker_bytes(worker.fd_write, sets[i], sizeof(double) * ip.num_dims, deadline, timed_out)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/* collect_worker reads the scores of the batch the given worker was sent, giving up at the batch's deadline
+	parameters:
+		worker: the worker to read from
+		num_sets: the number of parameter sets in the batch
+		scores: the array to store each set's score in
+		deadline: the monotonic time to give up at, or 0 to wait as long as the worker takes
+		timed_out: a pointer to store whether the worker ran past the deadline
+	returns: true if every score was read, false if the worker died or timed out first
+	notes:
+		Every read waits for the pipe against the deadline, so a worker that hangs partway through its batch, or partway through a score, is still caught.
+	todo:
+*/
+bool collect_worker (sim_worker& worker, int num_sets, double scores[], double deadline, bool* timed_out) {
+	*timed_out = false;
+	for (int i = 0; i < num_sets; i++) {
+		int reply[2]; // The (maximum score, score) pair of the set
+		if (!read_worker_bytes(worker.fd_read, reply, sizeof(reply), deadline, timed_out)) {
+			return false;
+		}
+		scores[i] = convert_score(reply[0], reply[1]);
+	}
+	return true;
+}
+
+/* write_worker_bytes writes the given number of bytes to the given non-blocking pipe, waiting for room until the given deadline
+	parameters:
+		fd: the file descriptor of the pipe to write to
+		bytes: a pointer to the bytes to write
+		size: the number of bytes to write
+		deadline: the monotonic time to give up at, or 0 to wait as long as it takes
+		timed_out: a pointer to store whether the deadline passed before every byte was written
+	returns: true if every byte was written, false if the reader closed the pipe or the deadline passed first
+	notes:
+	todo:
+*/
+bool write_worker_bytes (int fd, const void* bytes, size_t size, double deadline, bool* timed_out) {
+	const char* cur = (const char*)bytes;
+	while (size > 0) {
+		ssize_t written = write(fd, cur, size);
+		if (written == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (errno != EAGAIN) {
+				return false;
+			}
+			if (!wait_ready(fd, POLLOUT, deadline)) {
+				*timed_out = true;
+				return false;
+			}
+			continue;
+		}
+		cur += written;
+		size -= written;
+	}
+	return true;
+}
+
+/* read_worker_bytes reads the given number of bytes from the given non-blocking pipe, waiting for data until the given deadline
+	parameters:
+		fd: the file descriptor of the pipe to read from
+		bytes: a pointer to store the bytes read
+		size: the number of bytes to read
+		deadline: the monotonic time to give up at, or 0 to wait as long as it takes
+		timed_out: a pointer to store whether the deadline passed before every byte was read
+	returns: true if every byte was read, false if the pipe failed, was closed or the deadline passed first
+	notes:
+	todo:
+*/
+bool read_worker_bytes (int fd, void* bytes, size_t size, double deadline, bool* timed_out) {
+	char* cur = (char*)bytes;
+	while (size > 0) {
+		ssize_t received = read(fd, cur, size);
+		if (received == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (errno != EAGAIN) {
+				return false;
+			}
+			if (!wait_ready(fd, POLLIN, deadline)) {
+				*timed_out = true;
+				return false;
+			}
+			continue;
+		}
+		if (received == 0) {
+			return false;
+		}
+		cur += received;
+		size -= received;
+	}
+	return true;
+}
+
+/* wait_ready waits until the given pipe can be written to or read from, has been closed, or the given deadline passes
+	parameters:
+		fd: the file descriptor of the pipe to wait on
+		events: POLLOUT to wait for room to write, POLLIN to wait for something to read
+		deadline: the monotonic time to stop waiting at, or 0 to wait as long as it takes
+	returns: true if the pipe is ready, false if the deadline passed first
+	notes:
+		The deadline is checked again every time poll returns, so signals that interrupt it do not extend the wait.
+	todo:
+*/
+bool wait_ready (int fd, short events, double deadline) {
+	struct pollfd watched;
+	watched.fd = fd;
+	watched.events = events;
+	while (true) {
+		int wait = -1;
+		if (deadline > 0) {
+			double remaining = deadline - monotonic_time();
+			if (remaining <= 0) {
+				return false;
+			}
+			wait = (int)ceil(remaining * 1000);
+		}
+		watched.revents = 0;
+		int ready = poll(&watched, 1, wait);
+		if (ready > 0) {
+			return true;
+		}
+		if (ready == -1 && errno != EINTR) {
+			if (events == POLLOUT) {
+				term->failed_pipe_write();
+				exit(EXIT_PIPE_WRITE_ERROR);
+			}
+			term->failed_pipe_read();
+			exit(EXIT_PIPE_READ_ERROR);
+		}
+	}
+}
@@ -0,0 +1,40 @@
+/*
+Stochastically ranked evolutionary strategy sampler for zebrafish segmentation
+Copyright (C) 2013 Ahmet Ay, Jack Holland, Adriana Sperlea, Sebastian Sangervasi
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+pool.hpp contains function declarations for pool.cpp.
+*/
+
+#ifndef POOL_HPP
+#define POOL_HPP
+
+#include "structs.hpp"
+
+void init_pool(input_params&);
+void free_pool();
+void start_worker(sim_worker&);
+void stop_worker(sim_worker&);
+void restart_worker(sim_worker&);
+void simulate_sets_pool(double*[], int, int, double[]);
+bool send_worker(sim_worker&, double*[], int, double, bool*);
+bool collect_worker(sim_worker&, int, double[], double, bool*);
+bool write_worker_bytes(int, const void*, size_t, double, bool*);
+bool read_worker_bytes(int, void*, size_t, double, bool*);
+bool wait_ready(int, short, double);
+
+#endif
@@ -21,6 +21,7 @@ sres.cpp contains function to interact with libSRES.
 Avoid placing I/O functions here and add them to io.cpp instead.
 */
 
+#include <algorithm> // Needed for max
 #include <ctime> // Needed for time_t in libSRES (they don't include time.h for some reason)
 
 // Include MPI if compiled with it
@@ -43,10 +44,18 @@ Avoid placing I/O functions here and add them to io.cpp instead.
 
 #include "sres.hpp" // Function declarations
 
+#include "cache.hpp"
 #include "io.hpp"
+#include "island.hpp"
+#include "macros.hpp"
+#include "plugin.hpp"
+#include "steady.hpp"
+#include "store.hpp"
 
 extern terminal* term; // Declared in init.cpp
 
+eval_counts evals; // The number of evaluations this process performed
+
 /* get_rank gets the MPI rank of the process or returns 0 if MPI is not active
 	parameters:
 	returns: the rank
@@ -74,7 +83,7 @@ int get_rank () {
 void init_sres (input_params& ip, sres_params& sp) {
 	// Initialize parameters required by libSRES
 	int es = esDefESSlash;
-	int constraint = 0;
+	int constraint = NUM_CONSTRAINTS;
 	int dim = ip.num_dims;
 	int miu = ip.pop_parents;
 	int lambda = ip.pop_total;
@@ -84,6 +93,10 @@ void init_sres (input_params& ip, sres_params& sp) {
 	double varphi = esDefVarphi;
 	int retry = 0;
 	sp.pf = essrDefPf;
+	essrThreads = ip.num_jobs; // Large constrained populations are ranked with as many threads as simulations run at once, since those cores wait on the ranking
+
+	// libSRES's parameters, population and statistics are all allocated here
+	int tag = mem_tag(MEM_TAG_POPULATION);
 	
 	// Transform is a dummy function f(x)->x but is still required to fit libSRES's code structure
 	sp.trsfm = (ESfcnTrsfm*)mallocate(sizeof(ESfcnTrsfm) * dim);
@@ -91,6 +104,12 @@ void init_sres (input_params& ip, sres_params& sp) {
 		sp.trsfm[i] = transform;
 	}
 	
+	// Hand each MPI process as many sets at once as it simulates at once, so one process per node keeps every local simulation slot busy
+	#if defined(MPI)
+		int parallel = (ip.num_workers > 0 && ip.plugin_file == NULL) ? ip.num_workers : ip.num_jobs;
+		esMPIChunk = parallel * max(ip.batch_size, 1);
+	#endif
+	
 	// Call libSRES's initialize function
 	int rank = get_rank();
 	ostream& v = term->verbose();
@@ -99,32 +118,46 @@ void init_sres (input_params& ip, sres_params& sp) {
 		cout.flush();
 		v << endl;
 	}
-	ESInitial(ip.seed, &(sp.param), sp.trsfm, fitness, es, constraint, dim, sp.ub, sp.lb, miu, lambda, gen, gamma, alpha, varphi, retry, &(sp.population), &(sp.stats));
+	evals.phase = EVAL_PHASE_INIT;
+	ESInitial(ip.seed, &(sp.param), sp.trsfm, fitness, fitness_batch, es, constraint, dim, sp.ub, sp.lb, miu, lambda, gen, gamma, alpha, varphi, retry, &(sp.population), &(sp.stats));
 	if (rank == 0) {
 		cout << term->blue << "Done";
 		v << " with libSRES initialization simulations";
 		cout << term->reset << endl;
 	}
+	mem_tag(tag);
 }
 
 /* run_sres iterates through every specified generation of libSRES
 	parameters:
+		ip: the program's input parameters
 		sp: parameters required by libSRES
 	returns: nothing
 	notes:
+		With the island model each island's leader exchanges migrants after every generation.
+		The steady-state engine replaces the generational loop if the user chose it.
 	todo:
 */
-void run_sres (sres_params& sp) {
+void run_sres (input_params& ip, sres_params& sp) {
 	int rank = get_rank();
+	evals.phase = EVAL_PHASE_GENERATION;
+	if (ip.steady_state) {
+		run_steady(ip, sp);
+		return;
+	}
 	while (sp.stats->curgen < sp.param->gen) {
 		int cur_gen = sp.stats->curgen;
 		if (rank == 0) {
 			cout << term->blue << "Starting generation " << term->reset << cur_gen << " . . ." << endl;
 		}
 		ESStep(sp.population, sp.param, sp.stats, sp.pf);
+		migrate(ip, sp);
 		if (rank == 0) {
 			cout << term->blue << "Done with generation " << term->reset << cur_gen << endl;
 		}
+		#if defined(MEMTRACK)
+			print_heap_snapshot(rank, cur_gen);
+		#endif
 	}
 }
 
@@ -142,18 +175,123 @@ void free_sres (sres_params& sp) {
 	ESDeInitial(sp.param, sp.population, sp.stats);
 }
 
-/* fitness runs a simulation and stores its resulting score in a variable libSRES then accesses
+/* fitness scores one parameter set and stores its resulting score in a variable libSRES then accesses
 	parameters:
 		parameters: the parameters provided by libSRES
 		score: a pointer to store the score the simulation received
-		constraints: parameter constraints (not used but required by libSRES's code structure)
+		constraints: parameter constraints (filled in only by a fitness plugin)
 	returns: nothing
 	notes:
 		This function is called by libSRES for every population member every generation.
 	todo:
 */
 void fitness (double* parameters, double* score, double* constraints) {
-	*score = simulate_set(parameters);
+	fitness_batch(&parameters, 1, score, &constraints);
+}
+
+/* fitness_batch scores a batch of parameter sets, taking the scores it can from the fitness cache and evaluation store if they are enabled, and stores their resulting scores in an array libSRES then accesses
+	parameters:
+		parameters: the array of parameter sets provided by libSRES
+		num_sets: the number of parameter sets in the array
+		scores: the array to store each set's score in
+		constraints: each set's parameter constraints (filled in only by a fitness plugin)
+	returns: nothing
+	notes:
+		This function is called by libSRES once per generation with every population member that needs a score, which lets the simulations receive the sets in batches instead of one at a time.
+	todo:
+*/
+void fitness_batch (double** parameters, int num_sets, double* scores, double** constraints) {
+	int tag = mem_tag(MEM_TAG_OTHER); // Evaluating the initial population must not count toward the population it is called from
+	if (cache != NULL) {
+		fitness_cached(parameters, num_sets, scores, constraints, fitness_uncached);
+	} else {
+		fitness_uncached(parameters, num_sets, scores, constraints);
+	}
+	mem_tag(tag);
+}
+
+/* fitness_uncached scores a batch of parameter sets the fitness cache does not have, taking the scores it can from the evaluation store if one is open
+	parameters:
+		parameters: the array of parameter sets to score
+		num_sets: the number of parameter sets in the array
+		scores: the array to store each set's score in
+		constraints: each set's parameter constraints (filled in only by a fitness plugin)
+	returns: nothing
+	notes:
+	todo:
+*/
+void fitness_uncached (double** parameters, int num_sets, double* scores, double** constraints) {
+	if (store != NULL) {
+		fitness_stored(parameters, num_sets, scores, constraints, evaluate_sets);
+	} else {
+		evaluate_sets(parameters, num_sets, scores, constraints);
+	}
+}
+
+/* evaluate_sets runs simulations, or calls the fitness plugin if one is loaded, on a batch of parameter sets
+	parameters:
+		parameters: the array of parameter sets to evaluate
+		num_sets: the number of parameter sets in the array
+		scores: the array to store each set's score in
+		constraints: each set's parameter constraints (filled in only by a fitness plugin)
+	returns: nothing
+	notes:
+		Every evaluation in the program goes through this function, so this is where they are counted.
+	todo:
+*/
+void evaluate_sets (double** parameters, int num_sets, double* scores, double** constraints) {
+	count_evaluations(num_sets);
+	if (plugin != NULL) {
+		evaluate_plugin(parameters, num_sets, scores, constraints);
+	} else {
+		simulate_sets(parameters, num_sets, scores);
+	}
+}
+
+/* count_evaluations counts the given number of evaluations toward the current phase
+	parameters:
+		num_sets: the number of parameter sets evaluated
+	returns: nothing
+	notes:
+	todo:
+*/
+void count_evaluations (int num_sets) {
+	if (evals.phase == EVAL_PHASE_INIT) {
+		evals.init += num_sets;
+	} else {
+		evals.generation += num_sets;
+	}
+}
+
+/* count_wasted counts the given number of evaluations whose scores were thrown away
+	parameters:
+		num_sets: the number of parameter sets whose scores were thrown away
+	returns: nothing
+	notes:
+		Sets that are simulated again are only counted toward the current phase once, for the scores they end up with.
+	todo:
+*/
+void count_wasted (int num_sets) {
+	evals.wasted += num_sets;
+}
+
+/* print_evaluations prints how many evaluations this process performed
+	parameters:
+	returns: nothing
+	notes:
+		The failure counts are only printed if any simulation failed.
+	todo:
+*/
+void print_evaluations () {
+	if (evals.init + evals.generation + evals.wasted == 0) {
+		return;
+	}
+	term->rank(get_rank());
+	cout << term->blue << "Evaluations: " << term->reset << evals.init << term->blue << " initial, " << term->reset << evals.generation << term->blue << " in generations, " << term->reset << evals.wasted << term->blue << " wasted" << term->reset << endl;
+	if (evals.crashed + evals.timed_out + evals.retried + evals.penalized > 0) {
+		term->rank(get_rank());
+		cout << term->blue << "Failures: " << term->reset << evals.crashed << term->blue << " crashed, " << term->reset << evals.timed_out << term->blue << " timed out, " << term->reset << evals.retried << term->blue << " retried, " << term->reset << evals.penalized << term->blue << " penalized" << term->reset << endl;
+	}
 }
 
 /* transform is a dummy function required by libSRES's code structure
@@ -27,9 +27,15 @@ sres.hpp contains function declarations for sres.cpp.
 
 int get_rank();
 void init_sres(input_params&, sres_params&);
-void run_sres(sres_params&);
+void run_sres(input_params&, sres_params&);
 void free_sres(sres_params&);
 void fitness(double*, double*, double*);
+void fitness_batch(double**, int, double*, double**);
+void fitness_uncached(double**, int, double*, double**);
+void evaluate_sets(double**, int, double*, double**);
+void count_evaluations(int);
+void count_wasted(int);
+void print_evaluations();
 double transform(double);
 
 #endif
@@ -0,0 +1,74 @@
+/*
+Stochastically ranked evolutionary strategy sampler for zebrafish segmentation
+Copyright (C) 2013 Ahmet Ay, Jack Holland, Adriana Sperlea, Sebastian Sangervasi
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+sres_plugin.h is the C interface a fitness plugin loaded with --plugin implements.
+A plugin is a shared library exporting the functions below with C linkage, which the sampler calls directly instead of launching simulations.
+Build one with, for example, "gcc -shared -fPIC -O2 model.c -o model.so".
+
+Every thread evaluating the plugin gets its own state from sres_plugin_init, so a plugin never needs locks as long as it keeps its mutable data in that state.
+sres_plugin_init and sres_plugin_free are called on the thread that uses the state, so thread-local storage works as well.
+*/
+
+#ifndef SRES_PLUGIN_H
+#define SRES_PLUGIN_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The version of this interface, which sres_plugin_abi_version must return
+#define SRES_PLUGIN_ABI_VERSION 1
+
+/* sres_plugin_abi_version (required) returns the SRES_PLUGIN_ABI_VERSION the plugin was built against */
+typedef int (*sres_plugin_abi_version_fn)(void);
+
+/* sres_plugin_init (optional) creates the state of one evaluating thread
+	parameters:
+		num_dims: the number of parameters in every set
+		thread: the index of the thread, from 0 to the number of threads minus 1
+		state: a pointer to store the thread's state in, which may be left NULL
+	returns: 0 on success, anything else to stop the sampler
+*/
+typedef int (*sres_plugin_init_fn)(int num_dims, int thread, void** state);
+
+/* sres_plugin_fitness (required) scores one parameter set
+	parameters:
+		state: the calling thread's state from sres_plugin_init, or NULL
+		parameters: the parameter set to score
+		num_dims: the number of parameters in the set
+		fitness: a pointer to store the fitness in, where lower is better (simulations report 1 - score / max_score)
+		constraints: an array to store the set's constraint values in, where positive values are violations
+		num_constraints: the number of elements in constraints
+	returns: 0 on success, anything else to stop the sampler
+*/
+typedef int (*sres_plugin_fitness_fn)(void* state, const double* parameters, int num_dims, double* fitness, double* constraints, int num_constraints);
+
+/* sres_plugin_free (optional) frees the state of one evaluating thread */
+typedef void (*sres_plugin_free_fn)(void* state);
+
+int sres_plugin_abi_version(void);
+int sres_plugin_init(int num_dims, int thread, void** state);
+int sres_plugin_fitness(void* state, const double* parameters, int num_dims, double* fitness, double* constraints, int num_constraints);
+void sres_plugin_free(void* state);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,196 @@
+/*
+Stochastically ranked evolutionary strategy sampler for zebrafish segmentation
+Copyright (C) 2013 Ahmet Ay, Jack Holland, Adriana Sperlea, Sebastian Sangervasi
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+steady.cpp contains the steady-state engine, an alternative to libSRES's generational loop that keeps every simulation slot busy.
+Whenever a simulation finishes, its offspring is ranked into the population and a new offspring is mutated from the ranked population and launched in its place, so no simulation waits for the slowest one of a generation.
+*/
+
+#include <cmath> // Needed for exp
+#include <cstring> // Needed for memcpy
+
+// libSRES has different files for MPI and non-MPI versions
+#if defined(MPI)
+	#include "../libsres-mpi/sharefunc.hpp"
+	#include "../libsres-mpi/ESSRSort.hpp"
+	#include "../libsres-mpi/ESES.hpp"
+#else
+	#include "../libsres/sharefunc.hpp"
+	#include "../libsres/ESSRSort.hpp"
+	#include "../libsres/ESES.hpp"
+#endif
+
+#include "steady.hpp" // Function declarations
+
+#include "io.hpp"
+#include "macros.hpp"
+#include "sres.hpp"
+#include "supervisor.hpp"
+
+extern terminal* term; // Declared in init.cpp
+extern sim_supervisor* supervisor; // Declared in supervisor.cpp
+
+/* run_steady evolves the population one offspring at a time until it has evaluated as many offspring as the generational loop would
+	parameters:
+		ip: the program's input parameters
+		sp: parameters required by libSRES
+	returns: nothing
+	notes:
+		Progress is reported every lambda evaluations, which libSRES's statistics count as one generation.
+		The offspring are simulated through the supervisor directly, one set per simulation, so the fitness cache and evaluation store are not consulted.
+	todo:
+*/
+void run_steady (input_params& ip, sres_params& sp) {
+	ESParameter* param = sp.param;
+	ESStatistics* stats = sp.stats;
+	long budget = (long)param->gen * param->lambda;
+	int tag = mem_tag(MEM_TAG_POPULATION);
+	steady_engine engine(supervisor->max_jobs, param->lambda);
+	for (int i = 0; i < engine.num_slots; i++) {
+		ESInitialIndividual(&(engine.children[i]), param);
+		engine.sets[i] = engine.children[i]->op;
+	}
+	mem_tag(tag);
+	rank_population(sp, engine, NULL, 0);
+	
+	long submitted = 0;
+	long completed = 0;
+	int* finished = (int*)mallocate(sizeof(int) * supervisor->max_jobs);
+	while (completed < budget) {
+		// Fill every free slot with a new offspring
+		for (int i = 0; i < engine.num_slots && submitted < budget; i++) {
+			if (!engine.busy[i]) {
+				make_offspring(sp, engine.children[i], submitted);
+				count_evaluations(1);
+				supervisor_submit(i, &(engine.sets[i]), 1, &(engine.scores[i]));
+				engine.busy[i] = true;
+				submitted++;
+			}
+		}
+		
+		// Rank every offspring that finished into the population
+		int num_finished = supervisor_wait(finished, -1);
+		for (int j = 0; j < num_finished; j++) {
+			int i = finished[j];
+			engine.children[i]->f = engine.scores[i];
+			engine.children[i]->phi = 0;
+			rank_population(sp, engine, engine.children[i], completed + 1);
+			engine.busy[i] = false;
+			completed++;
+			if (completed % param->lambda == 0) {
+				ESDoStat(stats, sp.population, param);
+				ESPrintStat(stats, param);
+				cout << term->blue << "Done with " << term->reset << completed << term->blue << " evaluations" << term->reset << endl;
+				#if defined(MEMTRACK)
+					print_heap_snapshot(0, stats->curgen - 1);
+				#endif
+			}
+		}
+	}
+	mfree(finished);
+	
+	for (int i = 0; i < engine.num_slots; i++) {
+		ESDeInitialIndividual(engine.children[i]);
+	}
+}
+
+/* make_offspring mutates a parent picked from the best ranked individuals into the given offspring
+	parameters:
+		sp: parameters required by libSRES
+		child: the individual to store the offspring in
+		serial: how many offspring were made before this one
+	returns: nothing
+	notes:
+		This is libSRES's mutation for one offspring: the step sizes are mutated log-normally and capped, the parameters are mutated with the new step sizes and reset to the parent's where they leave the ranges, and the step sizes are then smoothed.
+		The offspring draws from libSRES's random streams as individual serial % lambda of generation serial / lambda, so it is the same offspring whichever order the simulations finish in.
+		libSRES's differential variation of its top parents needs a whole generation at once, so it is left out.
+	todo:
+*/
+void make_offspring (sres_params& sp, ESIndividual* child, long serial) {
+	ESParameter* param = sp.param;
+	unsigned int gen = serial / param->lambda;
+	unsigned int ind = serial % param->lambda;
+	int parent = (int)ShareRand(0, param->miu, gen, ind, 0, esDefStreamParent);
+	if (parent >= param->miu) {
+		parent = param->miu - 1;
+	}
+	ESIndividual* from = sp.population->member[parent];
+	ESCopyIndividual(from, child, param);
+	
+	double randscalar = ShareNormalRand(0, 1, gen, ind, 0, esDefStreamScalar);
+	for (int j = 0; j < param->dim; j++) {
+		double step = from->sp[j] * exp(param->tau_ * randscalar + param->tau * ShareNormalRand(0, 1, gen, ind, j, esDefStreamSp));
+		child->sp[j] = step > param->spb[j] ? param->spb[j] : step;
+	}
+	for (int j = 0; j < param->dim; j++) {
+		double value = from->op[j] + child->sp[j] * ShareNormalRand(0, 1, gen, ind, j, esDefStreamOp);
+		for (int k = 0; k < param->retry && (value > param->ub[j] || value < param->lb[j]); k++) {
+			value = from->op[j] + child->sp[j] * ShareNormalRand(0, 1, gen, ind, j, esDefStreamRetry + (k << 8));
+		}
+		child->op[j] = (value > param->ub[j] || value < param->lb[j]) ? from->op[j] : value;
+	}
+	for (int j = 0; j < param->dim; j++) {
+		child->sp[j] = from->sp[j] + param->alpha * (child->sp[j] - from->sp[j]);
+	}
+}
+
+/* rank_population stochastically ranks the population, together with the given offspring if there is one, and keeps the population in ranked order
+	parameters:
+		sp: parameters required by libSRES
+		engine: the steady-state engine with the scratch space to rank in
+		child: the offspring to rank into the population, or NULL to only rank the population
+		serial: how many rankings were done before this one, which keys the ranking's random draws
+	returns: nothing
+	notes:
+		The individual ranked last is replaced by the offspring, so an offspring ranked last is simply discarded.
+	todo:
+*/
+void rank_population (sres_params& sp, steady_engine& engine, ESIndividual* child, long serial) {
+	ESPopulation* population = sp.population;
+	int lambda = sp.param->lambda;
+	int n = lambda;
+	for (int i = 0; i < lambda; i++) {
+		engine.f[i] = population->f[i];
+		engine.phi[i] = population->phi[i];
+		engine.index[i] = i;
+	}
+	if (child != NULL) {
+		engine.f[lambda] = child->f;
+		engine.phi[lambda] = child->phi;
+		engine.index[lambda] = lambda;
+		n++;
+	}
+	ShareArenaReset(&(sp.param->arena)); // A steady-state run has no generations, so the arena holds only one ranking's scratch space
+	ESSRSort(engine.f, engine.phi, sp.pf, n, n, engine.index, serial, &(sp.param->arena));
+	
+	// Copy the offspring over the individual ranked last and put it in the offspring's place in the ranking
+	if (child != NULL && engine.index[lambda] != lambda) {
+		int dropped = engine.index[lambda];
+		ESCopyIndividual(child, population->member[dropped], sp.param);
+		population->f[dropped] = child->f;
+		population->phi[dropped] = child->phi;
+		for (int i = 0; i < lambda; i++) {
+			if (engine.index[i] == lambda) {
+				engine.index[i] = dropped;
+			}
+		}
+	}
+	
+	memcpy(population->index, engine.index, sizeof(int) * lambda);
+	ESSortPopulation(population, sp.param);
+}
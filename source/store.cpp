@@ -0,0 +1,358 @@
+/*
+Stochastically ranked evolutionary strategy sampler for zebrafish segmentation
+Copyright (C) 2013 Ahmet Ay, Jack Holland, Adriana Sperlea, Sebastian Sangervasi
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+store.cpp contains functions for the evaluation store, a file of scores shared by every run of the sampler so a parameter set scored in an earlier run, or by another sampler running at the same time, is not simulated again.
+The file starts with STORE_MAGIC and is followed by records, each a store_record header, the parameter set and its values.
+Records are only ever appended, always while holding an exclusive flock on the file, and read while holding a shared one, so any number of processes can use the same file at once.
+*/
+
+#include <cerrno> // Needed for errno, EINTR
+#include <fcntl.h> // Needed for open, O_RDWR, O_CREAT, O_APPEND, O_CLOEXEC
+#include <sys/file.h> // Needed for flock
+#include <sys/mman.h> // Needed for mmap, munmap
+#include <sys/stat.h> // Needed for fstat
+#include <unistd.h> // Needed for read, close, ftruncate
+
+#include "store.hpp" // Function declarations
+
+#include "cache.hpp"
+#include "io.hpp"
+#include "macros.hpp"
+#include "sres.hpp"
+
+extern terminal* term; // Declared in init.cpp
+
+eval_store* store = NULL; // The global evaluation store, NULL when the user did not specify one
+
+/* init_store opens the evaluation store if the user specified one, creating it if it does not exist, and indexes the records already in it
+	parameters:
+		ip: the program's input parameters
+	returns: nothing
+	notes:
+		Only records scored by a simulation (or plugin) with the same contents and arguments are used, so a rebuilt simulation never reuses stale scores.
+	todo:
+*/
+void init_store (input_params& ip) {
+	if (ip.store_file == NULL) {
+		return;
+	}
+	
+	int rank = get_rank();
+	ostream& v = term->verbose();
+	term->rank(rank, v);
+	v << term->blue << "Opening the evaluation store " << term->reset << ip.store_file << " . . . ";
+	int tag = mem_tag(MEM_TAG_CACHE);
+	store = new eval_store(ip.num_dims, 1 + NUM_CONSTRAINTS);
+	mem_tag(tag);
+	store->context = hash_store_context(ip);
+	store->fd = open(ip.store_file, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+	if (store->fd == -1) {
+		term->failed_store();
+		exit(EXIT_FILE_READ_ERROR);
+	}
+	
+	// Write the magic bytes to a new file or check them in an existing one
+	lock_store(LOCK_EX);
+	struct stat info;
+	char magic[STORE_MAGIC_SIZE];
+	if (fstat(store->fd, &info) == -1) {
+		term->failed_store();
+		exit(EXIT_FILE_READ_ERROR);
+	}
+	if (info.st_size == 0) {
+		if (!write_pipe_bytes(store->fd, STORE_MAGIC, STORE_MAGIC_SIZE)) {
+			term->failed_store();
+			exit(EXIT_FILE_WRITE_ERROR);
+		}
+	} else if (pread(store->fd, magic, STORE_MAGIC_SIZE, 0) != STORE_MAGIC_SIZE || memcmp(magic, STORE_MAGIC, STORE_MAGIC_SIZE) != 0) {
+		term->failed_store();
+		exit(EXIT_FILE_READ_ERROR);
+	}
+	store->indexed_size = STORE_MAGIC_SIZE;
+	sync_store();
+	lock_store(LOCK_UN);
+	v << term->blue << "Done: " << term->reset << store->index->num_keys << " scores of this simulation found" << endl;
+}
+
+/* free_store prints how often the evaluation store was used and closes it
+	parameters:
+	returns: nothing
+	notes:
+	todo:
+*/
+void free_store () {
+	if (store == NULL) {
+		return;
+	}
+	if (store->hits + store->appended > 0) {
+		term->rank(get_rank());
+		cout << term->blue << "Evaluation store: " << term->reset << store->hits << term->blue << " hits, " << term->reset << store->appended << term->blue << " appended" << term->reset << endl;
+	}
+	if (store->map != NULL) {
+		munmap(store->map, store->map_size);
+	}
+	close(store->fd);
+	delete store;
+	store = NULL;
+}
+
+/* fitness_stored scores the given parameter sets, taking every score it can from the evaluation store and evaluating and appending the rest
+	parameters:
+		sets: the array of parameter sets to score
+		num_sets: the number of parameter sets in the array
+		scores: the array to store each set's score in
+		constraints: the arrays to store each set's constraint values in
+		evaluate: the function that evaluates the sets missing from the store
+	returns: nothing
+	notes:
+		No lock is held while the missing sets are evaluated, so processes sharing the store never wait on each other's simulations.
+	todo:
+*/
+void fitness_stored (double** sets, int num_sets, double* scores, double** constraints, ESfcnFGBatch evaluate) {
+	double** miss_sets = (double**)mallocate(sizeof(double*) * num_sets);
+	double** miss_constraints = (double**)mallocate(sizeof(double*) * num_sets);
+	double* miss_scores = (double*)mallocate(sizeof(double) * num_sets);
+	int* miss_indices = (int*)mallocate(sizeof(int) * num_sets);
+	
+	// Take the scores of the sets already in the store
+	fitness_cache* index = store->index;
+	int num_misses = 0;
+	lock_store(LOCK_SH);
+	sync_store();
+	lock_store(LOCK_UN);
+	for (int i = 0; i < num_sets; i++) {
+		int key = find_cache(index, sets[i], hash_set(sets[i], index->num_dims));
+		if (key == -1) {
+			miss_sets[num_misses] = sets[i];
+			miss_constraints[num_misses] = constraints != NULL ? constraints[i] : NULL;
+			miss_indices[num_misses] = i;
+			num_misses++;
+		} else {
+			double* values = index->values + key * index->num_values;
+			scores[i] = values[0];
+			for (int j = 0; j < NUM_CONSTRAINTS; j++) {
+				constraints[i][j] = values[1 + j];
+			}
+			store->hits++;
+		}
+	}
+	
+	// Evaluate the rest and append them
+	if (num_misses > 0) {
+		evaluate(miss_sets, num_misses, miss_scores, miss_constraints);
+		for (int i = 0; i < num_misses; i++) {
+			scores[miss_indices[i]] = miss_scores[i];
+		}
+		append_store(miss_sets, miss_scores, miss_constraints, num_misses);
+	}
+	
+	mfree(miss_sets);
+	mfree(miss_constraints);
+	mfree(miss_scores);
+	mfree(miss_indices);
+}
+
+/* hash_store_context hashes everything besides the parameter set that determines a simulation's score, i.e. the simulation (or plugin) file's contents and the user's simulation arguments
+	parameters:
+		ip: the program's input parameters
+	returns: the hash
+	notes:
+		The implicit arguments are left out since they only name the pipes.
+	todo:
+*/
+uint64_t hash_store_context (input_params& ip) {
+	const char* filename = ip.plugin_file != NULL ? ip.plugin_file : ip.sim_file;
+	int fd = open(filename, O_RDONLY | O_CLOEXEC);
+	if (fd == -1) {
+		term->failed_store();
+		exit(EXIT_FILE_READ_ERROR);
+	}
+	uint64_t hash = hash_bytes(NULL, 0, 0);
+	char buffer[65536];
+	ssize_t bytes;
+	while ((bytes = read(fd, buffer, sizeof(buffer))) > 0) {
+		hash = hash_bytes(buffer, bytes, hash);
+	}
+	close(fd);
+	if (bytes == -1) {
+		term->failed_store();
+		exit(EXIT_FILE_READ_ERROR);
+	}
+	for (int i = 1; i < ip.num_sim_args - (NUM_IMPLICIT_SIM_ARGS - 1); i++) {
+		hash = hash_bytes(ip.sim_args[i], strlen(ip.sim_args[i]) + 1, hash);
+	}
+	return hash;
+}
+
+/* hash_bytes continues a 64-bit FNV-1a hash over the given bytes
+	parameters:
+		bytes: the bytes to hash
+		num_bytes: the number of bytes
+		hash: the hash so far, or 0 to start a new one
+	returns: the hash including the given bytes
+	notes:
+	todo:
+*/
+uint64_t hash_bytes (const void* bytes, size_t num_bytes, uint64_t hash) {
+	if (hash == 0) {
+		hash = 0xcbf29ce484222325ULL;
+	}
+	const unsigned char* data = (const unsigned char*)bytes;
+	for (size_t i = 0; i < num_bytes; i++) {
+		hash ^= data[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+/* lock_store locks or unlocks the evaluation store's file
+	parameters:
+		operation: LOCK_SH, LOCK_EX or LOCK_UN
+	returns: nothing
+	notes:
+	todo:
+*/
+void lock_store (int operation) {
+	while (flock(store->fd, operation) == -1) {
+		if (errno != EINTR) {
+			term->failed_store();
+			exit(EXIT_FILE_READ_ERROR);
+		}
+	}
+}
+
+/* sync_store maps the part of the evaluation store appended since it was last mapped and indexes its records
+	parameters:
+	returns: nothing
+	notes:
+		The store must be locked. Indexing stops at the first incomplete or corrupt record, which can only be left behind by a process killed while appending and is cut off by the next append.
+	todo:
+*/
+void sync_store () {
+	struct stat info;
+	if (fstat(store->fd, &info) == -1) {
+		term->failed_store();
+		exit(EXIT_FILE_READ_ERROR);
+	}
+	size_t size = info.st_size;
+	if (size <= store->indexed_size) {
+		return;
+	}
+	if (size > store->map_size) {
+		if (store->map != NULL) {
+			munmap(store->map, store->map_size);
+		}
+		store->map = (char*)mmap(NULL, size, PROT_READ, MAP_SHARED, store->fd, 0);
+		if (store->map == MAP_FAILED) {
+			store->map = NULL;
+			term->failed_store();
+			exit(EXIT_FILE_READ_ERROR);
+		}
+		store->map_size = size;
+	}
+	
+	fitness_cache* index = store->index;
+	size_t offset = store->indexed_size;
+	while (offset + sizeof(store_record) <= size) {
+		store_record header;
+		memcpy(&header, store->map + offset, sizeof(store_record));
+		size_t payload = sizeof(double) * ((size_t)header.num_dims + header.num_values);
+		if (header.magic != STORE_RECORD_MAGIC || header.num_dims > (size - offset) / sizeof(double) || header.num_values > (size - offset) / sizeof(double) || offset + sizeof(store_record) + payload > size) {
+			break;
+		}
+		const char* checked = store->map + offset + 2 * sizeof(uint32_t);
+		if ((uint32_t)hash_bytes(checked, sizeof(store_record) - 2 * sizeof(uint32_t) + payload, 0) != header.checksum) {
+			break;
+		}
+		
+		// Index the record if it belongs to this simulation and is not indexed yet
+		if (header.context == store->context && (int)header.num_dims == index->num_dims && (int)header.num_values == index->num_values) {
+			double* set = (double*)mallocate(payload);
+			memcpy(set, store->map + offset + sizeof(store_record), payload);
+			uint64_t hash = hash_set(set, index->num_dims);
+			if (find_cache(index, set, hash) == -1) {
+				int key = add_cache(index, set, hash);
+				memcpy(index->values + key * index->num_values, set + index->num_dims, sizeof(double) * index->num_values);
+			}
+			mfree(set);
+		}
+		offset += sizeof(store_record) + payload;
+	}
+	store->indexed_size = offset;
+}
+
+/* append_store appends the given scored parameter sets to the evaluation store, skipping any another process appended in the meantime
+	parameters:
+		sets: the array of parameter sets
+		scores: each set's score
+		constraints: each set's constraint values
+		num_sets: the number of parameter sets in the array
+	returns: nothing
+	notes:
+		Every record is written with a single write while holding the exclusive lock, so readers never see part of one.
+	todo:
+*/
+void append_store (double** sets, double* scores, double** constraints, int num_sets) {
+	fitness_cache* index = store->index;
+	size_t record_size = sizeof(store_record) + sizeof(double) * (index->num_dims + index->num_values);
+	int tag = mem_tag(MEM_TAG_IO);
+	char* records = (char*)mallocate(record_size * num_sets);
+	mem_tag(tag);
+	
+	lock_store(LOCK_EX);
+	sync_store();
+	
+	// Cut off a record left incomplete by a killed process so the new records are not appended after it
+	struct stat info;
+	if (fstat(store->fd, &info) == -1 || ((size_t)info.st_size > store->indexed_size && ftruncate(store->fd, store->indexed_size) == -1)) {
+		term->failed_store();
+		exit(EXIT_FILE_WRITE_ERROR);
+	}
+	
+	int num_records = 0;
+	for (int i = 0; i < num_sets; i++) {
+		if (scores[i] == PENALTY_FITNESS || find_cache(index, sets[i], hash_set(sets[i], index->num_dims)) != -1) { // A penalty stands for a failure that may not happen again, so it is not shared
+			continue;
+		}
+		char* record = records + record_size * num_records;
+		store_record header;
+		header.magic = STORE_RECORD_MAGIC;
+		header.context = store->context;
+		header.num_dims = index->num_dims;
+		header.num_values = index->num_values;
+		double* payload = (double*)(record + sizeof(store_record));
+		memcpy(payload, sets[i], sizeof(double) * index->num_dims);
+		payload[index->num_dims] = scores[i];
+		for (int j = 0; j < NUM_CONSTRAINTS; j++) {
+			payload[index->num_dims + 1 + j] = constraints[i][j];
+		}
+		memcpy(record, &header, sizeof(store_record));
+		header.checksum = hash_bytes(record + 2 * sizeof(uint32_t), record_size - 2 * sizeof(uint32_t), 0);
+		memcpy(record, &header, sizeof(store_record));
+		num_records++;
+	}
+	if (num_records > 0 && !write_pipe_bytes(store->fd, records, record_size * num_records)) {
+		term->failed_store();
+		exit(EXIT_FILE_WRITE_ERROR);
+	}
+	store->appended += num_records;
+	sync_store();
+	lock_store(LOCK_UN);
+	mfree(records);
+}
@@ -0,0 +1,39 @@
+/*
+Stochastically ranked evolutionary strategy sampler for zebrafish segmentation
+Copyright (C) 2013 Ahmet Ay, Jack Holland, Adriana Sperlea, Sebastian Sangervasi
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+store.hpp contains function declarations for store.cpp.
+*/
+
+#ifndef STORE_HPP
+#define STORE_HPP
+
+#include "structs.hpp"
+
+extern eval_store* store; // Declared in store.cpp
+
+void init_store(input_params&);
+void free_store();
+void fitness_stored(double**, int, double*, double**, ESfcnFGBatch);
+uint64_t hash_store_context(input_params&);
+uint64_t hash_bytes(const void*, size_t, uint64_t);
+void lock_store(int);
+void sync_store();
+void append_store(double**, double*, double**, int);
+
+#endif
@@ -23,9 +23,15 @@ structs.hpp contains every struct used in the program.
 #ifndef STRUCTS_HPP
 #define STRUCTS_HPP
 
+#include <cmath> // Needed for pow
 #include <cstring> // Needed for strlen, strcpy, strcmp
 #include <iostream> // Needed for cout
 #include <fstream> // Needed for ofstream
+#include <pthread.h> // Needed for pthread_t, pthread_mutex_t, pthread_cond_t
+#include <stdint.h> // Needed for uint64_t
+#include <sys/epoll.h> // Needed for epoll_event
+#include <sys/types.h> // Needed for pid_t
+#include <unistd.h> // Needed for close
 
 // libSRES has different files for MPI and non-MPI versions
 #if defined(MPI)
@@ -34,7 +40,9 @@ structs.hpp contains every struct used in the program.
 	#include "../libsres/ESES.hpp"
 #endif
 
+#include "macros.hpp"
 #include "memory.hpp"
+#include "sres_plugin.h"
 
 using namespace std;
 
@@ -142,6 +150,41 @@ struct terminal {
 		cout << this->red << "A child process encountered an error!" << this->reset << endl;
 	}
 	
+	// Indicates a simulation ran longer than its timeout
+	void failed_timeout () {
+		cout << this->red << "A simulation timed out! Set -F or --on-failure to retry or penalty to keep going when this happens." << this->reset << endl;
+	}
+	
+	// Indicates the program couldn't watch its child processes
+	void failed_epoll () {
+		cout << this->red << "Couldn't watch the running simulations!" << this->reset << endl;
+	}
+	
+	// Indicates a persistent simulation worker kept dying after being restarted
+	void failed_worker () {
+		cout << this->red << "A simulation worker died too many times! Make sure the simulation keeps reading parameter sets until its input pipe is closed." << this->reset << endl;
+	}
+	
+	// Indicates the program couldn't load the fitness plugin
+	void failed_plugin_load (const char* error) {
+		cout << this->red << "Couldn't load the fitness plugin: " << error << this->reset << endl;
+	}
+	
+	// Indicates the fitness plugin reported an error
+	void failed_plugin () {
+		cout << this->red << "The fitness plugin reported an error!" << this->reset << endl;
+	}
+	
+	// Indicates the program couldn't open, read or append to the evaluation store
+	void failed_store () {
+		cout << this->red << "Couldn't use the evaluation store! Make sure the file is writable and was created by this program." << this->reset << endl;
+	}
+	
+	// Indicates the processes couldn't be split into the requested number of islands
+	void failed_islands () {
+		cout << this->red << "There are more islands than MPI processes! Set -i or --islands to at most the number of processes." << this->reset << endl;
+	}
+	
 	// Returns the verbose stream that prints only when verbose mode is on
 	ostream& verbose () {
 		return *(this->verbose_stream);
@@ -168,6 +211,10 @@ struct input_params {
 	// Input and output files' paths and names (either absolute or relative)
 	char* ranges_file; // The relative filename of the parameter ranges file, default=none
 	char* sim_file; // The relative filename of the simulation executable
+	char* plugin_file; // The relative filename of the fitness plugin to call instead of launching simulations, default=none
+	char* store_file; // The relative filename of the evaluation store shared between runs, default=none
+	int sim_fd; // The file descriptor the simulation executable is kept open with, default=-1 (not opened yet)
+	char* sim_exec_path; // The path simulations are executed from, either the open file descriptor's /proc entry or the simulation's filename
 	
 	// libSRES parameters
 	int num_dims; // The number of dimensions (i.e. rate parameters) to explore, default=45
@@ -179,17 +226,33 @@ struct input_params {
 	// Simulation parameters
 	char** sim_args; // Arguments to be passed to the simulation
 	int num_sim_args; // The number of arguments to be passed to the simulation
+	int num_workers; // The number of persistent simulation processes to keep alive, default=0 (launch a new simulation for every parameter set)
+	int batch_size; // The number of parameter sets sent to a simulation at once, default=1 (0 sends a whole generation)
+	int memoize; // How the fitness cache matches parameter sets, one of the MEMOIZE_ macros, default=MEMOIZE_NONE
+	double timeout; // The number of seconds a simulation may take per parameter set before it is killed, default=0 (no limit)
+	double timeout_factor; // The multiple of the 99th percentile of observed simulation times per set a simulation may take before it is killed, default=0 (no adaptive limit)
+	int on_failure; // What happens to a simulation that crashes or times out, one of the FAILURE_ macros, default=FAILURE_EXIT
+	int num_islands; // The number of islands the MPI processes are split into, each evolving its own population, default=1
+	int migration_interval; // The number of generations between migrations from each island, default=10
+	int topology; // Which island each island's migrants go to, one of the TOPOLOGY_ macros, default=TOPOLOGY_RING
+	bool steady_state; // Whether to evolve one offspring at a time, launching a new one whenever a simulation finishes, instead of a generation at a time, default=false
+	int num_jobs; // The number of simulations to run at once when the worker pool is not used, or the number of threads calling the fitness plugin, default=1
 	
 	// Output stream data
 	int printing_precision; // The number of digits of precision parameters should be printed with, default=6
 	bool verbose; // Whether or not the program is verbose, i.e. prints many messages about program and simulation state, default=false
 	bool quiet; // Whether or not the program is quiet, i.e. redirects cout to /dev/null, default=false
+	bool memory_usage; // Whether or not to track heap usage and print it after every generation, which requires the memory tracker, default=false
 	streambuf* cout_orig; // cout's original buffer to be restored at program completion
 	ofstream* null_stream; // A stream to /dev/null that cout is redirected to if quiet mode is set
 	
 	input_params () {
 		this->ranges_file = NULL;
 		this->sim_file = copy_str("../simulation/simulation");
+		this->sim_fd = -1;
+		this->plugin_file = NULL;
+		this->store_file = NULL;
+		this->sim_exec_path = NULL;
 		this->num_dims = 45;
 		this->pop_parents = 3;
 		this->pop_total = 20;
@@ -197,9 +260,21 @@ struct input_params {
 		this->seed = time(0);
 		this->sim_args = NULL;
 		this->num_sim_args = 0;
+		this->num_workers = 0;
+		this->batch_size = 1;
+		this->memoize = MEMOIZE_NONE;
+		this->timeout = 0;
+		this->timeout_factor = 0;
+		this->on_failure = FAILURE_EXIT;
+		this->num_islands = 1;
+		this->migration_interval = 10;
+		this->topology = TOPOLOGY_RING;
+		this->steady_state = false;
+		this->num_jobs = 1;
 		this->printing_precision = 6;
 		this->verbose = false;
 		this->quiet = false;
+		this->memory_usage = false;
 		this->cout_orig = NULL;
 		this->null_stream = new ofstream("/dev/null");
 	}
@@ -207,6 +282,12 @@ struct input_params {
 	~input_params () {
 		mfree(this->ranges_file);
 		mfree(this->sim_file);
+		if (this->sim_fd != -1) {
+			close(this->sim_fd);
+		}
+		mfree(this->sim_exec_path);
+		mfree(this->plugin_file);
+		mfree(this->store_file);
 		if (this->sim_args != NULL) {
 			for (int i = 0; i < this->num_sim_args; i++) {
 				mfree(this->sim_args[i]);
@@ -242,6 +323,457 @@ struct sres_params {
 	}
 };
 
+/* sim_job contains a simulation the supervisor launched for a batch of parameter sets
+	notes:
+		A job whose pid is 0 is a free slot.
+	todo:
+*/
+struct sim_job {
+	pid_t pid; // The PID of the simulation process
+	int pidfd; // A file descriptor that becomes readable when the simulation exits, -1 if the kernel does not support pidfds
+	int fd_read; // The file descriptor scores are read from
+	int fd_write; // The file descriptor parameter sets are written to, -1 once every set has been written or writing was given up
+	int id; // The identifier the job was submitted with
+	double** sets; // The parameter sets the simulation was sent, kept to send them again if it fails
+	int num_sets; // The number of parameter sets the simulation was sent
+	double* scores; // The array to store each set's score in
+	char* request; // The parameter sets serialized for the simulation's pipe, kept with the slot and reused by its later jobs
+	size_t request_capacity; // The number of bytes the request array has room for
+	size_t request_size; // The number of bytes of the current job's request
+	size_t bytes_written; // The number of bytes of the request written so far
+	int* reply; // The (maximum score, score) pairs read from the simulation so far, kept with the slot and reused by its later jobs
+	size_t reply_size; // The number of bytes the reply array has room for
+	size_t bytes_read; // The number of bytes of the reply read so far
+	bool replied; // Whether or not the reply is over, i.e. every score has been read or the simulation closed the pipe
+	bool exited; // Whether or not the simulation has exited and been reaped
+	bool crashed; // Whether or not the simulation exited abnormally
+	bool timed_out; // Whether or not the simulation was killed for running past its deadline
+	int attempts; // The number of times the sets have been simulated before, counting only failures
+	double started; // The monotonic time in seconds the simulation was launched at
+	double deadline; // The monotonic time in seconds the simulation is killed at, 0 for no deadline
+	
+	sim_job () {
+		this->pid = 0;
+		this->pidfd = -1;
+		this->fd_read = -1;
+		this->fd_write = -1;
+		this->id = 0;
+		this->sets = NULL;
+		this->num_sets = 0;
+		this->scores = NULL;
+		this->request = NULL;
+		this->request_capacity = 0;
+		this->request_size = 0;
+		this->bytes_written = 0;
+		this->reply = NULL;
+		this->reply_size = 0;
+		this->bytes_read = 0;
+		this->replied = false;
+		this->exited = false;
+		this->crashed = false;
+		this->timed_out = false;
+		this->attempts = 0;
+		this->started = 0;
+		this->deadline = 0;
+	}
+};
+
+/* sim_timing contains the recent simulation times adaptive timeouts are based on
+	notes:
+		There should be only one instance of sim_timing at any time.
+		Times are per parameter set, i.e. a simulation's running time divided by the number of sets it was sent, so batches of any size can share them.
+	todo:
+*/
+struct sim_timing {
+	double latencies[LATENCY_SAMPLES]; // The most recent times, overwritten in a circle once full
+	double sorted[LATENCY_SAMPLES]; // Scratch space for finding the percentile without reordering latencies
+	int num_latencies; // The number of times stored, at most LATENCY_SAMPLES
+	int next_latency; // The index the next time is stored at
+	
+	sim_timing () {
+		this->num_latencies = 0;
+		this->next_latency = 0;
+	}
+};
+
+/* sim_supervisor contains the simulations running at once and the epoll instance watching them
+	notes:
+		There should be only one instance of sim_supervisor at any time.
+	todo:
+*/
+struct sim_supervisor {
+	int epoll_fd; // The epoll instance watching every job's score pipe and pidfd
+	sim_job* jobs; // The array of job slots
+	int max_jobs; // The number of job slots, i.e. how many simulations can run at once
+	int running; // The number of slots in use
+	struct epoll_event* events; // The array epoll_wait stores events in, with room for three per job
+	int* finished; // The array simulate_sets_supervised has supervisor_wait store finished jobs in, with room for every job
+	
+	explicit sim_supervisor (int max_jobs) {
+		this->epoll_fd = -1;
+		this->jobs = new sim_job[max_jobs];
+		this->max_jobs = max_jobs;
+		this->running = 0;
+		this->events = new struct epoll_event[3 * max_jobs];
+		this->finished = new int[max_jobs];
+	}
+	
+	~sim_supervisor () {
+		for (int i = 0; i < this->max_jobs; i++) {
+			mfree(this->jobs[i].request);
+			mfree(this->jobs[i].reply);
+		}
+		delete[] this->jobs;
+		delete[] this->events;
+		delete[] this->finished;
+	}
+};
+
+/* sim_worker contains the process and pipes of one persistent simulation
+	notes:
+		A worker whose pid is 0 is not running.
+	todo:
+*/
+struct sim_worker {
+	pid_t pid; // The PID of the simulation process
+	int fd_write; // The file descriptor parameter sets are written to
+	int fd_read; // The file descriptor scores are read from
+	
+	sim_worker () {
+		this->pid = 0;
+		this->fd_write = -1;
+		this->fd_read = -1;
+	}
+};
+
+/* sim_pool contains the persistent simulations parameter sets are handed to when the worker pool is enabled
+	notes:
+		There should be only one instance of sim_pool at any time.
+	todo:
+*/
+struct sim_pool {
+	sim_worker* workers; // The array of workers
+	int num_workers; // The number of workers in the array
+	
+	explicit sim_pool (int num_workers) {
+		this->workers = new sim_worker[num_workers];
+		this->num_workers = num_workers;
+	}
+	
+	~sim_pool () {
+		delete[] this->workers;
+	}
+};
+
+/* sim_plugin contains the loaded fitness plugin and the threads calling it
+	notes:
+		There should be only one instance of sim_plugin at any time.
+		The main thread is thread 0 and evaluates alongside the num_threads - 1 helper threads, which sleep between batches.
+	todo:
+*/
+struct sim_plugin {
+	void* library; // The handle dlopen returned
+	sres_plugin_init_fn init_state; // The plugin's sres_plugin_init, NULL if it has none
+	sres_plugin_fitness_fn fitness; // The plugin's sres_plugin_fitness
+	sres_plugin_free_fn free_state; // The plugin's sres_plugin_free, NULL if it has none
+	int num_dims; // The number of parameters in every set
+	int num_threads; // The number of threads calling the plugin, including the main thread
+	void** states; // Each thread's plugin state
+	pthread_t* threads; // The helper threads, indexed from 1
+	pthread_mutex_t lock; // Guards the batch and the counters below
+	pthread_cond_t work_ready; // Signaled when a batch is posted or the helpers should stop
+	pthread_cond_t work_done; // Signaled when the last helper finishes its part of a batch
+	
+	// The batch being evaluated
+	double** sets; // The parameter sets to score
+	double* scores; // The array to store each set's fitness in
+	double** constraints; // The arrays to store each set's constraint values in
+	int num_sets; // The number of sets in the batch
+	int next_set; // The index of the next set to score, taken atomically by every thread
+	
+	int batch; // Increases with every posted batch so helpers can tell new work from a spurious wakeup
+	int busy; // The number of helpers still working on the batch or still starting up
+	bool failed; // Whether the plugin reported an error in any thread
+	bool stopping; // Whether the helpers should exit
+	
+	sim_plugin (int num_dims, int num_threads) {
+		this->library = NULL;
+		this->init_state = NULL;
+		this->fitness = NULL;
+		this->free_state = NULL;
+		this->num_dims = num_dims;
+		this->num_threads = num_threads;
+		this->states = (void**)mallocate(sizeof(void*) * num_threads);
+		this->threads = (pthread_t*)mallocate(sizeof(pthread_t) * num_threads);
+		for (int i = 0; i < num_threads; i++) {
+			this->states[i] = NULL;
+		}
+		pthread_mutex_init(&(this->lock), NULL);
+		pthread_cond_init(&(this->work_ready), NULL);
+		pthread_cond_init(&(this->work_done), NULL);
+		this->sets = NULL;
+		this->scores = NULL;
+		this->constraints = NULL;
+		this->num_sets = 0;
+		this->next_set = 0;
+		this->batch = 0;
+		this->busy = 0;
+		this->failed = false;
+		this->stopping = false;
+	}
+	
+	~sim_plugin () {
+		pthread_cond_destroy(&(this->work_done));
+		pthread_cond_destroy(&(this->work_ready));
+		pthread_mutex_destroy(&(this->lock));
+		mfree(this->threads);
+		mfree(this->states);
+	}
+};
+
+/* fitness_cache contains the score of every parameter set evaluated so far so a repeated set is not simulated again
+	notes:
+		The global fitness cache and the evaluation store's index are the only instances of fitness_cache.
+		Keys are stored back to back in one array and the hash table holds indices into it, so growing the table never moves a key.
+		Nothing is ever evicted since a run of the sampler scores few enough sets to keep all of them.
+	todo:
+*/
+struct fitness_cache {
+	int num_dims; // The number of parameters in every key
+	int num_values; // The number of values stored per key, i.e. the score followed by the constraints
+	bool rounded; // Whether keys are rounded to the printing precision instead of matched exactly
+	double scale; // The power of 10 parameters are multiplied by before rounding
+	
+	double* keys; // The keys, num_dims parameters each
+	double* values; // The values, num_values each, in the same order as the keys
+	uint64_t* hashes; // The hash of each key
+	int num_keys; // The number of keys stored
+	int max_keys; // The number of keys the arrays have room for
+	
+	int* table; // The hash table of key indices, -1 for an empty slot
+	int capacity; // The number of slots in the table, always a power of 2
+	
+	long hits; // The number of sets whose score came from the cache
+	long misses; // The number of sets that had to be evaluated
+	
+	fitness_cache (int num_dims, int num_values, bool rounded, int precision) {
+		this->num_dims = num_dims;
+		this->num_values = num_values;
+		this->rounded = rounded;
+		this->scale = pow(10.0, precision);
+		this->num_keys = 0;
+		this->max_keys = 64;
+		this->keys = (double*)mallocate(sizeof(double) * num_dims * this->max_keys);
+		this->values = (double*)mallocate(sizeof(double) * num_values * this->max_keys);
+		this->hashes = (uint64_t*)mallocate(sizeof(uint64_t) * this->max_keys);
+		this->capacity = 128;
+		this->table = (int*)mallocate(sizeof(int) * this->capacity);
+		for (int i = 0; i < this->capacity; i++) {
+			this->table[i] = -1;
+		}
+		this->hits = 0;
+		this->misses = 0;
+	}
+	
+	~fitness_cache () {
+		mfree(this->keys);
+		mfree(this->values);
+		mfree(this->hashes);
+		mfree(this->table);
+	}
+};
+
+/* eval_store contains the evaluation store, a log of scores kept on disk and shared by every run of the sampler on the same simulation
+	notes:
+		There should be only one instance of eval_store at any time.
+		The log is append-only and memory-mapped; each process indexes the records it has not seen yet every time it uses the store.
+	todo:
+*/
+struct eval_store {
+	int fd; // The file descriptor of the log
+	uint64_t context; // The hash of the simulation (or plugin) and its arguments, which every record of this simulation starts with
+	char* map; // The log mapped into memory, NULL if nothing is mapped
+	size_t map_size; // The number of bytes mapped
+	size_t indexed_size; // The number of bytes of the log indexed so far
+	fitness_cache* index; // The scores of every record of this simulation, keyed by parameter set
+	long hits; // The number of sets whose score came from the store
+	long appended; // The number of sets this process appended to the store
+	
+	eval_store (int num_dims, int num_values) {
+		this->fd = -1;
+		this->context = 0;
+		this->map = NULL;
+		this->map_size = 0;
+		this->indexed_size = 0;
+		this->index = new fitness_cache(num_dims, num_values, false, 0);
+		this->hits = 0;
+		this->appended = 0;
+	}
+	
+	~eval_store () {
+		delete this->index;
+	}
+};
+
+/* store_record contains the header of every record in the evaluation store, which is followed by the record's parameters and values
+	notes:
+		The checksum lets a process skip a record another process was killed in the middle of appending.
+	todo:
+*/
+struct store_record {
+	uint32_t magic; // STORE_RECORD_MAGIC
+	uint32_t checksum; // The low 32 bits of the hash of the rest of the record
+	uint64_t context; // The hash of the simulation and its arguments the record was scored by
+	uint32_t num_dims; // The number of parameters following the header
+	uint32_t num_values; // The number of values following the parameters, i.e. the score followed by the constraints
+};
+
+#if defined(MPI)
+/* sim_islands contains the communicators and migration state of the island model, where the MPI processes are split into islands that each evolve their own population
+	notes:
+		There should be only one instance of sim_islands at any time.
+		Only the leader of each island, i.e. its rank 0, is in the leaders communicator and sends or receives migrants.
+	todo:
+*/
+struct sim_islands {
+	int island; // The index of this process's island
+	int num_islands; // The number of islands
+	MPI_Comm comm; // The communicator of this process's island
+	MPI_Comm leaders; // The communicator of the islands' leaders, MPI_COMM_NULL on every other process
+	unsigned int topology_seed; // The state of the random number generator picking destinations for the random topology, kept apart from libSRES's
+	int* sent; // The number of migrants sent to each island
+	MPI_Request* sends; // The requests of the migrants sent and not yet known to be delivered
+	double** migrants; // The buffers of the migrants sent, one per request
+	int num_sends; // The number of requests in use
+	int max_sends; // The number of requests there is room for
+	long emigrated; // The number of migrants this island sent
+	long immigrated; // The number of migrants this island received and took in
+	
+	sim_islands (int island, int num_islands) {
+		this->island = island;
+		this->num_islands = num_islands;
+		this->comm = MPI_COMM_NULL;
+		this->leaders = MPI_COMM_NULL;
+		this->topology_seed = 0;
+		this->sent = (int*)mallocate(sizeof(int) * num_islands);
+		for (int i = 0; i < num_islands; i++) {
+			this->sent[i] = 0;
+		}
+		this->sends = NULL;
+		this->migrants = NULL;
+		this->num_sends = 0;
+		this->max_sends = 0;
+		this->emigrated = 0;
+		this->immigrated = 0;
+	}
+	
+	~sim_islands () {
+		mfree(this->sent);
+		mfree(this->sends);
+		mfree(this->migrants);
+	}
+};
+#endif
+
+/* steady_engine contains the offspring in flight and the scratch space of the steady-state engine
+	notes:
+		Each slot holds one offspring while its simulation runs; slots are identified to the supervisor by their index.
+	todo:
+*/
+struct steady_engine {
+	int num_slots; // The number of offspring that can be simulated at once
+	ESIndividual** children; // The offspring of each slot
+	double** sets; // Each slot's offspring's parameters, as the supervisor takes them
+	double* scores; // The score of each slot's offspring
+	bool* busy; // Whether each slot's offspring is being simulated
+	double* f; // The fitness of the population and an offspring, to rank them
+	double* phi; // The constraint penalty of the population and an offspring, to rank them
+	int* index; // The ranking of the population and an offspring
+	
+	steady_engine (int num_slots, int lambda) {
+		this->num_slots = num_slots;
+		this->children = (ESIndividual**)mallocate(sizeof(ESIndividual*) * num_slots);
+		this->sets = (double**)mallocate(sizeof(double*) * num_slots);
+		this->scores = (double*)mallocate(sizeof(double) * num_slots);
+		this->busy = (bool*)mallocate(sizeof(bool) * num_slots);
+		for (int i = 0; i < num_slots; i++) {
+			this->children[i] = NULL;
+			this->busy[i] = false;
+		}
+		this->f = (double*)mallocate(sizeof(double) * (lambda + 1));
+		this->phi = (double*)mallocate(sizeof(double) * (lambda + 1));
+		this->index = (int*)mallocate(sizeof(int) * (lambda + 1));
+	}
+	
+	~steady_engine () {
+		mfree(this->children);
+		mfree(this->sets);
+		mfree(this->scores);
+		mfree(this->busy);
+		mfree(this->f);
+		mfree(this->phi);
+		mfree(this->index);
+	}
+};
+
+/* eval_counts contains how many parameter sets this process really evaluated, i.e. simulated or passed to the fitness plugin, not counting scores taken from the fitness cache or evaluation store
+	notes:
+		There should be only one instance of eval_counts at any time.
+		Wasted evaluations are ones whose scores were thrown away, e.g. the sets a dying worker was scoring, which are evaluated again.
+	todo:
+*/
+struct eval_counts {
+	long init; // The number of evaluations of the initial population
+	long generation; // The number of evaluations of offspring
+	long wasted; // The number of evaluations whose scores were thrown away
+	long crashed; // The number of simulations that crashed or replied with too few scores
+	long timed_out; // The number of simulations killed for running past their deadline
+	long retried; // The number of failed simulations whose sets were simulated again
+	long penalized; // The number of parameter sets given the penalty fitness
+	int phase; // The phase new evaluations are counted toward, one of the EVAL_PHASE_ macros
+	
+	eval_counts () {
+		this->init = 0;
+		this->generation = 0;
+		this->wasted = 0;
+		this->crashed = 0;
+		this->timed_out = 0;
+		this->retried = 0;
+		this->penalized = 0;
+		this->phase = EVAL_PHASE_INIT;
+	}
+};
+
+/* mem_header precedes every block mallocate returns when the memory pool or the memory tracker is compiled in
+	notes:
+		The header is 16 bytes so the block after it keeps malloc's alignment.
+		It is laid over raw memory and never constructed.
+	todo:
+*/
+struct mem_header {
+	size_t size; // The number of bytes requested
+	unsigned int size_class; // The size class the block belongs to, MEM_NUM_CLASSES if it came from malloc
+	unsigned int tag; // The category the memory tracker counts the block toward, MEM_NUM_TAGS if it was allocated while tracking was off
+};
+
+/* mem_cache contains one thread's free blocks of every size class of the memory pool
+	notes:
+		Every thread that allocates has one instance, so a thread allocates and frees without locking until one of its lists runs empty or grows too long.
+		A free block's first bytes after its header point to the next free block of the list.
+	todo:
+*/
+struct mem_cache {
+	mem_header* blocks[MEM_NUM_CLASSES]; // The free blocks of each size class
+	int num_blocks[MEM_NUM_CLASSES]; // The number of free blocks of each size class
+	
+	mem_cache () {
+		for (int i = 0; i < MEM_NUM_CLASSES; i++) {
+			this->blocks[i] = NULL;
+			this->num_blocks[i] = 0;
+		}
+	}
+};
+
 /* input_data contains information for retrieving data from an input file
 	notes:
 		All input files should be read with read_file and an input_data struct, storing their contents in a string buffer.
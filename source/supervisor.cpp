@@ -0,0 +1,523 @@
+/*
+Stochastically ranked evolutionary strategy sampler for zebrafish segmentation
+Copyright (C) 2013 Ahmet Ay, Jack Holland, Adriana Sperlea, Sebastian Sangervasi
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+supervisor.cpp contains functions for the supervisor that runs many simulations at once from a single thread.
+Every running simulation's score pipe and process are watched with epoll, so whichever simulation finishes first is read and reaped first without blocking on the others.
+*/
+
+#include <algorithm> // Needed for min, max
+#include <cmath> // Needed for ceil
+#include <cerrno> // Needed for errno, EINTR, EAGAIN
+#include <csignal> // Needed for signal, kill, SIGPIPE, SIGKILL
+#include <cstring> // Needed for memcpy
+#include <fcntl.h> // Needed for fcntl, O_NONBLOCK
+#include <sys/epoll.h> // Needed for epoll_create1, epoll_ctl, epoll_wait
+#include <stdint.h> // Needed for uint64_t
+#include <sys/syscall.h> // Needed for SYS_pidfd_open
+#include <sys/wait.h> // Needed for waitpid
+#include <unistd.h> // Needed for read, write, close, syscall
+
+#include "supervisor.hpp" // Function declarations
+
+#include "io.hpp"
+#include "macros.hpp"
+#include "sres.hpp"
+
+extern terminal* term; // Declared in init.cpp
+extern input_params ip; // Declared in main.cpp
+extern eval_counts evals; // Declared in sres.cpp
+
+sim_supervisor* supervisor = NULL; // The global supervisor, NULL when the worker pool is used instead
+
+/* init_supervisor creates the supervisor with room for as many simulations as the user wants to run at once
+	parameters:
+		ip: the program's input parameters
+	returns: nothing
+	notes:
+		The worker pool or a fitness plugin takes the place of the supervisor when either is enabled.
+		SIGPIPE is ignored so a simulation that closes its input before reading every set surfaces as a failed write handled by the failure policy instead of ending the sampler.
+	todo:
+*/
+void init_supervisor (input_params& ip) {
+	if (ip.num_workers > 0 || ip.plugin_file != NULL) {
+		return;
+	}
+	signal(SIGPIPE, SIG_IGN);
+	supervisor = new sim_supervisor(ip.num_jobs);
+	supervisor->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (supervisor->epoll_fd == -1) {
+		term->failed_epoll();
+		exit(EXIT_PIPE_CREATE_ERROR);
+	}
+}
+
+/* free_supervisor closes the supervisor's epoll instance and frees it
+	parameters:
+	returns: nothing
+	notes:
+		Every submitted simulation must have been waited for before calling this function.
+	todo:
+*/
+void free_supervisor () {
+	if (supervisor == NULL) {
+		return;
+	}
+	close(supervisor->epoll_fd);
+	delete supervisor;
+	supervisor = NULL;
+}
+
+/* simulate_sets_supervised runs the batches of the given parameter sets, keeping the supervisor full until every set has a score
+	parameters:
+		sets: the array of parameter sets to simulate
+		num_sets: the number of parameter sets in the array
+		batch_size: the number of parameter sets to send to a simulation at once
+		scores: the array to store each set's score in
+	returns: nothing
+	notes:
+		Whichever simulation finishes first is collected first and its slot is immediately given to the next batch, so one slow simulation does not hold up the others.
+	todo:
+*/
+void simulate_sets_supervised (double* sets[], int num_sets, int batch_size, double scores[]) {
+	int next = 0;
+	while (next < num_sets || supervisor->running > 0) {
+		while (next < num_sets && !supervisor_full()) {
+			int size = min(batch_size, num_sets - next);
+			supervisor_submit(next, sets + next, size, scores + next);
+			next += size;
+		}
+		supervisor_wait(supervisor->finished, -1);
+	}
+}
+
+/* supervisor_full checks whether the supervisor is running as many simulations as it is allowed to
+	parameters:
+	returns: true if no more simulations can be submitted until one finishes, false otherwise
+	notes:
+	todo:
+*/
+bool supervisor_full () {
+	return supervisor->running == supervisor->max_jobs;
+}
+
+/* supervisor_submit launches a simulation for the given parameter sets and returns without waiting for it
+	parameters:
+		id: an identifier of the caller's choice that supervisor_wait reports when the simulation finishes
+		sets: the array of parameter sets to simulate
+		num_sets: the number of parameter sets in the array
+		scores: the array to store each set's score in once the simulation finishes
+	returns: the slot of the job running the simulation
+	notes:
+		The supervisor must not be full when this function is called.
+	todo:
+*/
+int supervisor_submit (int id, double* sets[], int num_sets, double scores[]) {
+	// Find a free slot
+	int slot = 0;
+	while (supervisor->jobs[slot].pid != 0) {
+		slot++;
+	}
+	launch_job(slot, id, sets, num_sets, scores, 0);
+	supervisor->running++;
+	return slot;
+}
+
+/* launch_job launches a simulation for the given parameter sets in the given slot
+	parameters:
+		slot: the slot of the job, which must be free
+		id: the identifier the job was submitted with
+		sets: the array of parameter sets to simulate
+		num_sets: the number of parameter sets in the array
+		scores: the array to store each set's score in once the simulation finishes
+		attempts: the number of times the sets have been simulated before and failed
+	returns: nothing
+	notes:
+		The simulation's exit is watched with a pidfd when the kernel supports them, otherwise the simulation is reaped with a blocking wait once its pipe is closed.
+		The parameter sets are written without blocking; whatever does not fit in the pipe is written by the event loop as the simulation reads, so a simulation that stops reading is still killed at its deadline.
+	todo:
+*/
+void launch_job (int slot, int id, double* sets[], int num_sets, double scores[], int attempts) {
+	sim_job& job = supervisor->jobs[slot];
+	
+	// Launch the simulation
+	job.started = monotonic_time();
+	job.deadline = sim_deadline(job.started, num_sets);
+	job.pid = start_simulation(&(job.fd_write), &(job.fd_read));
+	job.id = id;
+	job.sets = sets;
+	job.num_sets = num_sets;
+	job.scores = scores;
+	size_t reply_size = sizeof(int) * 2 * num_sets;
+	if (job.reply_size < reply_size) { // The slot's reply array is only grown, so once it fits the largest batch no job allocates
+		mfree(job.reply);
+		int tag = mem_tag(MEM_TAG_IO);
+		job.reply = (int*)mallocate(reply_size);
+		mem_tag(tag);
+		job.reply_size = reply_size;
+	}
+	
+	// Serialize the number of dimensions, i.e. parameters per set, the number of sets and the sets themselves into the slot's request array, which is only grown like the reply array
+	size_t set_size = sizeof(double) * ip.num_dims;
+	size_t request_size = sizeof(int) * 2 + set_size * num_sets;
+	if (job.request_capacity < request_size) {
+		mfree(job.request);
+		int tag = mem_tag(MEM_TAG_IO);
+		job.request = (char*)mallocate(request_size);
+		mem_tag(tag);
+		job.request_capacity = request_size;
+	}
+	memcpy(job.request, &(ip.num_dims), sizeof(int));
+	memcpy(job.request + sizeof(int), &num_sets, sizeof(int));
+	for (int i = 0; i < num_sets; i++) {
+		memcpy(job.request + sizeof(int) * 2 + set_size * i, sets[i], set_size);
+	}
+	job.request_size = request_size;
+	job.bytes_written = 0;
+	job.bytes_read = 0;
+	job.replied = false;
+	job.exited = false;
+	job.crashed = false;
+	job.timed_out = false;
+	job.attempts = attempts;
+	
+	// Send as much of the request as the pipe takes and watch the rest of it, the simulation's score pipe and its process
+	if (fcntl(job.fd_write, F_SETFL, O_NONBLOCK) == -1) {
+		term->failed_pipe_write();
+		exit(EXIT_PIPE_WRITE_ERROR);
+	}
+	if (fcntl(job.fd_read, F_SETFL, O_NONBLOCK) == -1) {
+		term->failed_pipe_read();
+		exit(EXIT_PIPE_READ_ERROR);
+	}
+	handle_request(job);
+	if (job.fd_write != -1) {
+		watch_fd(job.fd_write, slot, JOB_FD_SETS);
+	}
+	watch_fd(job.fd_read, slot, JOB_FD_SCORES);
+	#if defined(SYS_pidfd_open)
+		job.pidfd = syscall(SYS_pidfd_open, job.pid, 0);
+	#else
+		job.pidfd = -1;
+	#endif
+	if (job.pidfd != -1) {
+		watch_fd(job.pidfd, slot, JOB_FD_EXIT);
+	}
+}
+
+/* supervisor_wait handles the events of the running simulations until at least one finishes or the timeout passes
+	parameters:
+		finished: an array with room for the supervisor's maximum number of jobs to store the identifier of each finished job in
+		timeout: the number of milliseconds to wait, or -1 to wait until a simulation finishes
+	returns: the number of jobs that finished, whose scores have been stored and whose slots are free again
+	notes:
+		epoll_wait also wakes up at the earliest simulation deadline so stragglers are killed on time.
+		A failed job that is retried does not count as finished; it keeps its slot and its identifier is reported once a later attempt finishes.
+	todo:
+*/
+int supervisor_wait (int* finished, int timeout) {
+	struct epoll_event* events = supervisor->events;
+	double give_up = timeout >= 0 ? monotonic_time() + timeout / 1000.0 : 0;
+	int num_finished = 0;
+	while (num_finished == 0) {
+		int num_events = epoll_wait(supervisor->epoll_fd, events, supervisor->max_jobs * 3, epoll_timeout(give_up));
+		if (num_events == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			term->failed_epoll();
+			exit(EXIT_PIPE_READ_ERROR);
+		}
+		
+		for (int i = 0; i < num_events; i++) {
+			int slot = events[i].data.u64 >> 2;
+			int kind = events[i].data.u64 & 3;
+			sim_job& job = supervisor->jobs[slot];
+			int fd = kind == JOB_FD_EXIT ? job.pidfd : (kind == JOB_FD_SETS ? job.fd_write : job.fd_read);
+			if (job.pid == 0 || fd == -1) { // The job finished or was relaunched on an earlier event in this batch
+				continue;
+			}
+			if (kind == JOB_FD_EXIT) {
+				handle_exit(job);
+			} else if (kind == JOB_FD_SETS) {
+				handle_request(job);
+			} else {
+				handle_reply(job);
+			}
+			if (job.replied && job.exited) {
+				int id = job.id;
+				if (complete_job(slot)) {
+					finished[num_finished++] = id;
+				}
+			}
+		}
+		
+		kill_stragglers();
+		if (num_events == 0 && timeout >= 0 && monotonic_time() >= give_up) {
+			break;
+		}
+	}
+	return num_finished;
+}
+
+/* epoll_timeout calculates how long epoll_wait should wait for, i.e. until the caller gives up or the earliest simulation deadline, whichever comes first
+	parameters:
+		give_up: the monotonic time the caller stops waiting at, 0 to wait until a simulation finishes
+	returns: the number of milliseconds to wait, or -1 to wait until an event arrives
+	notes:
+	todo:
+*/
+int epoll_timeout (double give_up) {
+	double wake = give_up;
+	for (int slot = 0; slot < supervisor->max_jobs; slot++) {
+		sim_job& job = supervisor->jobs[slot];
+		if (job.pid != 0 && job.deadline > 0 && !job.timed_out && (wake == 0 || job.deadline < wake)) {
+			wake = job.deadline;
+		}
+	}
+	if (wake == 0) {
+		return -1;
+	}
+	return max(0, (int)ceil((wake - monotonic_time()) * 1000));
+}
+
+/* kill_stragglers kills every simulation that is still running past its deadline
+	parameters:
+	returns: nothing
+	notes:
+		The simulation's whole process group is killed, and the job is handled like any other once the simulation is reaped, which leads to the failure policy.
+	todo:
+*/
+void kill_stragglers () {
+	double now = monotonic_time();
+	for (int slot = 0; slot < supervisor->max_jobs; slot++) {
+		sim_job& job = supervisor->jobs[slot];
+		if (job.pid != 0 && job.deadline > 0 && now >= job.deadline && !job.timed_out && !job.replied) {
+			kill(-job.pid, SIGKILL); // The whole process group, since a wrapper script's children hold the score pipe too
+			job.timed_out = true;
+			evals.timed_out++;
+		}
+	}
+}
+
+/* watch_fd adds the given file descriptor of a job to the supervisor's epoll instance
+	parameters:
+		fd: the file descriptor to watch
+		slot: the slot of the job the file descriptor belongs to
+		kind: which of the job's file descriptors it is, JOB_FD_SCORES, JOB_FD_EXIT or JOB_FD_SETS
+	returns: nothing
+	notes:
+		The slot and the kind of file descriptor are packed into the event data so an event leads straight to its job.
+		The pipe parameter sets are written to is watched for room to write, every other file descriptor for something to read.
+	todo:
+*/
+void watch_fd (int fd, int slot, int kind) {
+	struct epoll_event event;
+	event.events = kind == JOB_FD_SETS ? EPOLLOUT : EPOLLIN;
+	event.data.u64 = ((uint64_t)slot << 2) | kind;
+	if (epoll_ctl(supervisor->epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1) {
+		term->failed_epoll();
+		exit(EXIT_PIPE_READ_ERROR);
+	}
+}
+
+/* handle_request writes whatever part of the given job's parameter sets its pipe has room for without blocking
+	parameters:
+		job: the job whose parameter set pipe is writable
+	returns: nothing
+	notes:
+		Once every set has been written the pipe is closed so the simulation sees the end of its input.
+		If the simulation closed its input before reading every set it cannot score them all, so it is killed and the job is left to the failure policy once it is reaped.
+	todo:
+*/
+void handle_request (sim_job& job) {
+	while (job.bytes_written < job.request_size) {
+		ssize_t written = write(job.fd_write, job.request + job.bytes_written, job.request_size - job.bytes_written);
+		if (written == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (errno == EAGAIN) {
+				return;
+			}
+			if (errno != EPIPE) {
+				term->failed_pipe_write();
+				exit(EXIT_PIPE_WRITE_ERROR);
+			}
+			kill(-job.pid, SIGKILL);
+			break;
+		}
+		job.bytes_written += written;
+	}
+	close_request(job);
+}
+
+/* close_request closes the given job's parameter set pipe if it is still open
+	parameters:
+		job: the job whose pipe to close
+	returns: nothing
+	notes:
+		Closing the pipe also removes it from the epoll instance.
+	todo:
+*/
+void close_request (sim_job& job) {
+	if (job.fd_write == -1) {
+		return;
+	}
+	if (close(job.fd_write) == -1) {
+		term->failed_pipe_write();
+		exit(EXIT_PIPE_WRITE_ERROR);
+	}
+	job.fd_write = -1;
+}
+
+/* handle_reply reads whatever part of the given job's scores is available without blocking
+	parameters:
+		job: the job whose score pipe is readable
+	returns: nothing
+	notes:
+		Once every score has been read, or the simulation closed the pipe early, the pipe is closed, which also removes it from the epoll instance, and any parameter sets still unwritten are given up.
+		If the pidfd could not be opened the simulation is reaped here, which only blocks for as long as the simulation takes to exit after closing its pipe.
+	todo:
+*/
+void handle_reply (sim_job& job) {
+	if (job.replied) {
+		return;
+	}
+	size_t size = sizeof(int) * 2 * job.num_sets;
+	while (job.bytes_read < size) {
+		ssize_t received = read(job.fd_read, (char*)job.reply + job.bytes_read, size - job.bytes_read);
+		if (received == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (errno == EAGAIN) {
+				return;
+			}
+			term->failed_pipe_read();
+			exit(EXIT_PIPE_READ_ERROR);
+		}
+		if (received == 0) { // The simulation closed the pipe without sending every score, which complete_job treats as a failure
+			break;
+		}
+		job.bytes_read += received;
+	}
+	
+	if (close(job.fd_read) == -1) {
+		term->failed_pipe_read();
+		exit(EXIT_PIPE_READ_ERROR);
+	}
+	job.fd_read = -1;
+	if (job.bytes_read == size) {
+		for (int i = 0; i < job.num_sets; i++) {
+			job.scores[i] = convert_score(job.reply[2 * i], job.reply[2 * i + 1]);
+		}
+	}
+	job.replied = true;
+	close_request(job);
+	
+	if (job.pidfd == -1 && !job.exited) {
+		int status = 0;
+		while (waitpid(job.pid, &status, WUNTRACED) == -1) {
+			if (errno != EINTR) {
+				term->failed_child();
+				exit(EXIT_CHILD_ERROR);
+			}
+		}
+		job.crashed = WIFEXITED(status) == 0;
+		job.exited = true;
+	}
+}
+
+/* handle_exit reaps the given job's simulation after its pidfd reports that it exited
+	parameters:
+		job: the job whose simulation exited
+	returns: nothing
+	notes:
+		Whatever the simulation wrote before exiting is still in the pipe and is read here, while parameter sets it never read are given up.
+		A simulation that was killed or crashed is not waited on for the rest of its scores, since processes it started may still hold its score pipe open; the job fails at once instead.
+	todo:
+*/
+void handle_exit (sim_job& job) {
+	int status = 0;
+	if (waitpid(job.pid, &status, WNOHANG | WUNTRACED) == 0) {
+		return;
+	}
+	job.crashed = WIFEXITED(status) == 0;
+	close(job.pidfd);
+	job.pidfd = -1;
+	job.exited = true;
+	close_request(job);
+	handle_reply(job);
+	if (!job.replied && (job.timed_out || job.crashed)) {
+		if (close(job.fd_read) == -1) {
+			term->failed_pipe_read();
+			exit(EXIT_PIPE_READ_ERROR);
+		}
+		job.fd_read = -1;
+		job.replied = true;
+	}
+}
+
+/* complete_job applies the outcome of the given slot's job once its simulation has replied and exited
+	parameters:
+		slot: the slot of the job
+	returns: true if the job finished and its slot is free again, false if its sets were launched again in the same slot
+	notes:
+		A simulation that crashed, timed out, stopped reading its parameter sets or sent too few scores is handled by the user's failure policy: stopping the sampler, simulating the sets again up to MAX_SIM_RETRIES times, or giving them the penalty fitness.
+	todo:
+*/
+bool complete_job (int slot) {
+	sim_job& job = supervisor->jobs[slot];
+	bool succeeded = !job.crashed && !job.timed_out && job.bytes_read == sizeof(int) * 2 * job.num_sets;
+	if (succeeded) {
+		record_latency(job.started, job.num_sets);
+		finish_job(slot);
+		return true;
+	}
+	
+	if (!job.timed_out) {
+		evals.crashed++;
+	}
+	count_wasted(job.num_sets);
+	if (ip.on_failure == FAILURE_EXIT) {
+		exit_failed_simulation(job.timed_out, job.crashed);
+	}
+	if (ip.on_failure == FAILURE_RETRY && job.attempts < MAX_SIM_RETRIES) {
+		evals.retried++;
+		launch_job(slot, job.id, job.sets, job.num_sets, job.scores, job.attempts + 1);
+		return false;
+	}
+	penalize_sets(job.scores, job.num_sets);
+	finish_job(slot);
+	return true;
+}
+
+/* finish_job frees the given slot's job so the slot can be used again
+	parameters:
+		slot: the slot of the finished job
+	returns: nothing
+	notes:
+		The job's reply array is kept for the next job launched in the slot.
+	todo:
+*/
+void finish_job (int slot) {
+	sim_job& job = supervisor->jobs[slot];
+	job.pid = 0;
+	supervisor->running--;
+}
@@ -0,0 +1,45 @@
+/*
+Stochastically ranked evolutionary strategy sampler for zebrafish segmentation
+Copyright (C) 2013 Ahmet Ay, Jack Holland, Adriana Sperlea, Sebastian Sangervasi
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+supervisor.hpp contains function declarations for supervisor.cpp.
+*/
+
+#ifndef SUPERVISOR_HPP
+#define SUPERVISOR_HPP
+
+#include "structs.hpp"
+
+void init_supervisor(input_params&);
+void free_supervisor();
+void simulate_sets_supervised(double*[], int, int, double[]);
+bool supervisor_full();
+int supervisor_submit(int, double*[], int, double[]);
+void launch_job(int, int, double*[], int, double[], int);
+int supervisor_wait(int*, int);
+int epoll_timeout(double);
+void kill_stragglers();
+void watch_fd(int, int, int);
+void handle_request(sim_job&);
+void close_request(sim_job&);
+void handle_reply(sim_job&);
+void handle_exit(sim_job&);
+bool complete_job(int);
+void finish_job(int);
+
+#endif